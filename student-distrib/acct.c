@@ -0,0 +1,209 @@
+#include "acct.h"
+#include "smp.h"
+#include "sched.h"
+#include "clock.h"
+#include "timer.h"
+#include "device.h"
+#include "kstack.h"
+#include "page.h"
+
+/* counters of the process in each pid slot, cleared when execute hands the slot out */
+static proc_acct_t proc_acct[MAX_PROCESSES];
+
+static const table_pointer_t procstat_ops = { device_open_none, device_close_none, procstat_read, procstat_write };
+
+/* 
+ *   acct_init
+ *   DESCRIPTION: Registers the "procstat" device
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void acct_init(void) {
+    register_device("procstat", &procstat_ops);
+}
+
+/* 
+ *   acct_start
+ *   DESCRIPTION: Clears the counters of a pid slot for the program execute is starting in it
+ *   INPUTS: pid -- slot, name -- program
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void acct_start(int32_t pid, const int8_t* name) {
+    memset(&proc_acct[pid], 0, sizeof(proc_acct_t));
+    strncpy(proc_acct[pid].name, name, ACCT_NAME_LEN - 1);
+    proc_acct[pid].started = timer_ticks();
+}
+
+/* 
+ *   acct_name
+ *   DESCRIPTION: Program a pid slot runs, a forked child runs the same one
+ *   INPUTS: pid -- slot
+ *   OUTPUTS: the name acct_start was given
+ *   SIDE EFFECTS: none
+ */
+const int8_t* acct_name(int32_t pid) {
+    return proc_acct[pid].name;
+}
+
+/* 
+ *   acct_charge
+ *   DESCRIPTION: Charges the cycles since this cpu's last boundary to the process running on it, as user time
+ *   when the cpu is coming into the kernel and as kernel time otherwise. Called on every way into and out of
+ *   user mode and before the cpu's process changes. An idle cpu only moves the boundary
+ *   INPUTS: user -- 1 when the time since the last boundary was spent in user mode
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller has interrupts off
+ */
+void acct_charge(int32_t user) {
+    cpu_t* cpu = this_cpu();
+    uint64_t now = rdtsc();
+
+    if (cpu->pid >= 0) {
+        if (user) {
+            proc_acct[cpu->pid].user_cycles += now - cpu->acct_tsc;
+        } else {
+            proc_acct[cpu->pid].kernel_cycles += now - cpu->acct_tsc;
+        }
+    }
+    cpu->acct_tsc = now;
+}
+
+/* 
+ *   acct_switch / acct_syscall / acct_page_fault
+ *   DESCRIPTION: Count a task switch away from the process on this cpu, a system call and a page fault
+ *   INPUTS: preempted -- 1 if the process could have kept running, pid -- process
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void acct_switch(int32_t preempted) {
+    int32_t pid = this_cpu()->pid;
+
+    if (pid >= 0) {
+        proc_acct[pid].switches++;
+        proc_acct[pid].preempted += (preempted != 0);
+    }
+}
+
+void acct_syscall(int32_t pid) {
+    if (pid >= 0 && pid < MAX_PROCESSES) {
+        proc_acct[pid].syscalls++;
+    }
+}
+
+void acct_page_fault(int32_t pid) {
+    if (pid >= 0 && pid < MAX_PROCESSES) {
+        proc_acct[pid].page_faults++;
+    }
+}
+
+/* 
+ *   cycles_to_us
+ *   DESCRIPTION: TSC cycles to microseconds in two divisions small enough for div64_32
+ *   INPUTS: cycles
+ *   OUTPUTS: microseconds
+ *   SIDE EFFECTS: none
+ */
+static uint64_t cycles_to_us(uint64_t cycles) {
+    uint32_t ns;
+    uint32_t sec = div64_32(clock_cycles_to_ns(cycles), 1000000000, &ns);
+
+    return (uint64_t)sec * 1000000 + ns / 1000;
+}
+
+/* 
+ *   procstat_read
+ *   DESCRIPTION: Reads a proc_stats_t snapshot of every live process, like a regular file. A process running
+ *   on another cpu has not been charged since it last entered the kernel, so the time since is added in
+ *   INPUTS: fd -- file descriptor, buf -- destination, nbytes -- size of buf
+ *   OUTPUTS: number of bytes copied, 0 at the end
+ *   SIDE EFFECTS: advances the file position
+ */
+int32_t procstat_read(int32_t fd, void* buf, int32_t nbytes) {
+    static proc_stats_t snap;
+    proc_stat_t* ps;
+    pcb_t* pcb;
+    task_t* task;
+    uint64_t user, kernel, now;
+    uint32_t flags;
+    int32_t pid, c;
+
+    cli_and_save(flags);
+    acct_charge(0);
+    memset(&snap, 0, sizeof(snap));
+    snap.uptime_ms = timer_ticks();
+    now = rdtsc();
+    for (pid = 0; pid < MAX_PROCESSES; pid++) {
+        if (!available_process[pid]) {
+            continue;
+        }
+        pcb = PCB_ADDR(pid);
+        ps = &snap.proc[snap.num_procs++];
+        user = proc_acct[pid].user_cycles;
+        kernel = proc_acct[pid].kernel_cycles;
+
+        ps->pid = pid;
+        ps->parent = pcb->parent_id;
+        ps->terminal = pcb->terminal;
+        ps->nice = pcb->nice;
+        task = sched_task_of(pid);
+        if (pcb->zombie) {
+            ps->state = PROC_ZOMBIE;
+        } else if (task == NULL) {
+            ps->state = PROC_CHILD;
+        } else if (task->state == TASK_RUNNABLE) {
+            ps->state = PROC_READY;
+        } else if (task->state == TASK_WAITING) {
+            ps->state = PROC_SLEEPING;
+        } else {
+            ps->state = PROC_RUNNING;
+        }
+        for (c = 0; c < num_cpus; c++) {
+            if (&cpus[c] != this_cpu() && cpus[c].current != NULL && cpus[c].pid == pid) {
+                if (cpus[c].bkl_depth == 0) {
+                    user += now - cpus[c].acct_tsc;
+                } else {
+                    kernel += now - cpus[c].acct_tsc;
+                }
+            }
+        }
+        ps->user_us = cycles_to_us(user);
+        ps->kernel_us = cycles_to_us(kernel);
+        ps->switches = proc_acct[pid].switches;
+        ps->preempted = proc_acct[pid].preempted;
+        ps->syscalls = proc_acct[pid].syscalls;
+        ps->page_faults = proc_acct[pid].page_faults;
+        ps->age_ms = snap.uptime_ms - proc_acct[pid].started;
+        ps->kstack_used = kstack_used(pid);
+        ps->user_pages = page_user_pages(pid);
+        memcpy(ps->name, proc_acct[pid].name, ACCT_NAME_LEN);
+    }
+    restore_flags(flags);
+
+    return device_read_snapshot(fd, &snap, sizeof(snap), buf, nbytes);
+}
+
+/* 
+ *   procstat_write
+ *   DESCRIPTION: Any write clears the counters of every process, their names and start times stay
+ *   INPUTS: ignored
+ *   OUTPUTS: nbytes
+ *   SIDE EFFECTS: none
+ */
+int32_t procstat_write(int32_t fd, const void* buf, int32_t nbytes) {
+    uint32_t flags;
+    int32_t pid;
+
+    cli_and_save(flags);
+    for (pid = 0; pid < MAX_PROCESSES; pid++) {
+        proc_acct[pid].user_cycles = 0;
+        proc_acct[pid].kernel_cycles = 0;
+        proc_acct[pid].switches = 0;
+        proc_acct[pid].preempted = 0;
+        proc_acct[pid].syscalls = 0;
+        proc_acct[pid].page_faults = 0;
+    }
+    restore_flags(flags);
+    return nbytes;
+}
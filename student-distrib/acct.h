@@ -0,0 +1,66 @@
+#ifndef _X_ACCT_H
+#define _X_ACCT_H
+
+#include "types.h"
+#include "system_calls.h"
+
+/* longest program name kept, a file name and its '\0' */
+#define ACCT_NAME_LEN   33
+
+/* what a process has used since it was executed, kept per pid slot like the strace rings */
+typedef struct proc_acct {
+    uint64_t user_cycles;
+    uint64_t kernel_cycles;
+    uint32_t switches;              //times its terminal's task was switched away from while it was on top
+    uint32_t preempted;             //those that happened while it could still run
+    uint32_t syscalls;
+    uint32_t page_faults;
+    uint32_t started;               //timer tick it was executed at
+    int8_t name[ACCT_NAME_LEN];     //program it runs
+} proc_acct_t;
+
+/* process states the procstat device reports */
+#define PROC_RUNNING    0           //on a cpu now
+#define PROC_READY      1           //its task is on a run queue
+#define PROC_SLEEPING   2           //its task waits for input, a timer or the rtc
+#define PROC_CHILD      3           //in execute, waiting for a child to halt
+#define PROC_ZOMBIE     4           //forked and halted, waiting for its parent to wait
+
+/* one process as the procstat device reads it, the layout is shared with the user level top tool */
+typedef struct proc_stat {
+    uint64_t user_us;
+    uint64_t kernel_us;
+    int32_t pid;
+    int32_t parent;
+    int32_t terminal;
+    int32_t nice;
+    uint32_t state;
+    uint32_t switches;
+    uint32_t preempted;
+    uint32_t syscalls;
+    uint32_t page_faults;
+    uint32_t age_ms;                //time since it was executed
+    uint32_t kstack_used;           //deepest its kernel stack has been, in bytes
+    uint32_t user_pages;            //4KB pages mapped in its user space
+    int8_t name[ACCT_NAME_LEN];
+} proc_stat_t;
+
+/* what the procstat device reads, only the first num_procs entries are filled in */
+typedef struct proc_stats {
+    uint32_t uptime_ms;
+    uint32_t num_procs;
+    proc_stat_t proc[MAX_PROCESSES];
+} proc_stats_t;
+
+void acct_init(void);
+void acct_start(int32_t pid, const int8_t* name);
+const int8_t* acct_name(int32_t pid);
+void acct_charge(int32_t user);
+void acct_switch(int32_t preempted);
+void acct_syscall(int32_t pid);
+void acct_page_fault(int32_t pid);
+
+int32_t procstat_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t procstat_write(int32_t fd, const void* buf, int32_t nbytes);
+
+#endif
@@ -0,0 +1,383 @@
+#include "apic.h"
+#include "lib.h"
+#include "page.h"
+#include "klog.h"
+
+int32_t apic_enabled = 0;
+uint8_t apic_cpu_ids[MAX_CPUS];
+int32_t apic_num_cpus = 0;
+
+/* what apic_probe found in the MP table */
+static uint32_t lapic_base = 0;
+static uint32_t ioapic_base = 0;
+static int32_t ioapic_pins = 0;
+static int32_t has_imcr = 0;
+/* IOAPIC pin and polarity/trigger bits for each ISA irq, -1 for irqs with no pin */
+static int32_t irq_pin[ISA_IRQS];
+static uint32_t irq_mode[ISA_IRQS];
+/* low half of each irq's redirection entry, so masking is one register write */
+static uint32_t irq_redir[ISA_IRQS];
+
+/*
+ *   lapic_read / lapic_write
+ *   DESCRIPTION: Local APIC register access, the registers are 32 bits wide and 16 byte aligned
+ *   INPUTS: reg -- offset from the base, value -- what to write
+ *   OUTPUTS: the register value for the read
+ *   SIDE EFFECTS: none
+ */
+static inline uint32_t lapic_read(uint32_t reg) {
+    return *(volatile uint32_t*)(lapic_base + reg);
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    *(volatile uint32_t*)(lapic_base + reg) = value;
+}
+
+/*
+ *   ioapic_read / ioapic_write
+ *   DESCRIPTION: IOAPIC register access through the select and window registers
+ *   INPUTS: reg -- register index, value -- what to write
+ *   OUTPUTS: the register value for the read
+ *   SIDE EFFECTS: changes the selected register, callers have interrupts off
+ */
+static inline uint32_t ioapic_read(uint32_t reg) {
+    *(volatile uint32_t*)(ioapic_base + IOAPIC_REGSEL) = reg;
+    return *(volatile uint32_t*)(ioapic_base + IOAPIC_WINDOW);
+}
+
+static inline void ioapic_write(uint32_t reg, uint32_t value) {
+    *(volatile uint32_t*)(ioapic_base + IOAPIC_REGSEL) = reg;
+    *(volatile uint32_t*)(ioapic_base + IOAPIC_WINDOW) = value;
+}
+
+/*
+ *   mp_checksum(const uint8_t* p, uint32_t len)
+ *   DESCRIPTION: MP structures are valid when their bytes add up to 0
+ *   INPUTS: p -- start, len -- length in bytes
+ *   OUTPUTS: 1 if the sum is 0
+ *   SIDE EFFECTS: none
+ */
+static int32_t mp_checksum(const uint8_t* p, uint32_t len) {
+    uint8_t sum = 0;
+
+    while (len-- > 0) {
+        sum += *p++;
+    }
+    return sum == 0;
+}
+
+/*
+ *   mp_scan(uint32_t start, uint32_t len)
+ *   DESCRIPTION: Looks for the MP floating pointer, which sits on a 16 byte boundary
+ *   INPUTS: start -- physical address, len -- bytes to search
+ *   OUTPUTS: the floating pointer or NULL
+ *   SIDE EFFECTS: none
+ */
+static mp_float_t* mp_scan(uint32_t start, uint32_t len) {
+    uint32_t addr;
+
+    for (addr = start; addr + sizeof(mp_float_t) <= start + len; addr += 16) {
+        if (*(uint32_t*)addr == MP_FLOAT_SIGNATURE && mp_checksum((uint8_t*)addr, sizeof(mp_float_t))) {
+            return (mp_float_t*)addr;
+        }
+    }
+    return NULL;
+}
+
+/*
+ *   mp_find()
+ *   DESCRIPTION: Searches where the MP specification says the floating pointer can be: the first KB of the
+ *   EBDA, the last KB of base memory, then the BIOS ROM
+ *   INPUTS: none
+ *   OUTPUTS: the floating pointer or NULL
+ *   SIDE EFFECTS: reads physical memory, so paging must still be off
+ */
+static mp_float_t* mp_find(void) {
+    mp_float_t* mpf = NULL;
+    uint32_t ebda = (uint32_t)(*(uint16_t*)BDA_EBDA_SEGMENT) << 4;
+    uint32_t base_kb = *(uint16_t*)BDA_BASE_MEM_KB;
+
+    if (ebda != 0) {
+        mpf = mp_scan(ebda, 1024);
+    }
+    if (mpf == NULL && base_kb != 0) {
+        mpf = mp_scan(base_kb * 1024 - 1024, 1024);
+    }
+    if (mpf == NULL) {
+        mpf = mp_scan(BIOS_ROM_START, BIOS_ROM_END - BIOS_ROM_START);
+    }
+    return mpf;
+}
+
+/*
+ *   apic_probe()
+ *   DESCRIPTION: Checks for a local APIC and reads the MP configuration table for the cpus, the IOAPIC and how
+ *   the ISA irqs are wired to it. Nothing is programmed yet
+ *   INPUTS: none
+ *   OUTPUTS: 0 when the APICs can be used, -1 to stay on the 8259
+ *   SIDE EFFECTS: must run before paging, the tables are in memory that is not mapped afterwards
+ */
+int32_t apic_probe(void) {
+    uint32_t eax, ebx, ecx, edx;
+    mp_float_t* mpf;
+    mp_config_t* mpc;
+    uint8_t* entry;
+    int32_t isa_bus = -1;
+    int32_t i;
+
+    cpuid(1, eax, ebx, ecx, edx);
+    if (!(edx & CPUID_APIC)) {
+        return -1;
+    }
+    mpf = mp_find();
+    /* default configurations (feature1 != 0) have no table to say where IRQ0 goes, leave those to the 8259 */
+    if (mpf == NULL || mpf->config == 0 || mpf->feature1 != 0) {
+        return -1;
+    }
+    mpc = (mp_config_t*)mpf->config;
+    if (mpc->signature != MP_CONFIG_SIGNATURE || !mp_checksum((uint8_t*)mpc, mpc->length)) {
+        return -1;
+    }
+    has_imcr = (mpf->feature2 & MP_FEATURE2_IMCR) != 0;
+    lapic_base = mpc->lapic;
+
+    /* ISA irqs go to the pin of the same number unless an entry says otherwise, edge triggered active high */
+    for (i = 0; i < ISA_IRQS; i++) {
+        irq_pin[i] = i;
+        irq_mode[i] = 0;
+    }
+    /* the 8259 cascade is not an irq of its own */
+    irq_pin[2] = -1;
+
+    entry = (uint8_t*)(mpc + 1);
+    for (i = 0; i < mpc->entries; i++) {
+        switch (*entry) {
+        case MP_ENTRY_PROCESSOR: {
+            mp_processor_t* proc = (mp_processor_t*)entry;
+            if ((proc->flags & MP_PROC_ENABLED) && apic_num_cpus < MAX_CPUS) {
+                /* keep the boot cpu in slot 0 */
+                if ((proc->flags & MP_PROC_BSP) && apic_num_cpus > 0) {
+                    apic_cpu_ids[apic_num_cpus] = apic_cpu_ids[0];
+                    apic_cpu_ids[0] = proc->apic_id;
+                } else {
+                    apic_cpu_ids[apic_num_cpus] = proc->apic_id;
+                }
+                apic_num_cpus++;
+            }
+            entry += sizeof(mp_processor_t);
+            break;
+        }
+        case MP_ENTRY_BUS: {
+            mp_bus_t* bus = (mp_bus_t*)entry;
+            if (strncmp((int8_t*)bus->name, (int8_t*)"ISA", 3) == 0) {
+                isa_bus = bus->bus_id;
+            }
+            entry += sizeof(mp_bus_t);
+            break;
+        }
+        case MP_ENTRY_IOAPIC: {
+            mp_ioapic_t* io = (mp_ioapic_t*)entry;
+            /* only the first IOAPIC is used, the ISA irqs are on it */
+            if ((io->flags & 1) && ioapic_base == 0) {
+                ioapic_base = io->address;
+            }
+            entry += sizeof(mp_ioapic_t);
+            break;
+        }
+        case MP_ENTRY_IOINT: {
+            mp_ioint_t* irq = (mp_ioint_t*)entry;
+            if (irq->irq_type == MP_IOINT_INT && irq->src_bus == isa_bus && irq->src_irq < ISA_IRQS) {
+                irq_pin[irq->src_irq] = irq->dst_pin;
+                irq_mode[irq->src_irq] =
+                    ((irq->flags & MP_POLARITY_LOW) == MP_POLARITY_LOW ? IOAPIC_ACTIVE_LOW : 0) |
+                    ((irq->flags & MP_TRIGGER_LEVEL) == MP_TRIGGER_LEVEL ? IOAPIC_LEVEL : 0);
+            }
+            entry += sizeof(mp_ioint_t);
+            break;
+        }
+        case MP_ENTRY_LINT:
+            entry += sizeof(mp_ioint_t);
+            break;
+        default:
+            /* unknown entry, its length is unknown too */
+            i = mpc->entries;
+            break;
+        }
+    }
+    if (lapic_base == 0 || ioapic_base == 0) {
+        return -1;
+    }
+    if (apic_num_cpus == 0) {
+        apic_num_cpus = 1;
+    }
+    return 0;
+}
+
+/*
+ *   lapic_cpu_init
+ *   DESCRIPTION: Enables the local APIC of the calling cpu: spurious vector, all priorities accepted, the
+ *   8259 line masked and NMI on LINT1. Every cpu has its own local APIC at the same address
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: the registers must already be mapped by apic_init
+ */
+void lapic_cpu_init(void) {
+    uint32_t lo, hi;
+
+    rdmsr(IA32_APIC_BASE, lo, hi);
+    wrmsr(IA32_APIC_BASE, (lo & ~APIC_BASE_MASK) | lapic_base | APIC_BASE_ENABLE, hi);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+}
+
+/*
+ *   apic_init()
+ *   DESCRIPTION: Switches interrupt delivery from the 8259 to the IOAPIC and the local APIC when apic_probe
+ *   found them. The 8259 is masked (and disconnected through the IMCR where there is one), the local APIC is
+ *   enabled, and every ISA irq gets a masked redirection entry to the boot cpu with its old vector
+ *   INPUTS: none
+ *   OUTPUTS: 0 when the APICs are in use, -1 when the 8259 stays
+ *   SIDE EFFECTS: maps the APIC registers, interrupts must be off
+ */
+int32_t apic_init(void) {
+    uint32_t bsp;
+    int32_t i;
+
+    if (lapic_base == 0 || ioapic_base == 0) {
+        klog(KLOG_INFO, "apic: none found, using the 8259");
+        return -1;
+    }
+    mmio_paging(lapic_base);
+    mmio_paging(ioapic_base);
+
+    /* nothing may come through the 8259 any more */
+    if (has_imcr) {
+        outb(IMCR_REGISTER, IMCR_SELECT);
+        outb(IMCR_APIC, IMCR_DATA);
+    }
+    outb(0xFF, 0x21);
+    outb(0xFF, 0xA1);
+
+    lapic_cpu_init();
+    bsp = lapic_id();
+
+    ioapic_pins = ((ioapic_read(IOAPIC_VER) >> 16) & 0xFF) + 1;
+    for (i = 0; i < ioapic_pins; i++) {
+        ioapic_write(IOAPIC_REDTBL(i), IOAPIC_MASKED);
+    }
+    for (i = 0; i < ISA_IRQS; i++) {
+        if (irq_pin[i] < 0 || irq_pin[i] >= ioapic_pins) {
+            irq_pin[i] = -1;
+            continue;
+        }
+        /* fixed delivery, physical destination */
+        irq_redir[i] = IOAPIC_MASKED | irq_mode[i] | (IRQ_VECTOR_BASE + i);
+        ioapic_write(IOAPIC_REDTBL(irq_pin[i]) + 1, bsp << 24);
+        ioapic_write(IOAPIC_REDTBL(irq_pin[i]), irq_redir[i]);
+    }
+
+    apic_enabled = 1;
+    klog(KLOG_INFO, "apic: local APIC %u at %#x, IOAPIC at %#x with %u pins, IRQ0 on pin %d, %u cpus",
+            bsp, lapic_base, ioapic_base, ioapic_pins, irq_pin[0], apic_num_cpus);
+    return 0;
+}
+
+/*
+ *   lapic_id()
+ *   DESCRIPTION: APIC id of the cpu running this
+ *   INPUTS: none
+ *   OUTPUTS: the id
+ *   SIDE EFFECTS: none
+ */
+uint32_t lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+/*
+ *   apic_irq_mask(uint32_t irq, int32_t masked)
+ *   DESCRIPTION: Masks or unmasks an ISA irq at the IOAPIC, using the cached entry so no register is read
+ *   INPUTS: irq -- ISA irq number, masked -- 1 to mask
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void apic_irq_mask(uint32_t irq, int32_t masked) {
+    uint32_t flags;
+
+    if (irq >= ISA_IRQS || irq_pin[irq] < 0) {
+        return;
+    }
+    cli_and_save(flags);
+    if (masked) {
+        irq_redir[irq] |= IOAPIC_MASKED;
+    } else {
+        irq_redir[irq] &= ~IOAPIC_MASKED;
+    }
+    ioapic_write(IOAPIC_REDTBL(irq_pin[irq]), irq_redir[irq]);
+    restore_flags(flags);
+}
+
+/*
+ *   apic_eoi()
+ *   DESCRIPTION: Ends the interrupt being serviced, one register write
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void apic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/*
+ *   lapic_send
+ *   DESCRIPTION: Sends an interprocessor interrupt and waits for the local APIC to accept it
+ *   INPUTS: apic_id -- destination, ignored for the shorthand destinations, icr -- low ICR word
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+static void lapic_send(uint32_t apic_id, uint32_t icr) {
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, icr);
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING);
+}
+
+/*
+ *   lapic_send_ipi
+ *   DESCRIPTION: Interrupts another cpu with a fixed vector
+ *   INPUTS: apic_id -- destination cpu, vector -- IDT vector it runs
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void lapic_send_ipi(uint32_t apic_id, uint32_t vector) {
+    lapic_send(apic_id, LAPIC_ICR_FIXED | vector);
+}
+
+/*
+ *   lapic_send_others
+ *   DESCRIPTION: Interrupts every cpu but this one with a fixed vector
+ *   INPUTS: vector -- IDT vector they run
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void lapic_send_others(uint32_t vector) {
+    lapic_send(0, LAPIC_ICR_OTHERS | LAPIC_ICR_FIXED | vector);
+}
+
+/*
+ *   lapic_send_init / lapic_send_startup
+ *   DESCRIPTION: The INIT and STARTUP IPIs that wake an application processor. STARTUP starts it in real
+ *   mode at page << 12
+ *   INPUTS: apic_id -- cpu to start, page -- 4KB page below 1MB holding its first instruction
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: the INIT resets the cpu
+ */
+void lapic_send_init(uint32_t apic_id) {
+    lapic_send(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL | LAPIC_ICR_ASSERT);
+    lapic_send(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+}
+
+void lapic_send_startup(uint32_t apic_id, uint32_t page) {
+    lapic_send(apic_id, LAPIC_ICR_STARTUP | (page & 0xFF));
+}
@@ -0,0 +1,158 @@
+#ifndef _X_APIC_H
+#define _X_APIC_H
+
+#include "x86_desc.h"
+
+/* cpuid leaf 1 edx bit for an on-chip local APIC */
+#define CPUID_APIC              (1 << 9)
+#define IA32_APIC_BASE          0x1B
+#define APIC_BASE_ENABLE        (1 << 11)
+#define APIC_BASE_MASK          0xFFFFF000
+
+/* local APIC registers, offsets from its base */
+#define LAPIC_ID                0x20
+#define LAPIC_VERSION           0x30
+#define LAPIC_TPR               0x80
+#define LAPIC_EOI               0xB0
+#define LAPIC_SVR               0xF0
+#define LAPIC_LVT_LINT0         0x350
+#define LAPIC_LVT_LINT1         0x360
+#define LAPIC_LVT_ERROR         0x370
+#define LAPIC_ICR_LOW           0x300
+#define LAPIC_ICR_HIGH          0x310
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_LVT_MASKED        (1 << 16)
+#define LAPIC_LVT_NMI           (4 << 8)
+
+/* interrupt command register, low word */
+#define LAPIC_ICR_FIXED         (0 << 8)
+#define LAPIC_ICR_INIT          (5 << 8)
+#define LAPIC_ICR_STARTUP       (6 << 8)
+#define LAPIC_ICR_PENDING       (1 << 12)
+#define LAPIC_ICR_ASSERT        (1 << 14)
+#define LAPIC_ICR_LEVEL         (1 << 15)
+#define LAPIC_ICR_OTHERS        (3 << 18)
+
+/* IOAPIC registers, reached through the select and window registers */
+#define IOAPIC_REGSEL           0x00
+#define IOAPIC_WINDOW           0x10
+#define IOAPIC_VER              0x01
+#define IOAPIC_REDTBL(pin)      (0x10 + 2 * (pin))
+#define IOAPIC_MASKED           (1 << 16)
+#define IOAPIC_LEVEL            (1 << 15)
+#define IOAPIC_ACTIVE_LOW       (1 << 13)
+
+/* ISA irqs keep the vectors the 8259 gave them, spurious interrupts get the last one */
+#define IRQ_VECTOR_BASE         0x20
+#define ISA_IRQS                16
+#define APIC_SPURIOUS_VECTOR    0xFF
+/* interprocessor interrupts: flush the TLB, and look at the run queue */
+#define IPI_TLB_VECTOR          0xFD
+#define IPI_RESCHED_VECTOR      0xFE
+
+/* IMCR, present when bit 7 of the second MP feature byte is set, routes the 8259 away from the cpu */
+#define IMCR_SELECT             0x22
+#define IMCR_DATA               0x23
+#define IMCR_REGISTER           0x70
+#define IMCR_APIC               0x01
+#define MP_FEATURE2_IMCR        0x80
+
+/* Intel MultiProcessor Specification 1.4 tables, which is how QEMU's BIOS describes the APICs */
+#define MP_FLOAT_SIGNATURE      0x5F504D5F      //"_MP_"
+#define MP_CONFIG_SIGNATURE     0x504D4350      //"PCMP"
+#define MP_ENTRY_PROCESSOR      0
+#define MP_ENTRY_BUS            1
+#define MP_ENTRY_IOAPIC         2
+#define MP_ENTRY_IOINT          3
+#define MP_ENTRY_LINT           4
+#define MP_PROC_ENABLED         0x01
+#define MP_PROC_BSP             0x02
+#define MP_IOINT_INT            0
+#define MP_POLARITY_LOW         0x03
+#define MP_TRIGGER_LEVEL        0x0C
+
+/* BIOS data area words giving the EBDA segment and the base memory size in KB */
+#define BDA_EBDA_SEGMENT        0x40E
+#define BDA_BASE_MEM_KB         0x413
+#define BIOS_ROM_START          0xF0000
+#define BIOS_ROM_END            0x100000
+
+typedef struct mp_float {
+    uint32_t signature;
+    uint32_t config;                //physical address of the configuration table
+    uint8_t length;                 //in 16 byte units
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t feature1;               //non zero means a default configuration, no table
+    uint8_t feature2;
+    uint8_t reserved[3];
+} __attribute__ ((packed)) mp_float_t;
+
+typedef struct mp_config {
+    uint32_t signature;
+    uint16_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t oem[8];
+    uint8_t product[12];
+    uint32_t oem_table;
+    uint16_t oem_size;
+    uint16_t entries;
+    uint32_t lapic;
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} __attribute__ ((packed)) mp_config_t;
+
+typedef struct mp_processor {
+    uint8_t type;
+    uint8_t apic_id;
+    uint8_t version;
+    uint8_t flags;
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+} __attribute__ ((packed)) mp_processor_t;
+
+typedef struct mp_bus {
+    uint8_t type;
+    uint8_t bus_id;
+    uint8_t name[6];
+} __attribute__ ((packed)) mp_bus_t;
+
+typedef struct mp_ioapic {
+    uint8_t type;
+    uint8_t id;
+    uint8_t version;
+    uint8_t flags;
+    uint32_t address;
+} __attribute__ ((packed)) mp_ioapic_t;
+
+typedef struct mp_ioint {
+    uint8_t type;
+    uint8_t irq_type;
+    uint16_t flags;
+    uint8_t src_bus;
+    uint8_t src_irq;
+    uint8_t dst_ioapic;
+    uint8_t dst_pin;
+} __attribute__ ((packed)) mp_ioint_t;
+
+/* set once apic_init has switched interrupt delivery over from the 8259 */
+extern int32_t apic_enabled;
+/* local APIC ids of the usable cpus the MP table lists, the boot cpu first */
+extern uint8_t apic_cpu_ids[MAX_CPUS];
+extern int32_t apic_num_cpus;
+
+int32_t apic_probe(void);
+int32_t apic_init(void);
+void lapic_cpu_init(void);
+uint32_t lapic_id(void);
+void lapic_send_ipi(uint32_t apic_id, uint32_t vector);
+void lapic_send_others(uint32_t vector);
+void lapic_send_init(uint32_t apic_id);
+void lapic_send_startup(uint32_t apic_id, uint32_t page);
+void apic_irq_mask(uint32_t irq, int32_t masked);
+void apic_eoi(void);
+
+#endif
@@ -0,0 +1,160 @@
+#include "clock.h"
+#include "lib.h"
+#include "klog.h"
+#include "page.h"
+
+/* TSC frequency found by clock_init, 1 until then so clock_ms cannot divide by zero */
+static uint32_t tsc_khz = 1;
+/* nanoseconds per cycle << CLOCK_SHIFT */
+static uint32_t ns_mult = 0;
+/* TSC at clock_init, time zero of the clock */
+static uint64_t tsc_boot = 0;
+
+/* 
+ *   div64_32(uint64_t n, uint32_t d, uint32_t* rem)
+ *   DESCRIPTION: 64 by 32 bit division with a single divl, since there is no libgcc for the C operator.
+ *   The quotient has to fit in 32 bits, so the high half of n must be below d
+ *   INPUTS: dividend, divisor, where to put the remainder (can be NULL)
+ *   OUTPUTS: quotient
+ *   SIDE EFFECTS: none
+ */
+uint32_t div64_32(uint64_t n, uint32_t d, uint32_t* rem) {
+    uint32_t q, r;
+
+    asm volatile ("divl %4"
+            : "=a"(q), "=d"(r)
+            : "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d)
+            : "cc");
+    if (rem != NULL) {
+        *rem = r;
+    }
+    return q;
+}
+
+/* 
+ *   pit_calibrate_once()
+ *   DESCRIPTION: Counts TSC cycles while PIT channel 2 counts down CLOCK_CALIBRATE_MS in one-shot mode
+ *   INPUTS: none
+ *   OUTPUTS: cycles in CLOCK_CALIBRATE_MS
+ *   SIDE EFFECTS: uses PIT channel 2 (the speaker channel) with the speaker off
+ */
+static uint32_t pit_calibrate_once(void) {
+    uint32_t count = PIT_HZ / (1000 / CLOCK_CALIBRATE_MS);
+    uint32_t flags;
+    uint64_t start;
+
+    cli_and_save(flags);
+    /* gate on, speaker off, then load the count, counting starts with the high byte */
+    outb((inb(PIT_GATE_PORT) & ~PIT_SPEAKER) | PIT_GATE2, PIT_GATE_PORT);
+    outb(PIT_CH2_ONESHOT, PIT_COMMAND);
+    outb(count & 0xFF, PIT_CHANNEL2);
+    outb((count >> 8) & 0xFF, PIT_CHANNEL2);
+    start = rdtsc();
+    /* the output goes high when the count reaches zero */
+    while (!(inb(PIT_GATE_PORT) & PIT_OUT2)) {}
+    start = rdtsc() - start;
+    restore_flags(flags);
+    return (uint32_t)start;
+}
+
+/* 
+ *   clock_init()
+ *   DESCRIPTION: Measures the TSC frequency against the PIT, taking the shortest of a few runs because
+ *   anything that interrupts a run only makes it longer, and starts the clock at zero
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: busy waits CLOCK_CALIBRATE_RUNS * CLOCK_CALIBRATE_MS
+ */
+void clock_init(void) {
+    uint32_t best = 0xFFFFFFFF;
+    uint32_t cycles;
+    int32_t i;
+
+    for (i = 0; i < CLOCK_CALIBRATE_RUNS; i++) {
+        cycles = pit_calibrate_once();
+        if (cycles < best) {
+            best = cycles;
+        }
+    }
+    tsc_khz = best / CLOCK_CALIBRATE_MS;
+    /* below ~4 MHz the factor would not fit in 32 bits, no TSC is that slow */
+    if (tsc_khz <= (1000000 >> (32 - CLOCK_SHIFT))) {
+        tsc_khz = (1000000 >> (32 - CLOCK_SHIFT)) + 1;
+    }
+    /* 10^6 ns per ms / cycles per ms, scaled by 2^CLOCK_SHIFT */
+    ns_mult = div64_32((uint64_t)1000000 << CLOCK_SHIFT, tsc_khz, NULL);
+    tsc_boot = rdtsc();
+    klog(KLOG_INFO, "clock: TSC at %u kHz", tsc_khz);
+}
+
+/* 
+ *   clock_tsc_khz()
+ *   DESCRIPTION: TSC frequency measured at boot
+ *   INPUTS: none
+ *   OUTPUTS: cycles per millisecond
+ *   SIDE EFFECTS: none
+ */
+uint32_t clock_tsc_khz(void) {
+    return tsc_khz;
+}
+
+/* 
+ *   clock_cycles_to_ns(uint64_t cycles)
+ *   DESCRIPTION: Converts a TSC difference to nanoseconds with a multiply and a shift
+ *   INPUTS: cycles
+ *   OUTPUTS: nanoseconds
+ *   SIDE EFFECTS: none
+ */
+uint64_t clock_cycles_to_ns(uint64_t cycles) {
+    uint64_t lo = (uint64_t)(uint32_t)cycles * ns_mult;
+    uint64_t hi = (uint64_t)(uint32_t)(cycles >> 32) * ns_mult;
+
+    return (lo >> CLOCK_SHIFT) + (hi << (32 - CLOCK_SHIFT));
+}
+
+/* 
+ *   clock_ns()
+ *   DESCRIPTION: Monotonic clock, nanoseconds since clock_init
+ *   INPUTS: none
+ *   OUTPUTS: nanoseconds
+ *   SIDE EFFECTS: none
+ */
+uint64_t clock_ns(void) {
+    return clock_cycles_to_ns(rdtsc() - tsc_boot);
+}
+
+/* 
+ *   clock_ms()
+ *   DESCRIPTION: Monotonic clock in milliseconds, wraps after 49 days
+ *   INPUTS: none
+ *   OUTPUTS: milliseconds since clock_init
+ *   SIDE EFFECTS: none
+ */
+uint32_t clock_ms(void) {
+    uint64_t cycles = rdtsc() - tsc_boot;
+    uint32_t rem;
+
+    /* divide the high half first so divl never overflows, the quotient of the high half is what wraps */
+    div64_32(cycles >> 32, tsc_khz, &rem);
+    return div64_32(((uint64_t)rem << 32) | (uint32_t)cycles, tsc_khz, NULL);
+}
+
+/* 
+ *   gettime(clock_time_t* t)
+ *   DESCRIPTION: System call, time since boot as seconds and nanoseconds
+ *   INPUTS: t -- user pointer to fill in
+ *   OUTPUTS: 0 on success, -1 for a pointer outside the pages the program has mapped
+ *   SIDE EFFECTS: none
+ */
+int32_t gettime(clock_time_t* t) {
+    uint64_t ns;
+    uint32_t rem;
+
+    if (!page_user_ok(t, sizeof(clock_time_t))) {
+        return -1;
+    }
+    ns = clock_ns();
+    t->sec = div64_32(ns, 1000000000, &rem);
+    t->nsec = rem;
+    return 0;
+}
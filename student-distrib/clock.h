@@ -0,0 +1,37 @@
+#ifndef _X_CLOCK_H
+#define _X_CLOCK_H
+
+#include "types.h"
+
+/* 8254 PIT, channel 2 is the one whose output can be read back through port 0x61 */
+#define PIT_HZ              1193182
+#define PIT_COMMAND         0x43
+#define PIT_CHANNEL2        0x42
+#define PIT_GATE_PORT       0x61
+#define PIT_GATE2           0x01    //channel 2 gate
+#define PIT_SPEAKER         0x02    //keep the speaker off
+#define PIT_OUT2            0x20    //channel 2 output
+#define PIT_CH2_ONESHOT     0xB0    //channel 2, low then high byte, mode 0
+
+/* length of one calibration run and how many runs to take the best of */
+#define CLOCK_CALIBRATE_MS  10
+#define CLOCK_CALIBRATE_RUNS 3
+
+/* fixed point shift of the cycles to nanoseconds factor */
+#define CLOCK_SHIFT         24
+
+/* what the gettime system call fills in, must match ece391syscall.h */
+typedef struct clock_time {
+    uint32_t sec;
+    uint32_t nsec;
+} clock_time_t;
+
+void clock_init(void);
+uint32_t clock_tsc_khz(void);
+uint64_t clock_cycles_to_ns(uint64_t cycles);
+uint64_t clock_ns(void);
+uint32_t clock_ms(void);
+uint32_t div64_32(uint64_t n, uint32_t d, uint32_t* rem);
+int32_t gettime(clock_time_t* t);
+
+#endif
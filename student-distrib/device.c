@@ -0,0 +1,80 @@
+#include "device.h"
+#include "lib.h"
+#include "smp.h"
+#include "system_calls.h"
+
+/* table of registered devices */
+static device_t devices[MAX_DEVICES];
+static int device_count = 0;
+
+/* 
+ *   register_device(const char* name, const table_pointer_t* ops)
+ *   DESCRIPTION: Adds a named device so that open() can hand out file descriptors for it.
+ *   Devices are looked up before the file system image, so they shadow files with the same name
+ *   INPUTS: name of the device (max 32 chars) and the jumptable for its file operations
+ *   OUTPUTS: 0 on success, -1 if the name is bad or the table is full
+ *   SIDE EFFECTS: NONE
+ */
+int32_t register_device(const char* name, const table_pointer_t* ops) {
+    if (name == NULL || ops == NULL) { return -1; }
+    if (strlen(name) > 32 || device_count >= MAX_DEVICES) { return -1; }
+
+    strncpy(devices[device_count].name, name, 33);
+    devices[device_count].ops = *ops;
+    device_count++;
+    return 0;
+}
+
+/* 
+ *   find_device(const uint8_t* name)
+ *   DESCRIPTION: Looks up a registered device by name
+ *   INPUTS: name of the device
+ *   OUTPUTS: pointer to the device jumptable, NULL if there is no such device
+ *   SIDE EFFECTS: NONE
+ */
+const table_pointer_t* find_device(const uint8_t* name) {
+    int i;
+    if (name == NULL) { return NULL; }
+    for (i = 0; i < device_count; i++) {
+        if (strncmp(devices[i].name, (const char *)name, 33) == 0) {
+            return &devices[i].ops;
+        }
+    }
+    return NULL;
+}
+
+/* 
+ *   device_open_none / device_close_none
+ *   DESCRIPTION: open and close of devices that keep all their per fd state in the file array entry
+ *   INPUTS: filename / fd
+ *   OUTPUTS: 0
+ *   SIDE EFFECTS: NONE
+ */
+int32_t device_open_none(const uint8_t* filename) {
+    return 0;
+}
+
+int32_t device_close_none(int32_t fd) {
+    return 0;
+}
+
+/* 
+ *   device_read_snapshot(int32_t fd, const void* snap, uint32_t size, void* buf, int32_t nbytes)
+ *   DESCRIPTION: Reads a snapshot struct the caller just filled like a regular file, from the fd's position on
+ *   INPUTS: fd -- file descriptor, snap/size -- the snapshot, buf -- destination, nbytes -- size of buf
+ *   OUTPUTS: number of bytes copied, 0 at the end
+ *   SIDE EFFECTS: advances the file position
+ */
+int32_t device_read_snapshot(int32_t fd, const void* snap, uint32_t size, void* buf, int32_t nbytes) {
+    file_entry_t* entry;
+    uint32_t left;
+
+    entry = &PCB_ADDR(this_cpu()->pid)->file_array[fd];
+    if (entry->position >= size) { return 0; }
+
+    left = size - entry->position;
+    if ((uint32_t)nbytes < left) { left = nbytes; }
+    memcpy(buf, (const uint8_t *)snap + entry->position, left);
+    entry->position += left;
+    return left;
+}
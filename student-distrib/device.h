@@ -0,0 +1,23 @@
+#ifndef _X_DEVICE_H
+#define _X_DEVICE_H
+
+#include "file_sys.h"
+
+/* max number of kernel devices that can be opened by name */
+#define MAX_DEVICES 8
+
+/* kernel device that open() finds by name before looking in the file system image */
+typedef struct device {
+    char name[33];
+    table_pointer_t ops;
+} device_t;
+
+int32_t register_device(const char* name, const table_pointer_t* ops);
+const table_pointer_t* find_device(const uint8_t* name);
+
+/* helpers for devices that hand out a snapshot struct */
+int32_t device_open_none(const uint8_t* filename);
+int32_t device_close_none(int32_t fd);
+int32_t device_read_snapshot(int32_t fd, const void* snap, uint32_t size, void* buf, int32_t nbytes);
+
+#endif
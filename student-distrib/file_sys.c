@@ -1,9 +1,15 @@
 #include "file_sys.h"
 #include "lib.h"
+#include "lock.h"
 
 /* global variable to hold the module address */
 uint32_t global_address = 0;
 
+/* serializes copies out of the image, a program load holds it for a whole 4 MB copy so waiters sleep */
+static mutex_t fs_lock;
+
+static int32_t fs_read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+
 /* 
  *   initialize_pointers(uint32_t module_address)
  *   DESCRIPTION: initializes the global stats of the file system through type casting and initializes the file array
@@ -15,6 +21,7 @@ uint32_t global_address = 0;
 void initialize_pointers(uint32_t module_address){
     /* initialize a global variable to hold the starting address of the file system */
     global_address = module_address;
+    mutex_init(&fs_lock, "fs");
     /* type casting the boot block, inodes, and data blocks to our defined structs */
     boot_block = (boot_block_t * )(module_address);
     inodes = (inode_t * )(module_address + BLOCK_SIZE);
@@ -85,10 +92,26 @@ int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry){
  *   SIDE EFFECTS: Buffer pointer stores contents of what has just been read 
  */
 int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
-    /* determine the current inode */
-    inode_t current_node = inodes[inode];
+    int32_t ret;
+
+    mutex_lock(&fs_lock);
+    ret = fs_read_data(inode, offset, buf, length);
+    mutex_unlock(&fs_lock);
+    return ret;
+}
+
+/* 
+ *   fs_read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length)
+ *   DESCRIPTION: read_data with fs_lock held
+ *   INPUTS: same as read_data
+ *   OUTPUTS: # of bytes read
+ *   SIDE EFFECTS: Buffer pointer stores contents of what has just been read 
+ */
+static int32_t fs_read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
+    /* determine the current inode, not copied: a 4KB copy would take half of a kernel stack */
+    inode_t* current_node = &inodes[inode];
     /* determine the actual size of the file */
-    uint32_t size_of_file = current_node.length;
+    uint32_t size_of_file = current_node->length;
 
     /*if the offset is past the size of the file, cannot complete read */
     if(offset > size_of_file){ return -1; }      
@@ -100,7 +123,7 @@ int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t lengt
     uint32_t offset_into_block = offset % BLOCK_SIZE;
 
     /* determine the actual block index by iterating through the current node data structure */
-    uint32_t real_idx = current_node.data_blocks[block_idx]; 
+    uint32_t real_idx = current_node->data_blocks[block_idx]; 
 
     /* initialize variables */
     uint32_t chars_read, can_read_in_this_block, dataRemaining, newOffset;
@@ -160,7 +183,7 @@ int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t lengt
             newOffset = 0;
             can_read_in_this_block = BLOCK_SIZE;
             /* determine the actual next data block */
-            real_idx = current_node.data_blocks[++block_idx];
+            real_idx = current_node->data_blocks[++block_idx];
         }
     }
 
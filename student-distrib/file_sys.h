@@ -1,3 +1,6 @@
+#ifndef _X_FILE_SYS_H
+#define _X_FILE_SYS_H
+
 #include "x86_desc.h"
 #include "keyboard.h"
 
@@ -48,6 +51,10 @@ typedef struct table_pointer {
     int32_t (*close) (int32_t fd);
     int32_t (*read) (int32_t fd, void* buf, int32_t nbytes);
     int32_t (*write) (int32_t fd, const void* buf, int32_t nbytes);   
+    /* device specific requests, NULL if the file type has none */
+    int32_t (*ioctl) (int32_t fd, int32_t request, void* arg);
+    /* takes another reference for the copy fork gives the child, NULL if closing a copy costs nothing */
+    int32_t (*dup) (int32_t fd);
 } table_pointer_t;
 
 //struct to hold a file descriptor array entry
@@ -83,3 +90,5 @@ int32_t open_dir (const uint8_t* filename);
 int32_t close_dir (int32_t fd);
 int32_t read_dir (int32_t fd, void* buf, int32_t nbytes);
 int32_t write_dir (int32_t fd, const void* buf, int32_t nbytes);
+
+#endif
@@ -4,8 +4,10 @@
 
 #include "i8259.h"
 #include "lib.h"
+#include "apic.h"
 
-/* Interrupt masks to determine which interrupts are enabled and disabled */
+/* Interrupt masks to determine which interrupts are enabled and disabled, kept here so changing one
+ * is a single outb */
 uint8_t master_mask; /* IRQs 0-7  */
 uint8_t slave_mask;  /* IRQs 8-15 */
 
@@ -41,38 +43,42 @@ void i8259_init(void) {
 
 //THIS IS DOING PROTEXTED MODE WE NEED TO DO REAL MODE
 
-//clear interrupt masks
+//clear interrupt masks, at the IOAPIC once apic_init has taken over
 void enable_irq(uint32_t irq_num) {
-    uint16_t port;
-    uint16_t value;
- 
+    if(apic_enabled){
+        apic_irq_mask(irq_num, 0);
+        return;
+    }
     if(irq_num < 8) {
-        port = 0x21; // Port is set to Master data
+        master_mask &= ~(1 << irq_num); // AND the value to Clear the mask
+        outb(master_mask, 0x21); // Port is set to Master data
     }else{
-		irq_num -= 8; // Subtract 8 to get IRQ for slave pic
-        port  = 0xA1; // Port is set to Slave data
+        slave_mask &= ~(1 << (irq_num - 8)); // Subtract 8 to get IRQ for slave pic
+        outb(slave_mask, 0xA1); // Port is set to Slave data
 	}
-    value = inb(port) & ~(1 << irq_num); // AND the value to Clear the mask
-    outb(value,port);
-
 }
 
 // mask interrupts
 void disable_irq(uint32_t irq_num) {
-    uint16_t port;
-    uint16_t value;
-
+    if(apic_enabled){
+        apic_irq_mask(irq_num, 1);
+        return;
+    }
     if(irq_num < 8) {
-		port = 0x21; // Port is set to Master data
+        master_mask |= 1 << irq_num; // OR the value to set the mask
+        outb(master_mask, 0x21); // Port is set to Master data
 	}else{
-		port = 0xA1; // Port is set to Slave data
-		irq_num -= 8; // Subtract 8 to get IRQ for slave pic
+        slave_mask |= 1 << (irq_num - 8); // Subtract 8 to get IRQ for slave pic
+        outb(slave_mask, 0xA1); // Port is set to Slave data
 	}
-    value = inb(port) | (1 << irq_num); // OR the value to set the mask
-    outb(value,port);
 }
 
+// the local APIC ends any interrupt with one register write
 void send_eoi(uint32_t irq_num) {
+    if(apic_enabled){
+        apic_eoi();
+        return;
+    }
     if(irq_num >= 8){
 		outb(EOI | 2, MASTER_8259_PORT); //OR End of interrupt with Slave IRQ on Master PIC then send that to the corresponding port
         outb(EOI | (irq_num-8), SLAVE_8259_PORT); //OR End of interrupt with IRQ on slave pic then send it to the corresponding port
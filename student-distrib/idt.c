@@ -1,4 +1,6 @@
 #include "idt.h"
+#include "apic.h"
+#include "smp.h"
 
 
 /* 
@@ -26,9 +28,12 @@ void idt_init(){
             idt[i].present = 1; //set exceptions to present
             idt[i].reserved3 = 0;
         }
-        if((i == 0x21) | (i == 0x28)){
+        if((i == 0x20) | (i == 0x21) | (i == 0x24) | (i == 0x28)){
             idt[i].present = 1; //set interrupts to present
         }
+        if((i == APIC_SPURIOUS_VECTOR) | (i == IPI_TLB_VECTOR) | (i == IPI_RESCHED_VECTOR)){
+            idt[i].present = 1;
+        }
         if(i == 0x80){
             idt[i].dpl = 3; //priority for system call
             idt[i].present = 1; //set system call to present
@@ -58,8 +63,13 @@ void idt_init(){
     SET_IDT_ENTRY(idt[19], SIMD_Floating_Point_exception_asm);
 
     //SET_IDT_ENTRY FOR INTERRUPTS
+    SET_IDT_ENTRY(idt[0x20], timer_handler_asm);
     SET_IDT_ENTRY(idt[0x21], keyboard_handler_asm);
+    SET_IDT_ENTRY(idt[0x24], serial_handler_asm);
     SET_IDT_ENTRY(idt[0x28], rtc_handler_asm);
+    SET_IDT_ENTRY(idt[APIC_SPURIOUS_VECTOR], apic_spurious_asm);
+    SET_IDT_ENTRY(idt[IPI_TLB_VECTOR], ipi_tlb_asm);
+    SET_IDT_ENTRY(idt[IPI_RESCHED_VECTOR], ipi_resched_asm);
 
     //SET_IDT_ENTRY FOR SYSTEM CALL
     SET_IDT_ENTRY(idt[0x80], idtSyscall_asm);
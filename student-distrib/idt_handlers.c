@@ -10,6 +10,9 @@
 #include "keyboard.h"
 #include "rtc.h"
 #include "system_calls.h"
+#include "smp.h"
+#include "acct.h"
+#include "page.h"
 
 #define MAX_IDT_ENTRY 255
 
@@ -199,12 +202,21 @@ void General_Protection_Fault(){
 
 /* 
  *   Page_Fault
- *   DESCRIPTION: Clear the screen, prints the current exception, and while loop to keep it stuck in the exception
- *   INPUTS: none
+ *   DESCRIPTION: Returns when the fault was a write to a copy on write page that page_cow_fault resolved or
+ *   the first touch of a heap or mmap page page_demand_fault backed, otherwise prints the current exception
+ *   and halts the process
+ *   INPUTS: error -- error code the cpu pushed
  *   OUTPUTS: none
  *   Return: none
  */
-void Page_Fault(){
+void Page_Fault(uint32_t error){
+    uint32_t cr2;
+
+    acct_page_fault(this_cpu()->pid);
+    asm volatile ("movl %%cr2, %0" : "=r"(cr2));
+    if(page_cow_fault(cr2, error) == 0 || page_demand_fault(cr2, error) == 0){
+        return;
+    }
     squashFlag = 1;
     printf("Exception occurred: Page_Fault \n");
     halt(MAX_IDT_ENTRY);
@@ -14,6 +14,19 @@
 #include "idt.h"
 // #include "file_sys.h"
 #include "system_calls.h"
+#include "sysenter.h"
+#include "syscall_trace.h"
+#include "tty.h"
+#include "serial.h"
+#include "klog.h"
+#include "clock.h"
+#include "timer.h"
+#include "apic.h"
+#include "smp.h"
+#include "sched.h"
+#include "lock.h"
+#include "acct.h"
+#include "kstack.h"
 
 //#define RUN_TESTS
 
@@ -21,19 +34,22 @@
 /* Check if the bit BIT in FLAGS is set. */
 #define CHECK_FLAG(flags, bit)   ((flags) & (1 << (bit)))
 
-/* Check if MAGIC is valid and print the Multiboot information structure
-   pointed by ADDR. */
+/* Check if MAGIC is valid and log the Multiboot information structure
+   pointed by ADDR, it can be read back with dmesg after boot. */
 void entry(unsigned long magic, unsigned long addr) {
 
     multiboot_info_t *mbi;
     unsigned int module_address;
+    int8_t bytes[16 * 5 + 1];
+    int32_t len;
 
-    /* Clear the screen. */
+    /* Blank the terminal backing pages and clear the screen. */
+    console_init();
     clear();
 
     /* Am I booted by a Multiboot-compliant boot loader? */
     if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
-        printf("Invalid magic number: 0x%#x\n", (unsigned)magic);
+        klog(KLOG_ERR, "Invalid magic number: 0x%#x\n", (unsigned)magic);
         return;
     }
 
@@ -41,48 +57,47 @@ void entry(unsigned long magic, unsigned long addr) {
     mbi = (multiboot_info_t *) addr;
 
     /* Print out the flags. */
-    printf("flags = 0x%#x\n", (unsigned)mbi->flags);
+    klog(KLOG_INFO, "flags = 0x%#x\n", (unsigned)mbi->flags);
 
     /* Are mem_* valid? */
     if (CHECK_FLAG(mbi->flags, 0))
-        printf("mem_lower = %uKB, mem_upper = %uKB\n", (unsigned)mbi->mem_lower, (unsigned)mbi->mem_upper);
+        klog(KLOG_INFO, "mem_lower = %uKB, mem_upper = %uKB\n", (unsigned)mbi->mem_lower, (unsigned)mbi->mem_upper);
 
     /* Is boot_device valid? */
     if (CHECK_FLAG(mbi->flags, 1))
-        printf("boot_device = 0x%#x\n", (unsigned)mbi->boot_device);
+        klog(KLOG_INFO, "boot_device = 0x%#x\n", (unsigned)mbi->boot_device);
 
     /* Is the command line passed? */
     if (CHECK_FLAG(mbi->flags, 2))
-        printf("cmdline = %s\n", (char *)mbi->cmdline);
+        klog(KLOG_INFO, "cmdline = %s\n", (char *)mbi->cmdline);
 
     if (CHECK_FLAG(mbi->flags, 3)) {
         int mod_count = 0;
         int i;
         module_t* mod = (module_t*)mbi->mods_addr;
         while (mod_count < mbi->mods_count) {
-            printf("Module %d loaded at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_start);
+            klog(KLOG_INFO, "Module %d loaded at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_start);
             /* assign the module address to mod_start. This is used to pass into the initialize pointers function */
             module_address = (unsigned int)mod->mod_start; 
-            printf("Module %d ends at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_end);
-            printf("First few bytes of module:\n");
-            for (i = 0; i < 16; i++) {
-                printf("0x%x ", *((char*)(mod->mod_start+i)));
+            klog(KLOG_INFO, "Module %d ends at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_end);
+            for (i = 0, len = 0; i < 16; i++) {
+                len += snprintf(bytes + len, sizeof(bytes) - len, "0x%x ", *((uint8_t*)(mod->mod_start+i)));
             }
-            printf("\n");
+            klog(KLOG_INFO, "First few bytes of module: %s\n", bytes);
             mod_count++;
             mod++;
         }
     }
     /* Bits 4 and 5 are mutually exclusive! */
     if (CHECK_FLAG(mbi->flags, 4) && CHECK_FLAG(mbi->flags, 5)) {
-        printf("Both bits 4 and 5 are set.\n");
+        klog(KLOG_ERR, "Both bits 4 and 5 are set.\n");
         return;
     }
 
     /* Is the section header table of ELF valid? */
     if (CHECK_FLAG(mbi->flags, 5)) {
         elf_section_header_table_t *elf_sec = &(mbi->elf_sec);
-        printf("elf_sec: num = %u, size = 0x%#x, addr = 0x%#x, shndx = 0x%#x\n",
+        klog(KLOG_INFO, "elf_sec: num = %u, size = 0x%#x, addr = 0x%#x, shndx = 0x%#x\n",
                 (unsigned)elf_sec->num, (unsigned)elf_sec->size,
                 (unsigned)elf_sec->addr, (unsigned)elf_sec->shndx);
     }
@@ -90,12 +105,12 @@ void entry(unsigned long magic, unsigned long addr) {
     /* Are mmap_* valid? */
     if (CHECK_FLAG(mbi->flags, 6)) {
         memory_map_t *mmap;
-        printf("mmap_addr = 0x%#x, mmap_length = 0x%x\n",
+        klog(KLOG_INFO, "mmap_addr = 0x%#x, mmap_length = 0x%x\n",
                 (unsigned)mbi->mmap_addr, (unsigned)mbi->mmap_length);
         for (mmap = (memory_map_t *)mbi->mmap_addr;
                 (unsigned long)mmap < mbi->mmap_addr + mbi->mmap_length;
                 mmap = (memory_map_t *)((unsigned long)mmap + mmap->size + sizeof (mmap->size)))
-            printf("    size = 0x%x, base_addr = 0x%#x%#x\n    type = 0x%x,  length    = 0x%#x%#x\n",
+            klog(KLOG_INFO, "    size = 0x%x, base_addr = 0x%#x%#x, type = 0x%x, length = 0x%#x%#x\n",
                     (unsigned)mmap->size,
                     (unsigned)mmap->base_addr_high,
                     (unsigned)mmap->base_addr_low,
@@ -147,10 +162,27 @@ void entry(unsigned long magic, unsigned long addr) {
     
     //init idt
     idt_init();
+    //double faults get a task of their own, a kernel stack that ran into its guard page cannot take them
+    kstack_init();
+
+    //program the sysenter MSRs for the fast system call path
+    sysenter_init();
 
     // initialize the pointers for file system
     initialize_pointers(module_address);
 
+    // syscall counters, per process rings and their devices
+    syscall_trace_init();
+    // lock contention counters and the process table lock
+    lock_init();
+    process_init();
+    // per process cpu time and counters, read through the procstat device
+    acct_init();
+    // TLB flush counters and user memory in use, read through the vmstat device
+    page_init();
+    // the boot messages logged so far become readable through the kmsg device
+    klog_init();
+
     //init pic
     i8259_init();
     //disable all interrupts in case
@@ -158,14 +190,30 @@ void entry(unsigned long magic, unsigned long addr) {
     for(disable = 0; disable < 16; disable++){
         disable_irq(disable);
     }
+    // the MP table is only reachable before paging, read it for apic_init
+    apic_probe();
     //start paging
     start_paging();         //initialize page directories and tables
+    // move interrupt delivery to the IOAPIC and local APIC when there are any
+    apic_init();
+
+    // measure the TSC against the PIT while nothing can interrupt
+    clock_init();
+
+    //the millisecond tick behind sleep, alarm and read timeouts
+    timer_init();
 
     //init devices
+    tty_init();
     kb_init();
 
     rtc_init();
 
+    // mirror everything printed to COM1 when there is a UART
+    if (serial_init() == 0) {
+        console_add_sink(serial_write);
+    }
+
     
     sti();
     /* Initialize devices, memory, filesystem, enable device interrupts on the
@@ -184,9 +232,13 @@ void entry(unsigned long magic, unsigned long addr) {
     /* Run tests */
     // launch_tests();
 #endif
-    /* Execute the first program ("shell") ... */
+    // start the other cpus, they wait for the kernel lock until this one goes idle
+    smp_init();
+    sched_init();
+
+    /* Execute the first program ("shell") on every terminal, this becomes cpu 0's idle loop */
     clear();
-    execute((const uint8_t*)"shell");
+    sched_start();
 
 
     /* Spin (nicely, so we don't chew up cycles) */
@@ -1,8 +1,10 @@
 #include "keyboard.h"
 #include "system_calls.h"
-
-#define buffEnd 127
-#define buffSize 128
+#include "tty.h"
+#include "timer.h"
+#include "smp.h"
+#include "page.h"
+#include "sched.h"
 
 //flags for holding down special keys
 int capsFlag = 0;
@@ -11,28 +13,23 @@ int rshiftFlag = 0;
 int altFlag = 0;
 int ctrlFlag = 0;
 
-static char line_buf[buffSize];
-
-/* buffer pointer array for typed in text for each terminal  */
-int bufPtr_arr[3] = {0, 0, 0};
-/* keep tracks of the buffer for each terminal*/
-static char buf_arr[3][buffSize];
+/* scancodes from the interrupt, only the top half moves kb_head and only the bottom half moves kb_tail */
+static volatile uint8_t kb_ring[KB_RING_SIZE];
+static volatile uint32_t kb_head = 0;
+static volatile uint32_t kb_tail = 0;
+/* set while the bottom half is draining the ring */
+static volatile int kb_bh_running = 0;
+/* scancodes lost because the ring was full */
+int kb_dropped = 0;
 
-/* keeps track of x and y position for each terminal */
-int x_arr[3] = {0,0,0};
-int y_arr[3] = {0,0,0};
+static int keyboard_bottom_half();
+static int keyboard_process(uint8_t scancode);
 
-int bufPtr = 0;
-int readPtr = 0;
-int enterFlag = 0;
 int terminal = 1;
 
 /* terminal addresses for vidmem to be mapped to based on switch  */
 void* VIDEO_PAGE_ADDRESS[4] = { 0, (void *)0xBA000, (void *)0xBC000, (void *)0xBE000 }; // 0 for indexing
 
-/* keeps track of process index that is current for each terminal */
-int top_terminal_pid[4] = { -1, -1, -1, -1 };
-
 int get_terminal(int t){
     return (int)VIDEO_PAGE_ADDRESS[t];
 }
@@ -52,20 +49,88 @@ void kb_init(){
 
 /* 
  *   keyboard_handler
- *   DESCRIPTION: Reads value from the keyboard and prints it to the screen to type
+ *   DESCRIPTION: Top half of the keyboard interrupt. Only reads the scancode into the ring, acknowledges the
+ *   interrupt and then runs the bottom half with interrupts enabled, so a screen scroll never holds up the RTC.
+ *   Every terminal's shell runs as its own task, so a terminal switch only changes what is on screen. Tasks
+ *   waiting for input are woken at the end
  *   INPUTS: none
  *   OUTPUTS: none
  *   Return: none
  */
 void keyboard_handler(){
-    //mask all interrupts    
-    cli();
-    //kernel_paging();
+    uint32_t head = kb_head;
+    uint8_t scancode = inb(0x60); //read from keyboard port
+    int next_terminal;
+
+    //interrupt gate, interrupts are off until the bottom half turns them on
+    if(head - kb_tail < KB_RING_SIZE){
+        kb_ring[head & (KB_RING_SIZE - 1)] = scancode;
+        kb_head = head + 1;    //publish after the scancode is stored
+    }else{
+        kb_dropped++;
+    }
+    send_eoi(1);
+
+    //the rest of the ring after a switch belongs to the new terminal
+    while((next_terminal = keyboard_bottom_half()) != 0){
+        setTerminal(next_terminal);
+    }
+    sched_wake_all();
+}
+
+/* 
+ *   keyboard_bottom_half
+ *   DESCRIPTION: Drains the scancode ring with interrupts enabled. Only one instance runs at a time, a keyboard
+ *   interrupt that arrives meanwhile just queues its scancode and this loop picks it up. Stops early when a
+ *   terminal switch is asked for, the rest of the ring belongs to the new terminal and is drained by the next
+ *   call once the caller has switched
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   Return: terminal to switch to, 0 for none. Returns with interrupts disabled
+ */
+static int keyboard_bottom_half(){
+    uint32_t tail;
+    uint8_t scancode;
+    int next_terminal = 0;
+
+    //called with interrupts off, so checking and setting the flag cannot be split by another interrupt
+    if(kb_bh_running){
+        return 0;
+    }
+    kb_bh_running = 1;
+
+    for(;;){
+        sti();
+        while((kb_tail != kb_head) && (next_terminal == 0)){
+            tail = kb_tail;
+            scancode = kb_ring[tail & (KB_RING_SIZE - 1)];
+            kb_tail = tail + 1;    //hand the slot back to the top half
+            next_terminal = keyboard_process(scancode);
+        }
+        //with interrupts off no scancode can come in between the last check and clearing the flag
+        cli();
+        if((next_terminal != 0) || (kb_tail == kb_head)){
+            break;
+        }
+    }
+    kb_bh_running = 0;
+    return next_terminal;
+}
+
+/* 
+ *   keyboard_process
+ *   DESCRIPTION: Translates one scancode, keeps track of the modifier keys and hands the character to the line
+ *   discipline of the terminal on screen
+ *   INPUTS: scancode -- raw scancode from the ring
+ *   OUTPUTS: none
+ *   Return: terminal to switch to when alt + F1/F2/F3 selects another terminal, else 0
+ */
+static int keyboard_process(uint8_t scancode){
+    char scan;
+    int next_terminal = 0;
+    tty_t* tty = tty_get(terminal);
     // initialize color
     colorFlag = 1;
-    int scancode = inb(0x60); //read from keyboard port
-    char scan;
-    enterFlag = 0; //flag to see if enter has been pressed or not
 
     //If the key we press is a special character then we raise a flag to use later
     switch(scancode){
@@ -123,217 +188,58 @@ void keyboard_handler(){
         //We do not want to print the special keys so we move on
         if((scan == F1) || (scan == F2) || (scan == F3) || (scancode == caps_clicked) || (scancode == alt_held) || (scancode == left_shift_held) || (scancode == right_shift_held) || (scancode == ctrl_held)){
             colorFlag = 0;
-            send_eoi(1);
-            sti();
-            return;
+            return 0;
         }
 
-        //backspace handling in buffer (clear curr character and move ptr back)
-        if((scan == '\b') && (bufPtr > 0)){
-            line_buf[bufPtr] = ' ';
-            bufPtr--;
-        } 
-        
-        //save last spot for enter key. Only add to buffer if it isn't the last spot
-        if((bufPtr < buffEnd) && (scan != '\b') && (scan != '\t')){
-            line_buf[bufPtr] = scan;
-            if(scan == '\n'){
-                enterFlag = 1;
-                //program_paging(top_terminal_pid[terminal], terminal);
-            }else{
-                bufPtr++;
-            }
-        }
-        //if enter key then we have to save the line buffer to the user buffer in terminal_read
-        if((scan == '\n') && (bufPtr == buffEnd)){
-            line_buf[bufPtr] = scan;
-            enterFlag = 1;
-            //program_paging(top_terminal_pid[terminal], terminal);
-        }
-        //special case for tab 
-        if(scan != '\t'){
-            putc(scan);//print to the screen 
+        //in raw mode Ctrl + letter reaches the program as the control code
+        if(ctrlFlag && tty->mode.raw && (keyMap[scancode] >= 'a') && (keyMap[scancode] <= 'z')){
+            tty_input(tty, keyMap[scancode] & 0x1F);
+        //Ctrl + l or Ctrl + L clears the screen and the line being typed
+        }else if(ctrlFlag && (keyMap[scancode] == 'l')){
+            tty_clear_screen(tty);
         }else{
-            //only add part of tab to the line buffer if it is near the end so we do not overflow
-            int tab;
-            int count;
-            switch(bufPtr){
-                //only one space left in buffer to fill
-                case 126:
-                    count = 1;
-                    break;
-                //only two space left in buffer to fill
-                case 125:
-                    count = 2;
-                    break;
-                //only three space left in buffer to fill
-                case 124:
-                    count = 3;
-                    break;
-                //only more than 3 spaces left in buffer to fill
-                default:
-                    count = 4;
-                    break;
-            }
-            if((count >= 1) && (count <=4)){
-                for(tab = 0; tab < count; tab++){
-                    line_buf[bufPtr] = ' ';
-                    bufPtr++;
-                }
-            }
-            //always print tab on the screen as four spaces
-            putc(' ');
-            putc(' ');
-            putc(' ');
-            putc(' ');
+            tty_input(tty, scan);
         }
     }
 
-    //Ctrl + l or Ctrl + L clears the screen and the line_buffer
-    if(ctrlFlag && ((keyMap[scancode] == 'l') || (keyMapShift[scancode] == 'L') || (keyMapCaps[scancode] == 'L') ) ){
-        clearFlag = 1;
-        clear();
-        int clear;
-        for(clear = 0; clear < bufPtr; clear++){
-            line_buf[bufPtr] = ' ';
-        }
-        bufPtr = 0;
-    }
     // checks to see which terminal to switch to
-    if(altFlag && (scancode == F1)){
-        //putc('1');
-        if(terminal != 1){
-            // save the previous terminal
-            int prev_terminal = terminal;
-            setTerminal(1);
-            {
-                // store the process index in the current process pid
-                pcb_t* curr_pcb;
-                curr_pcb = (pcb_t *) (END_KERNEL - ((top_terminal_pid[prev_terminal] + 1) * (PCB_SIZE)));
-                // save ebp
-                asm __volatile__(
-                    "movl %%ebp, %0;"
-                    : "=r"(curr_pcb->old_ebp)
-                );    
-            }
-            //program_paging(top_terminal_pid[terminal], terminal);
-            if (top_terminal_pid[terminal] == -1) {
-                send_eoi(1);
-                sti();
-                // execute shell again if the base shell
-                execute((const uint8_t*)"shell");
-            } else {
-                send_eoi(1);
-                sti();
-                // restore execute to handle process index 
-                restoreExec(top_terminal_pid[terminal]);
-            }
-        }
-        //program_paging(top_terminal_pid[terminal], terminal);
+    if(altFlag && (scancode == F1) && (terminal != 1)){
+        next_terminal = 1;
     }
-    if(altFlag && (scancode == F2)){
-        // putc('2');
-        if(terminal != 2){
-            // save the previous terminal
-            int prev_terminal = terminal;
-            setTerminal(2);
-            {
-                // store the process index in the current process pid
-                pcb_t* curr_pcb;
-                curr_pcb = (pcb_t *) (END_KERNEL - ((top_terminal_pid[prev_terminal] + 1) * (PCB_SIZE)));
-                // save ebp
-                asm __volatile__(
-                    "movl %%ebp, %0;"
-                    : "=r"(curr_pcb->old_ebp)
-                );    
-            }
-            //program_paging(top_terminal_pid[terminal], terminal);
-            if (top_terminal_pid[terminal] == -1) {
-                send_eoi(1);
-                sti();
-                // execute shell again if the base shell
-                execute((const uint8_t*)"shell");
-            } else {
-                send_eoi(1);
-                sti();
-                // restore execute to handle process index 
-                restoreExec(top_terminal_pid[terminal]);
-            }
-        }
+    if(altFlag && (scancode == F2) && (terminal != 2)){
+        next_terminal = 2;
     }
-    if(altFlag && (scancode == F3)){
-        //putc('3');
-        if(terminal != 3){
-            // save the previous terminal
-            int prev_terminal = terminal;
-            setTerminal(3);
-            {
-                // store the process index in the current process pid
-                pcb_t* curr_pcb;
-                curr_pcb = (pcb_t *) (END_KERNEL - ((top_terminal_pid[prev_terminal] + 1) * (PCB_SIZE)));
-                // save ebp
-                asm __volatile__(
-                    "movl %%ebp, %0;"
-                    : "=r"(curr_pcb->old_ebp)
-                );    
-            }
-            //program_paging(top_terminal_pid[terminal], terminal);
-            if (top_terminal_pid[terminal] == -1) {
-                send_eoi(1);
-                sti();
-                // execute shell again if the base shell
-                execute((const uint8_t*)"shell");
-            } else {
-                send_eoi(1);
-                sti();
-                // restore execute to handle process index 
-                restoreExec(top_terminal_pid[terminal]);
-            }
-        }
-        //program_paging(top_terminal_pid[terminal], terminal);
+    if(altFlag && (scancode == F3) && (terminal != 3)){
+        next_terminal = 3;
     }
     colorFlag = 0;
-    send_eoi(1);
-    sti();
+    //put the echoed characters on the screen
+    console_flush();
+    return next_terminal;
 }
 
 /* 
  *   setTerminal()
- *   DESCRIPTION: changes the video memory mapping and restores the previous terminal attributes so that the
- *   terminals can be switched upon key press. Makes sure to keep track of the old attributes by putting them
- *   in the previosuly declared arrays
+ *   DESCRIPTION: switches which terminal is written to and shown on screen upon key press. Every terminal
+ *   draws into its own backing page and has its own line discipline, so nothing has to be saved here and the
+ *   console code repaints the screen from the new terminal's page
  *   INPUTS: int next_terminal
  *   OUTPUTS: none
  *   SIDE EFFECTS: changes the video memory mapping and restores the previous terminal attributes
  */
 void setTerminal(int next_terminal) {
-    if (terminal == next_terminal) return;
+    int prev_terminal = terminal;
 
-    /* copy video memory to terminal to save the current page */
-    memcpy(VIDEO_PAGE_ADDRESS[terminal], (void *)VIDEO_MEM_ADDRESS, 4096);
+    if (terminal == next_terminal) return;
 
-    /* keep the buffer stored in the array so we dont lose track of it */
-    strncpy(buf_arr[terminal-1], line_buf, bufPtr + 1);
-    bufPtr_arr[terminal-1] = bufPtr;
-    /* keep track of the current x and y positions of the cursor*/
-    x_arr[terminal-1] = screen_x;
-    y_arr[terminal-1] = screen_y;
     /* actually change the next terminal*/
     terminal = next_terminal;
 
-    /* update the cursor */
-    screen_x = x_arr[terminal-1];
-    screen_y = y_arr[terminal-1];
-    update_cursor();
-    /* restore buffer  */
-    bufPtr = bufPtr_arr[terminal-1];
-    /* copy the buffer array back to the actual buffer */
-    strncpy(line_buf, buf_arr[terminal-1], bufPtr + 1);
-
-     /* copy the terminal address to video memory */
-    memcpy((void *)VIDEO_MEM_ADDRESS, VIDEO_PAGE_ADDRESS[terminal], 4096);
-
-    // program_paging(top_terminal_pid[terminal], terminal);
+    /* write to and show the new terminal, this saves and restores the cursor too */
+    console_select(terminal);
+    console_show(terminal);
+    /* programs that draw through vidmap follow their terminal on and off the screen */
+    vidmap_switch(prev_terminal, terminal);
 }
 
 
@@ -361,34 +267,26 @@ int32_t terminal_close(int32_t fd){
 
 /* 
  *   terminal_read
- *   DESCRIPTION: Blocks until the enter key is pressed. Then copies the line buffer into the argument buffer
+ *   DESCRIPTION: Blocks until a line is typed on the terminal of the calling process, then copies it, newline
+ *   included, into the argument buffer
  *   INPUTS: fd-- file descriptor index
- *          buf-- buffer to copy line buffer into
+ *          buf-- buffer to copy the line into
  *          nbytes-- number of bytes to copy 
  *   OUTPUTS: none
  *   Return: number of bytes
  */
 int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes){
-    // If enter key is pressed then copy everything in line buffer to user buffer
-    int retval;
-
-    while(!enterFlag){}
-    enterFlag = 0; //reset flag
-    cli();
-    strncpy((char*)buf, line_buf, bufPtr + 1);    //copy to buffer
-    retval = bufPtr + 1;
-    int clear;
-    for(clear = 0; clear < bufPtr; clear++){
-        line_buf[clear] = '\0';
+    tty_t* tty = tty_get(current_terminal());
+
+    if(buf == NULL || tty == NULL){
+        return -1;
     }
-    bufPtr = 0; //reset ptr for next buffer
-    sti();
-    return retval;
+    return tty_read(tty, (uint8_t*)buf, nbytes);
 }
 
 /* 
  *   terminal_write
- *   DESCRIPTION: Writes an entire input buffer to the screen
+ *   DESCRIPTION: Writes an entire input buffer to the screen with a single putbuf call
  *   INPUTS: fd-- file descriptor index
  *          buf-- buffer print to the screen
  *          nbytes-- number of bytes to copy 
@@ -397,29 +295,51 @@ int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes){
  */
 int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes){
     int a;
-    char scan;
+    int32_t prev;
 
     if(buf == NULL){
         return -1;
     }
 
-    //iterate through the bytes we want to print and print them to the screen
+    //only print up to the first '\002'
     for(a = 0; a < nbytes; a++) {
-        //Prints the given characters to the screen.
         if(((char*)buf)[a] == '\002'){
             break;
         }
-        scan = ((char*)buf)[a];
-        if(scan != '\0'){
-            putc(scan);
-        }
-        //newline indicates the end of the buffer so we break
-        
-        
-        /*BUG CP4*/
-        // if(scan == '\n'){
-        //     break;
-        // }
     }
+
+    //print the whole run in one go, putbuf skips the '\0' characters like the old per character loop did
+    //onto the writer's terminal, which runs whether or not it is on screen
+    prev = console_select(current_terminal());
+    putbuf((const uint8_t*)buf, a);
+    console_select(prev);
     return nbytes;
 }   
+
+/* 
+ *   terminal_ioctl
+ *   DESCRIPTION: Reads or changes the input mode of the calling process's terminal
+ *   INPUTS: fd-- file descriptor index
+ *          request-- TTY_GETMODE or TTY_SETMODE
+ *          arg-- user pointer to a tty_mode_t
+ *   OUTPUTS: TTY_GETMODE fills in arg
+ *   Return: 0 on success, -1 for a bad request or pointer
+ */
+int32_t terminal_ioctl(int32_t fd, int32_t request, void* arg){
+    tty_t* tty = tty_get(current_terminal());
+    tty_mode_t* mode = (tty_mode_t*)arg;
+
+    /* the mode has to be in a page the program has mapped */
+    if(tty == NULL || !page_user_ok(mode, sizeof(tty_mode_t))){
+        return -1;
+    }
+    switch(request){
+        case TTY_GETMODE:
+            *mode = tty->mode;
+            return 0;
+        case TTY_SETMODE:
+            return tty_set_mode(tty, mode, this_cpu()->pid);
+        default:
+            return -1;
+    }
+}
@@ -6,6 +6,9 @@
 #include "i8259.h"
 #include "page.h"
 
+//size of the scancode ring, must be a power of two
+#define KB_RING_SIZE 64
+
 #define caps_clicked 0x3A
 
 #define left_shift_held 0x2A
@@ -27,12 +30,12 @@
 int colorFlag;
 int clearFlag;
 int terminal;
-int top_terminal_pid[4];
 
 int32_t terminal_open(const uint8_t* filename);
 int32_t terminal_close(int32_t fd);
 int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes);
 int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t terminal_ioctl(int32_t fd, int32_t request, void* arg);
 void setTerminal(int next_terminal);
 
 //Create a key map for all the keys from 0 to 0x59 to print to screen
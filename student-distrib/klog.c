@@ -0,0 +1,163 @@
+#include "klog.h"
+#include "lib.h"
+#include "device.h"
+#include "system_calls.h"
+#include "clock.h"
+#include "smp.h"
+
+/* the log, message seq lives in slot seq % KLOG_ENTRIES */
+static klog_entry_t klog_ring[KLOG_ENTRIES];
+/* seq of the next message */
+static uint32_t klog_next = 0;
+
+static const table_pointer_t kmsg_ops = { kmsg_open, kmsg_close, kmsg_read, kmsg_write };
+
+/* 
+ *   klog_init()
+ *   DESCRIPTION: Registers the "kmsg" device that reads the log as text. Messages logged before this are kept
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: a new name can be opened
+ */
+void klog_init(void) {
+    register_device("kmsg", &kmsg_ops);
+}
+
+/* 
+ *   klog_append(int32_t level, int8_t* format, int32_t* args)
+ *   DESCRIPTION: Formats a message straight into the next slot of the ring
+ *   INPUTS: level, printf style format and the arguments after it
+ *   OUTPUTS: the entry written
+ *   SIDE EFFECTS: overwrites the oldest message once the ring is full
+ */
+static klog_entry_t* klog_append(int32_t level, int8_t* format, int32_t* args) {
+    uint32_t flags;
+    klog_entry_t* entry;
+    int32_t len;
+
+    cli_and_save(flags);
+    entry = &klog_ring[klog_next & (KLOG_ENTRIES - 1)];
+    entry->tsc = rdtsc();
+    entry->seq = klog_next++;
+    entry->level = level;
+    len = vsnprintf(entry->text, KLOG_MSG_MAX, format, args);
+    /* the log is line based, drop the newline printf style callers put at the end */
+    if (len > 0 && entry->text[len - 1] == '\n') {
+        entry->text[--len] = '\0';
+    }
+    entry->len = len;
+    restore_flags(flags);
+    return entry;
+}
+
+/* 
+ *   klog(int32_t level, int8_t* format, ...)
+ *   DESCRIPTION: Adds a message to the kernel log. Costs a format into memory, only messages at
+ *   KLOG_CONSOLE_LEVEL or more important are also printed
+ *   INPUTS: level (KLOG_ERR ... KLOG_DEBUG), printf style format and arguments
+ *   OUTPUTS: length of the message kept
+ *   SIDE EFFECTS: none
+ */
+int32_t klog(int32_t level, int8_t* format, ...) {
+    klog_entry_t* entry = klog_append(level, format, (int32_t *)&format + 1);
+
+    if (level <= KLOG_CONSOLE_LEVEL) {
+        printf("%s\n", entry->text);
+    }
+    return entry->len;
+}
+
+/* 
+ *   kmsg_open(const uint8_t* filename)
+ *   DESCRIPTION: Nothing to set up, the file position starts at the oldest message
+ *   INPUTS: filename
+ *   OUTPUTS: 0
+ *   SIDE EFFECTS: none
+ */
+int32_t kmsg_open(const uint8_t* filename) {
+    return 0;
+}
+
+/* 
+ *   kmsg_close(int32_t fd)
+ *   DESCRIPTION: Nothing to free
+ *   INPUTS: fd
+ *   OUTPUTS: 0
+ *   SIDE EFFECTS: none
+ */
+int32_t kmsg_close(int32_t fd) {
+    return 0;
+}
+
+/* 
+ *   kmsg_read(int32_t fd, void* buf, int32_t nbytes)
+ *   DESCRIPTION: Reads as many whole messages as fit, one per line as "<level>[seconds.microseconds] text".
+ *   The time is counted from TSC reset, so messages from before the clock was calibrated get one too. The
+ *   file position is the seq of the next message, messages that were overwritten meanwhile are skipped
+ *   INPUTS: file descriptor, buffer and its size in bytes
+ *   OUTPUTS: number of bytes copied, 0 once all messages are read
+ *   SIDE EFFECTS: advances the file position
+ */
+int32_t kmsg_read(int32_t fd, void* buf, int32_t nbytes) {
+    pcb_t* curr_pcb;
+    file_entry_t* file;
+    klog_entry_t* entry;
+    uint32_t flags;
+    int8_t line[KLOG_MSG_MAX + 32];
+    int32_t len;
+    int32_t copied = 0;
+    uint32_t sec, nsec;
+    int8_t frac[8];
+
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
+    file = &curr_pcb->file_array[fd];
+
+    cli_and_save(flags);
+    if (klog_next - file->position > KLOG_ENTRIES) {
+        file->position = klog_next - KLOG_ENTRIES;
+    }
+    while (file->position != klog_next) {
+        entry = &klog_ring[file->position & (KLOG_ENTRIES - 1)];
+        sec = div64_32(clock_cycles_to_ns(entry->tsc), 1000000000, &nsec);
+        /* zero padded microseconds, formatting 1000000 + usec and skipping the 1 */
+        snprintf(frac, sizeof(frac), "%u", 1000000 + nsec / 1000);
+        len = snprintf(line, sizeof(line), "<%u>[%u.%s] %s\n", entry->level,
+                sec, frac + 1, entry->text);
+        if (copied + len > nbytes) {
+            /* a buffer smaller than one line still gets the start of it */
+            if (copied == 0) {
+                memcpy(buf, line, nbytes);
+                copied = nbytes;
+                file->position++;
+            }
+            break;
+        }
+        memcpy((int8_t *)buf + copied, line, len);
+        copied += len;
+        file->position++;
+    }
+    restore_flags(flags);
+    return copied;
+}
+
+/* 
+ *   kmsg_write(int32_t fd, const void* buf, int32_t nbytes)
+ *   DESCRIPTION: Lets programs add a line to the log at KLOG_INFO
+ *   INPUTS: file descriptor, text and its length
+ *   OUTPUTS: nbytes
+ *   SIDE EFFECTS: none
+ */
+int32_t kmsg_write(int32_t fd, const void* buf, int32_t nbytes) {
+    int8_t text[KLOG_MSG_MAX];
+
+    if (buf == NULL || nbytes < 0) {
+        return -1;
+    }
+    if (nbytes > KLOG_MSG_MAX - 1) {
+        nbytes = KLOG_MSG_MAX - 1;
+    }
+    memcpy(text, buf, nbytes);
+    text[nbytes] = '\0';
+    klog(KLOG_INFO, "%s", text);
+    return nbytes;
+}
@@ -0,0 +1,37 @@
+#ifndef _X_KLOG_H
+#define _X_KLOG_H
+
+#include "types.h"
+
+/* log levels, lower is more important */
+#define KLOG_ERR        0
+#define KLOG_WARN       1
+#define KLOG_INFO       2
+#define KLOG_DEBUG      3
+
+/* entries kept, must be a power of two. The oldest ones are overwritten */
+#define KLOG_ENTRIES    128
+/* longest message kept, longer ones are cut */
+#define KLOG_MSG_MAX    112
+
+/* messages at this level or more important are also printed on the console */
+#define KLOG_CONSOLE_LEVEL  KLOG_ERR
+
+/* one message in the log ring */
+typedef struct klog_entry {
+    uint64_t tsc;                   //rdtsc when it was logged, kmsg turns it into seconds
+    uint32_t seq;                   //number of the message since boot
+    uint8_t level;
+    uint8_t len;
+    int8_t text[KLOG_MSG_MAX];      //'\0' terminated, no trailing newline
+} klog_entry_t;
+
+void klog_init(void);
+int32_t klog(int32_t level, int8_t* format, ...);
+
+int32_t kmsg_open(const uint8_t* filename);
+int32_t kmsg_close(int32_t fd);
+int32_t kmsg_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t kmsg_write(int32_t fd, const void* buf, int32_t nbytes);
+
+#endif
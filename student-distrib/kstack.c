@@ -0,0 +1,155 @@
+#include "kstack.h"
+#include "lib.h"
+#include "klog.h"
+#include "page.h"
+#include "smp.h"
+
+/*
+ * A kernel stack that runs into its guard page faults with esp on that page, and the cpu cannot push the page
+ * fault frame there either, which makes it a double fault. That one is taken through a task gate so it starts
+ * on a TSS and stack of its own instead of a third push onto the guard page. The IDT is shared, so is the
+ * task: two cpus double faulting at once is not survived, neither is one
+ */
+static tss_t df_tss;
+static uint8_t df_stack[DF_STACK_SIZE] __attribute__((aligned(16)));
+
+static void kstack_double_fault(void);
+
+/*
+ *   kstack_init
+ *   DESCRIPTION: Sets up the double fault task: its TSS, the GDT descriptor for it and a task gate in IDT
+ *   entry 8 in place of the interrupt gate idt_init put there
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: call after idt_init
+ */
+void kstack_init(void) {
+    seg_desc_t the_tss_desc;
+
+    the_tss_desc.granularity   = 0x0;
+    the_tss_desc.opsize        = 0x0;
+    the_tss_desc.reserved      = 0x0;
+    the_tss_desc.avail         = 0x0;
+    the_tss_desc.seg_lim_19_16 = TSS_SIZE & 0x000F0000;
+    the_tss_desc.present       = 0x1;
+    the_tss_desc.dpl           = 0x0;
+    the_tss_desc.sys           = 0x0;
+    the_tss_desc.type          = 0x9;
+    the_tss_desc.seg_lim_15_00 = TSS_SIZE & 0x0000FFFF;
+
+    SET_TSS_PARAMS(the_tss_desc, &df_tss, tss_size);
+    df_tss_desc_ptr = the_tss_desc;
+
+    //the boot directory maps the kernel the same as every cpu's
+    df_tss.cr3 = (uint32_t)pd;
+    df_tss.eip = (uint32_t)kstack_double_fault;
+    df_tss.eflags = 0x2;
+    df_tss.esp = (uint32_t)&df_stack[DF_STACK_SIZE];
+    df_tss.cs = KERNEL_CS;
+    df_tss.ss = KERNEL_DS;
+    df_tss.ds = KERNEL_DS;
+    df_tss.es = KERNEL_DS;
+    df_tss.fs = KERNEL_DS;
+    df_tss.gs = KERNEL_DS;
+    df_tss.ldt_segment_selector = KERNEL_LDT;
+
+    //task gate: type 0x5, the offset is not used
+    idt[8].seg_selector = DF_TSS;
+    idt[8].reserved3 = 1;
+    idt[8].reserved2 = 0;
+    idt[8].reserved1 = 1;
+    idt[8].size = 0;
+    idt[8].reserved0 = 0;
+    idt[8].dpl = 0;
+    idt[8].present = 1;
+}
+
+/*
+ *   kstack_paint
+ *   DESCRIPTION: Fills a process's kernel stack with KSTACK_CANARY so kstack_used can tell how deep it went.
+ *   A shell restarted by halt reuses the slot it is running on, only the part below esp is painted then
+ *   INPUTS: pid -- process whose slot it is
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none, nothing in the painted range is live. No calls are made while painting
+ */
+void kstack_paint(int32_t pid) {
+    uint32_t* word = (uint32_t*)KSTACK_LOW(pid);
+    uint32_t* end = (uint32_t*)KSTACK_TOP(pid);
+    uint32_t esp;
+
+    asm volatile ("movl %%esp, %0" : "=r"(esp));
+    if (esp > (uint32_t)word && esp <= (uint32_t)end) {
+        end = (uint32_t*)(esp & ~3);
+    }
+    while (word < end) {
+        *word++ = KSTACK_CANARY;
+    }
+}
+
+/*
+ *   kstack_used
+ *   DESCRIPTION: High water mark of a process's kernel stack, from the first word up from the bottom that
+ *   is not the canary any more
+ *   INPUTS: pid -- process
+ *   OUTPUTS: bytes used at the deepest point since it was executed
+ *   SIDE EFFECTS: none
+ */
+uint32_t kstack_used(int32_t pid) {
+    uint32_t* word = (uint32_t*)KSTACK_LOW(pid);
+    uint32_t* end = (uint32_t*)KSTACK_TOP(pid);
+
+    while (word < end && *word == KSTACK_CANARY) {
+        word++;
+    }
+    return (uint32_t)end - (uint32_t)word;
+}
+
+/*
+ *   kstack_check
+ *   DESCRIPTION: Called by halt on the exiting process, logs a warning if its stack came close to the guard
+ *   INPUTS: pid -- process
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void kstack_check(int32_t pid) {
+    uint32_t used = kstack_used(pid);
+
+    if (used > KSTACK_WARN) {
+        klog(KLOG_WARN, "kstack: pid %d used %d of %d bytes of its kernel stack", pid, used, KSTACK_SIZE);
+    }
+}
+
+/*
+ *   kstack_double_fault
+ *   DESCRIPTION: Entry of the double fault task. The cpu that faulted is the one whose TSS the back link
+ *   names, its registers were saved there. this_cpu cannot be used, the task register holds DF_TSS. A fault
+ *   address in a guard page names the process whose stack ran over
+ *   INPUTS: none, the error code pushed on df_stack is always 0
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: halts the cpu for good
+ */
+static void kstack_double_fault(void) {
+    uint16_t sel = df_tss.prev_task_link;
+    int32_t id = (sel == KERNEL_TSS) ? 0 : ((sel - CPU_TSS_BASE) >> 3) + 1;
+    tss_t* prev = cpus[id].tss;
+    uint32_t cr2;
+    int32_t pid;
+
+    asm volatile ("movl %%cr2, %0" : "=r"(cr2));
+    for (pid = -1; pid < MAX_PROCESSES; pid++) {
+        if (cr2 >= KSLOT(pid) && cr2 < KSTACK_LOW(pid)) {
+            break;
+        }
+    }
+    if (pid < 0) {
+        klog(KLOG_ERR, "kstack: boot stack overflow on cpu %d, eip %x esp %x", id, prev->eip, prev->esp);
+    } else if (pid < MAX_PROCESSES) {
+        klog(KLOG_ERR, "kstack: kernel stack overflow, pid %d on cpu %d, eip %x esp %x",
+             pid, id, prev->eip, prev->esp);
+    } else {
+        klog(KLOG_ERR, "Exception occurred: Double_Fault on cpu %d, eip %x esp %x", id, prev->eip, prev->esp);
+    }
+    while (1) {
+        asm volatile ("cli; hlt");
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef _X_KSTACK_H
+#define _X_KSTACK_H
+
+#include "types.h"
+#include "system_calls.h"
+
+/* word a kernel stack is painted with at execute, whatever is still this was never reached */
+#define KSTACK_CANARY       0x57ACC0DE
+/* usable part of a process's kernel stack, below its pcb */
+#define KSTACK_SIZE         (PCB_SIZE - PCB_RESERVED)
+/* a process that went deeper than this gets a warning in the log when it halts */
+#define KSTACK_WARN         (KSTACK_SIZE * 3 / 4)
+/* stack of the double fault task */
+#define DF_STACK_SIZE       4096
+
+void kstack_init(void);
+void kstack_paint(int32_t pid);
+uint32_t kstack_used(int32_t pid);
+void kstack_check(int32_t pid);
+
+#endif
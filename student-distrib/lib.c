@@ -4,6 +4,7 @@
 #include "lib.h"
 #include "keyboard.h"
 #include "x86_desc.h"
+#include "page.h"
 
 #define VIDEO       0xB8000
 #define NUM_COLS    80
@@ -20,61 +21,296 @@
 #define ATTRIBY     0x0F
 
 
-static char* video_mem = (char *)VIDEO;
+//every row of the screen, for marking the whole console dirty
+#define ALL_ROWS    ((1 << NUM_ROWS) - 1)
+
+/* each terminal renders into its own backing page, only the shown one is copied to VGA memory */
+typedef struct console {
+    char* buf;                  //backing page of the terminal
+    char* draw;                 //where output goes, the backing page or VGA memory when a program has it mapped
+    int x;                      //saved cursor while another terminal is being written to
+    int y;
+    int of_flag;                //saved ofFlag
+    int user_mapped;            //a program of this terminal draws through vidmap
+    volatile uint32_t dirty;    //one bit per row changed since the last flush
+} console_t;
+
+static console_t consoles[NUM_TERMINALS + 1] = {
+    { 0 },  // 0 for indexing, terminals are numbered from 1
+    { (char *)VIDEO_PAGE_ONE, (char *)VIDEO_PAGE_ONE },
+    { (char *)VIDEO_PAGE_TWO, (char *)VIDEO_PAGE_TWO },
+    { (char *)VIDEO_PAGE_THREE, (char *)VIDEO_PAGE_THREE },
+};
+//terminal that output is written to (the one the running process belongs to) and the one on screen
+static int out_term = 1;
+static int shown_term = 1;
+static console_t* out_con = &consoles[1];
+//last position written to the hardware cursor, so unchanged positions skip the port writes
+static int32_t hw_cursor = -1;
+
+static char* video_mem = (char *)VIDEO_PAGE_ONE;
 static int ofFlag = 0;
 char ATTRIB;
 
+/* outputs that mirror the consoles, see console_add_sink */
+static console_sink_t console_sinks[MAX_CONSOLE_SINKS];
+static int32_t num_console_sinks = 0;
+
+//printf formats into a stack buffer of this size and prints it with one putbuf per buffer
+#define PRINTF_CHUNK    128
+
+//marks a row of the console being written to as changed
+#define MARK_DIRTY(row)     (out_con->dirty |= (1 << (row)))
+
+/* void console_init(void);
+ * Inputs: void
+ * Return Value: none
+ * Function: Blanks the backing pages of every terminal and starts out writing to and showing terminal 1 */
+void console_init(void) {
+    int32_t t;
+    for (t = 1; t <= NUM_TERMINALS; t++) {
+        memset_word(consoles[t].buf, 0, NUM_ROWS * NUM_COLS);
+        consoles[t].draw = consoles[t].buf;
+        consoles[t].x = 0;
+        consoles[t].y = 0;
+        consoles[t].of_flag = 0;
+        consoles[t].user_mapped = 0;
+        consoles[t].dirty = ALL_ROWS;
+    }
+    out_term = shown_term = 1;
+    out_con = &consoles[1];
+    video_mem = out_con->draw;
+    screen_x = screen_y = 0;
+    ofFlag = 0;
+}
+
+/* int32_t console_select(int32_t t);
+ * Inputs: t = terminal number (1 - NUM_TERMINALS)
+ * Return Value: terminal that was written to before, so callers can switch back
+ * Function: Makes putc/putbuf/printf write to terminal t. The cursor of the old terminal is saved and
+ *           the one of t restored into screen_x/screen_y */
+int32_t console_select(int32_t t) {
+    int32_t prev = out_term;
+
+    if (t < 1 || t > NUM_TERMINALS || t == out_term) {
+        return prev;
+    }
+    out_con->x = screen_x;
+    out_con->y = screen_y;
+    out_con->of_flag = ofFlag;
+
+    out_term = t;
+    out_con = &consoles[t];
+    screen_x = out_con->x;
+    screen_y = out_con->y;
+    ofFlag = out_con->of_flag;
+    video_mem = out_con->draw;
+    return prev;
+}
+
+/* void console_show(int32_t t);
+ * Inputs: t = terminal number (1 - NUM_TERMINALS)
+ * Return Value: none
+ * Function: Puts terminal t on the screen. Nothing is copied out of VGA memory unless a program of the
+ *           old terminal drew into it directly through vidmap, the new terminal is copied in by one flush */
+void console_show(int32_t t) {
+    console_t* old;
+    console_t* con;
+
+    if (t < 1 || t > NUM_TERMINALS || t == shown_term) {
+        return;
+    }
+    old = &consoles[shown_term];
+    if (old->user_mapped) {
+        //the program drew straight into VGA memory, keep its picture in the backing page from now on
+        memcpy(old->buf, (void *)VIDEO, NUM_ROWS * NUM_COLS * 2);
+        old->draw = old->buf;
+        if (old == out_con) {
+            video_mem = old->draw;
+        }
+    }
+
+    shown_term = t;
+    con = &consoles[t];
+    con->dirty = ALL_ROWS;
+    console_flush();
+    if (con->user_mapped) {
+        //on screen the program's writes and ours have to go to the same place
+        con->draw = (char *)VIDEO;
+        if (con == out_con) {
+            video_mem = con->draw;
+        }
+    }
+}
+
+/* void console_set_mapped(int32_t t, int32_t mapped);
+ * Inputs: t = terminal number, mapped = whether a program of t now draws through vidmap
+ * Return Value: none
+ * Function: While a program draws into VGA memory itself, the shown terminal renders straight into VGA
+ *           memory too, so flushing the backing page never paints over the program's picture */
+void console_set_mapped(int32_t t, int32_t mapped) {
+    console_t* con;
+
+    if (t < 1 || t > NUM_TERMINALS) {
+        return;
+    }
+    con = &consoles[t];
+    if (con->user_mapped == mapped) {
+        return;
+    }
+    con->user_mapped = mapped;
+    if (t != shown_term) {
+        return;
+    }
+    if (mapped) {
+        console_flush();
+        con->draw = (char *)VIDEO;
+    } else {
+        memcpy(con->buf, (void *)VIDEO, NUM_ROWS * NUM_COLS * 2);
+        con->draw = con->buf;
+    }
+    if (con == out_con) {
+        video_mem = con->draw;
+    }
+}
+
+/* void console_flush(void);
+ * Inputs: void
+ * Return Value: none
+ * Function: Copies the rows of the shown terminal that changed since the last flush into VGA memory and
+ *           moves the hardware cursor. Called at the end of every write and from the RTC tick */
+void console_flush(void) {
+    uint32_t flags;
+    uint32_t dirty;
+    int32_t row;
+    console_t* con = &consoles[shown_term];
+
+    cli_and_save(flags);
+    dirty = con->dirty;
+    con->dirty = 0;
+    restore_flags(flags);
+
+    if (con->draw != (char *)VIDEO) {
+        if (dirty == ALL_ROWS) {
+            memcpy((void *)VIDEO, con->buf, NUM_ROWS * NUM_COLS * 2);
+        } else {
+            for (row = 0; dirty != 0; row++, dirty >>= 1) {
+                if (dirty & 1) {
+                    memcpy((char *)VIDEO + ((NUM_COLS * row) << 1), con->buf + ((NUM_COLS * row) << 1), NUM_COLS * 2);
+                }
+            }
+        }
+    }
+    update_cursor();
+}
+
+/* int32_t console_dirty(void);
+ * Inputs: void
+ * Return Value: nonzero if the shown terminal has rows waiting to be flushed
+ * Function: Lets the RTC tick skip the flush when nothing changed */
+int32_t console_dirty(void) {
+    return consoles[shown_term].dirty != 0;
+}
+
+/* int32_t console_add_sink(console_sink_t sink);
+ * Inputs: sink = function that takes a copy of every buffer and character printed
+ * Return Value: 0 on success, -1 if all MAX_CONSOLE_SINKS slots are taken
+ * Function: Mirrors the output of putc/putbuf/printf of every terminal to another device */
+int32_t console_add_sink(console_sink_t sink) {
+    if (num_console_sinks >= MAX_CONSOLE_SINKS) {
+        return -1;
+    }
+    console_sinks[num_console_sinks++] = sink;
+    return 0;
+}
+
+/* void console_mirror(const uint8_t* buf, int32_t n);
+ * Inputs: buf = bytes printed, n = number of bytes
+ * Return Value: none
+ * Function: Hands printed bytes to every sink */
+static void console_mirror(const uint8_t* buf, int32_t n) {
+    int32_t i;
+    for (i = 0; i < num_console_sinks; i++) {
+        console_sinks[i](buf, n);
+    }
+}
+
+/* int32_t console_shown(void);
+ * Inputs: void
+ * Return Value: number of the terminal on screen
+ * Function: Lets vidmap decide between video memory and a backing page */
+int32_t console_shown(void) {
+    return shown_term;
+}
+
 /* void clear(void);
  * Inputs: void
  * Return Value: none
  * Function: Clears video memory */
 void clear(void) {
-    int32_t i;
-    for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
-        *(uint8_t *)(video_mem + (i << 1)) = '\0';
-        *(uint8_t *)(video_mem + (i << 1) + 1) = ATTRIB;
-    }
+    //blank cell is a '\0' character in the current color
+    memset_word(video_mem, ((uint32_t)(uint8_t)ATTRIB) << 8, NUM_ROWS * NUM_COLS);
+    out_con->dirty = ALL_ROWS;
     //move cursor back to (x,y) = (0,0)
     screen_x = 0;
     screen_y = 0;
-    update_cursor();
     /* check if we need to clear */
     if(clearFlag){
         printf("391OS> ");
         screen_x = 7;
-        update_cursor();
         clearFlag = 0;
     }
+    console_flush();
 
 }
 
-/* Standard printf().
- * Only supports the following format strings:
- * %%  - print a literal '%' character
- * %x  - print a number in hexadecimal
- * %u  - print a number as an unsigned integer
- * %d  - print a number as a signed integer
- * %c  - print a character
- * %s  - print a string
- * %#x - print a number in 32-bit aligned hexadecimal, i.e.
- *       print 8 hexadecimal digits, zero-padded on the left.
- *       For example, the hex number "E" would be printed as
- *       "0000000E".
- *       Note: This is slightly different than the libc specification
- *       for the "#" modifier (this implementation doesn't add a "0x" at
- *       the beginning), but I think it's more flexible this way.
- *       Also note: %x is the only conversion specifier that can use
- *       the "#" modifier to alter output. */
-int32_t printf(int8_t *format, ...) {
-    /* set color flag */
-    colorFlag2 = 1;
+/* where vformat puts its output. Once buf is full it is handed to spill and reused, without a spill the rest
+ * of the output is dropped */
+typedef struct format_out {
+    int8_t* buf;
+    int32_t size;
+    int32_t len;        //bytes in buf
+    int32_t total;      //bytes produced so far, dropped ones included
+    void (*spill)(const int8_t* buf, int32_t n);
+} format_out_t;
+
+/* void format_put(format_out_t* out, const int8_t* s, int32_t n);
+ * Inputs: out = destination, s = bytes to add, n = number of bytes
+ * Return Value: none
+ * Function: Appends formatted output, spilling or dropping it when the buffer is full */
+static void format_put(format_out_t* out, const int8_t* s, int32_t n) {
+    int32_t room;
 
+    out->total += n;
+    while (n > 0) {
+        room = out->size - out->len;
+        if (room == 0) {
+            if (out->spill == NULL) {
+                return;
+            }
+            out->spill(out->buf, out->len);
+            out->len = 0;
+            room = out->size;
+        }
+        if (room > n) {
+            room = n;
+        }
+        memcpy(out->buf + out->len, s, room);
+        out->len += room;
+        s += room;
+        n -= room;
+    }
+}
+
+/* int32_t vformat(format_out_t* out, int8_t* format, int32_t* esp);
+ * Inputs: out = destination, format = format string, esp = first argument after the format string
+ * Return Value: number of characters produced
+ * Function: Does the formatting for printf and snprintf, see printf for the format strings */
+static int32_t vformat(format_out_t* out, int8_t* format, int32_t* esp) {
     /* Pointer to the format string */
     int8_t* buf = format;
-
-    /* Stack pointer for the other parameters */
-    int32_t* esp = (void *)&format;
-    esp++;
+    int8_t* s;
+    int8_t c;
 
     while (*buf != '\0') {
         switch (*buf) {
@@ -88,7 +324,7 @@ format_char_switch:
                     switch (*buf) {
                         /* Print a literal '%' character */
                         case '%':
-                            putc('%');
+                            format_put(out, buf, 1);
                             break;
 
                         /* Use alternate formatting */
@@ -106,7 +342,7 @@ format_char_switch:
                                 int8_t conv_buf[64];
                                 if (alternate == 0) {
                                     itoa(*((uint32_t *)esp), conv_buf, 16);
-                                    puts(conv_buf);
+                                    format_put(out, conv_buf, strlen(conv_buf));
                                 } else {
                                     int32_t starting_index;
                                     int32_t i;
@@ -116,7 +352,7 @@ format_char_switch:
                                         conv_buf[i] = '0';
                                         i++;
                                     }
-                                    puts(&conv_buf[starting_index]);
+                                    format_put(out, &conv_buf[starting_index], strlen(&conv_buf[starting_index]));
                                 }
                                 esp++;
                             }
@@ -127,7 +363,7 @@ format_char_switch:
                             {
                                 int8_t conv_buf[36];
                                 itoa(*((uint32_t *)esp), conv_buf, 10);
-                                puts(conv_buf);
+                                format_put(out, conv_buf, strlen(conv_buf));
                                 esp++;
                             }
                             break;
@@ -143,20 +379,22 @@ format_char_switch:
                                 } else {
                                     itoa(value, conv_buf, 10);
                                 }
-                                puts(conv_buf);
+                                format_put(out, conv_buf, strlen(conv_buf));
                                 esp++;
                             }
                             break;
 
                         /* Print a single character */
                         case 'c':
-                            putc((uint8_t) *((int32_t *)esp));
+                            c = (int8_t) *((int32_t *)esp);
+                            format_put(out, &c, 1);
                             esp++;
                             break;
 
                         /* Print a NULL-terminated string */
                         case 's':
-                            puts(*((int8_t **)esp));
+                            s = *((int8_t **)esp);
+                            format_put(out, s, strlen(s));
                             esp++;
                             break;
 
@@ -168,14 +406,90 @@ format_char_switch:
                 break;
 
             default:
-                putc(*buf);
+                format_put(out, buf, 1);
                 break;
         }
         buf++;
     }
+    return out->total;
+}
+
+/* void printf_spill(const int8_t* buf, int32_t n);
+ * Inputs: buf = formatted output, n = number of bytes
+ * Return Value: none
+ * Function: Prints a chunk of printf output in one go */
+static void printf_spill(const int8_t* buf, int32_t n) {
+    putbuf((const uint8_t *)buf, n);
+}
+
+/* Standard printf().
+ * Only supports the following format strings:
+ * %%  - print a literal '%' character
+ * %x  - print a number in hexadecimal
+ * %u  - print a number as an unsigned integer
+ * %d  - print a number as a signed integer
+ * %c  - print a character
+ * %s  - print a string
+ * %#x - print a number in 32-bit aligned hexadecimal, i.e.
+ *       print 8 hexadecimal digits, zero-padded on the left.
+ *       For example, the hex number "E" would be printed as
+ *       "0000000E".
+ *       Note: This is slightly different than the libc specification
+ *       for the "#" modifier (this implementation doesn't add a "0x" at
+ *       the beginning), but I think it's more flexible this way.
+ *       Also note: %x is the only conversion specifier that can use
+ *       the "#" modifier to alter output.
+ * The output is formatted into a buffer and printed with putbuf a
+ * buffer at a time. */
+int32_t printf(int8_t *format, ...) {
+    int8_t line[PRINTF_CHUNK];
+    format_out_t out;
+    int32_t n;
+
+    /* set color flag */
+    colorFlag2 = 1;
+
+    out.buf = line;
+    out.size = PRINTF_CHUNK;
+    out.len = 0;
+    out.total = 0;
+    out.spill = printf_spill;
+    /* the other parameters follow the format string on the stack */
+    n = vformat(&out, format, (int32_t *)&format + 1);
+    printf_spill(line, out.len);
+
     colorFlag2 = 0;
 
-    return (buf - format);
+    return n;
+}
+
+/* int32_t vsnprintf(int8_t* str, int32_t size, int8_t* format, int32_t* args);
+ * Inputs: str = buffer for the output, size = size of str, format = printf format string,
+ *         args = first argument after the format string
+ * Return Value: number of characters written, not counting the '\0'
+ * Function: printf into a buffer. Output that does not fit is dropped and str is always '\0' terminated */
+int32_t vsnprintf(int8_t* str, int32_t size, int8_t* format, int32_t* args) {
+    format_out_t out;
+
+    if (size <= 0) {
+        return 0;
+    }
+    out.buf = str;
+    out.size = size - 1;
+    out.len = 0;
+    out.total = 0;
+    out.spill = NULL;
+    vformat(&out, format, args);
+    str[out.len] = '\0';
+    return out.len;
+}
+
+/* int32_t snprintf(int8_t* str, int32_t size, int8_t* format, ...);
+ * Inputs: str = buffer for the output, size = size of str, format = printf format string
+ * Return Value: number of characters written, not counting the '\0'
+ * Function: printf into a buffer, see vsnprintf */
+int32_t snprintf(int8_t* str, int32_t size, int8_t* format, ...) {
+    return vsnprintf(str, size, format, (int32_t *)&format + 1);
 }
 
 /* int32_t puts(int8_t* s);
@@ -188,17 +502,29 @@ int32_t puts(int8_t* s) {
         putc(s[index]);
         index++;
     }
+    console_flush();
     return index;
 }
 
 /* update_cursor
  *   Inputs: none
  *   Return Value: none
- *    Description: Moves the cursor which was initialized for us to screenx,screeny
+ *    Description: Moves the cursor which was initialized for us to the position of the shown terminal,
+ *    screenx,screeny when that is the one being written to. Skips the port writes if it did not move
   */
 void update_cursor(void) {
     //osdev code
-    uint16_t pos = screen_y * NUM_COLS + screen_x;
+    uint16_t pos;
+
+    if(out_term == shown_term){
+        pos = screen_y * NUM_COLS + screen_x;
+    }else{
+        pos = consoles[shown_term].y * NUM_COLS + consoles[shown_term].x;
+    }
+    if(pos == hw_cursor){
+        return;
+    }
+    hw_cursor = pos;
 
     outb(0x0F, 0x3D4);
     outb((uint8_t) (pos & 0xFF), 0x3D5);
@@ -208,138 +534,111 @@ void update_cursor(void) {
 
 }
 
-/* scroll_screen
+/* text_attrib
+ *   Inputs: none
+ *   Return Value: attribute byte for the next characters
+ *    Description: printf output is red unless it is echoing a key press or redrawing the prompt after a
+ *    clear, everything else gets the color of the current terminal
+ */
+static char text_attrib(void) {
+    if(colorFlag2 && !colorFlag && !clearFlag){
+        return ATTRIBX;
+    }
+    // change the ATTRIB based on key press, different text color for each terminal 
+    switch(out_term){
+        case 1:
+            return ATTRIBA;
+        case 2:
+            return ATTRIBB;
+        case 3:
+            return ATTRIBC;
+        default:
+            return ATTRIBY;
+    }
+}
+
+/* erase_char
  *   Inputs: none
  *   Return Value: none
- *    Description: Iterate through video memory and remap the character such that we "move" all of the rows up to scroll
-*/
-void scroll_screen(void){
-    if(!colorFlag){
-        if(colorFlag2){
-            ATTRIB = ATTRIBX;       
+ *    Description: Handles a backspace on the screen. Moves back one character and blanks it, going back
+ *    to the previous row only if we wrapped onto this one, and never erasing into the "391OS> " prompt
+ */
+static void erase_char(void) {
+    if((*(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x - 2) << 1)) != '>') && *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x - 2) << 1)) != '?'){
+        //we can only go back to previous line if we wrapped around
+        if((screen_x == 0) && (ofFlag == 1)){
+            screen_y--;
+            screen_x = NUM_COLS-1;
+            ofFlag = 0;
+            *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = ' ';        
+            MARK_DIRTY(screen_y);
+
         }else{
-            // ATTRIB = ATTRIBY;
-            // change the ATTRIB based on key press, different text color for each terminal 
-            switch(terminal){
-                case 1:
-                    ATTRIB = ATTRIBA;
-                    break;
-                case 2:
-                    ATTRIB = ATTRIBB;
-                    break;
-                case 3:
-                    ATTRIB = ATTRIBC;
-                    break;
-                default:
-                    ATTRIB = ATTRIBY;
-                    break;
-            } 
-        }
-    }else{
-            switch(terminal){
-                case 1:
-                    ATTRIB = ATTRIBA;
-                    break;
-                case 2:
-                    ATTRIB = ATTRIBB;
-                    break;
-                case 3:
-                    ATTRIB = ATTRIBC;
-                    break;
-                default:
-                    ATTRIB = ATTRIBY;
-                    break;
-            } 
-    }
-
-    int row;
-    int col;
-    //go through every line and replace the line above with the line below
-    for(row = 1; row < NUM_ROWS; row++) {
-        for(col = 0; col < NUM_COLS; col++) {
-            /*bug: I put the bottom most row empty section here and it kept clearing the bottom row instead of just moving it up
-            took about 30 min to fix*/
-            
-            //replace line above with line below
-            *(uint8_t *)(video_mem + ((NUM_COLS * (row - 1) + col) << 1)) = *(uint8_t *)(video_mem + ((NUM_COLS * row + col) << 1));
-            //replace color of line above with color of line below
-            *(uint8_t *)(video_mem + ((NUM_COLS * (row - 1) + col) << 1) + 1) = *(uint8_t *)(video_mem + ((NUM_COLS * row + col) << 1) + 1);
-            //Leave bottom-most row empty
-            if(row == NUM_ROWS-1) {
-                *(uint8_t *)(video_mem + ((NUM_COLS * row + col) << 1)) = '\0';
-                *(uint8_t *)(video_mem + ((NUM_COLS * row + col) << 1) + 1) = ATTRIB;
+            //handle backspce on the screen where we move back and clear the character
+            if(screen_x>0){
+                screen_x--;
+                *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = ' ';               
+                MARK_DIRTY(screen_y);
             }
         }
     }
 }
 
+/* scroll_screen
+ *   Inputs: none
+ *   Return Value: none
+ *    Description: Moves every row up by one and blanks the bottom row
+*/
+void scroll_screen(void){
+    scroll_lines(1);
+}
+
+/* scroll_lines
+ *   Inputs: lines = number of rows to scroll up
+ *   Return Value: none
+ *    Description: Moves the rows that stay on screen up with one memmove and fills the freed rows at
+ *    the bottom with blanks a dword (two cells) at a time. Scrolling by NUM_ROWS or more blanks the screen
+*/
+void scroll_lines(int32_t lines){
+    uint32_t blank;
+
+    if(lines <= 0){
+        return;
+    }
+    if(lines > NUM_ROWS){
+        lines = NUM_ROWS;
+    }
+
+    ATTRIB = text_attrib();
+    //blank cell is a '\0' character in the current color, two of them per dword
+    blank = ((uint32_t)(uint8_t)ATTRIB) << 8;
+    blank |= blank << 16;
+
+    //move the rows that stay visible up in one block
+    if(lines < NUM_ROWS){
+        memmove(video_mem, video_mem + ((NUM_COLS * lines) << 1), (NUM_COLS * (NUM_ROWS - lines)) << 1);
+    }
+    //leave the freed rows at the bottom empty
+    memset_dword(video_mem + ((NUM_COLS * (NUM_ROWS - lines)) << 1), blank, (NUM_COLS * lines) >> 1);
+    //every row moved
+    out_con->dirty = ALL_ROWS;
+}
+
 /* void putc(uint8_t c);
  * Inputs: uint_8* c = character to print
  * Return Value: void
  *  Function: Output a character to the console */
 void putc(uint8_t c) {
+    console_mirror(&c, 1);
     /* set different color attirbutes */
-    if(!colorFlag){
-        if(colorFlag2){
-            ATTRIB = ATTRIBX;
-        }else{
-            // ATTRIB = ATTRIBY;
-            // change the ATTRIB based on key press, different text color for each terminal 
-            switch(terminal){
-                case 1:
-                    ATTRIB = ATTRIBA;
-                    break;
-                case 2:
-                    ATTRIB = ATTRIBB;
-                    break;
-                case 3:
-                    ATTRIB = ATTRIBC;
-                    break;
-                default:
-                    ATTRIB = ATTRIBY;
-                    break;
-            }       
-        }
-    }else{
-            // change the ATTRIB based on key press, different text color for each terminal 
-            switch(terminal){
-                case 1:
-                    ATTRIB = ATTRIBA;
-                    break;
-                case 2:
-                    ATTRIB = ATTRIBB;
-                    break;
-                case 3:
-                    ATTRIB = ATTRIBC;
-                    break;
-                default:
-                    ATTRIB = ATTRIBY;
-                    break;
-            }
-    }
-    if(clearFlag){
-        // ATTRIB = ATTRIBY;
-            switch(terminal){
-                case 1:
-                    ATTRIB = ATTRIBA;
-                    break;
-                case 2:
-                    ATTRIB = ATTRIBB;
-                    break;
-                case 3:
-                    ATTRIB = ATTRIBC;
-                    break;
-                default:
-                    ATTRIB = ATTRIBY;
-                    break;
-            } 
-    }
+    ATTRIB = text_attrib();
 
     //if character at the very end of the row then start typing on new line. Wrapping around
     if((screen_x == NUM_COLS-1) && (c != '\b')){
         ofFlag = 1; //flag so we only can go back to previous line if we wrap around
         *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = c;
         *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
+        MARK_DIRTY(screen_y);
         if(screen_y != NUM_ROWS-1){
             //if we are not at the lowest row then we just move the screeny down
             screen_y++;
@@ -352,23 +651,7 @@ void putc(uint8_t c) {
     }else{
         //handling backspace
         if(c == '\b'){
-            if((*(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x - 2) << 1)) != '>') && *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x - 2) << 1)) != '?'){
-                //we can only go back to previous line if we wrapped around
-                if((screen_x == 0) && (ofFlag == 1)){
-                    screen_y--;
-                    screen_x = NUM_COLS-1;
-                    ofFlag = 0;
-                    *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = ' ';        
-
-                }else{
-                    //handle backspce on the screen where we move back and clear the character
-                    if(screen_x>0){
-                        screen_x--;
-                        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = ' ';               
-                    }
-                }
-
-            }
+            erase_char();
 
         //handle new line
         }else if(c == '\n' || c == '\r') {
@@ -385,12 +668,103 @@ void putc(uint8_t c) {
             //normal printing
             *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = c;
             *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
+            MARK_DIRTY(screen_y);
             screen_x++;
             screen_x %= NUM_COLS;
             screen_y = (screen_y + (screen_x / NUM_COLS)) % NUM_ROWS;
         }
     }
-    update_cursor(); //update the cursor to the new location
+    //the screen and the cursor catch up on the next console_flush
+}
+
+/* void putbuf(const uint8_t* buf, int32_t n);
+ * Inputs: const uint8_t* buf = characters to print
+ *         int32_t n = number of characters in buf
+ * Return Value: void
+ *  Function: Output a whole buffer to the console. Same screen result as calling putc on every
+ *  character except '\0', which is skipped, but the attribute is worked out once, each cell is a
+ *  single 16-bit store, the screen is scrolled once for the whole buffer and the changed rows are
+ *  flushed to the screen together with the cursor at the end */
+void putbuf(const uint8_t* buf, int32_t n) {
+    int32_t i;
+    int32_t x;
+    int32_t rows;
+    uint8_t c;
+    uint16_t attrib;
+    uint16_t* cell;
+
+    console_mirror(buf, n);
+    //count how many rows the buffer moves down, using the same wrap rules as the loop below
+    x = screen_x;
+    rows = 0;
+    for(i = 0; i < n; i++){
+        c = buf[i];
+        if(c == '\b'){
+            //backspace can move back up a row, let the loop scroll one row at a time instead
+            rows = 0;
+            break;
+        }
+        if(c == '\0'){
+            continue;
+        }
+        if(x == NUM_COLS-1 || c == '\n' || c == '\r'){
+            rows++;
+            x = 0;
+        }else{
+            x++;
+        }
+    }
+    //scroll once for everything that runs off the bottom. Rows that scroll off again before the
+    //buffer ends are never drawn, screen_y goes negative until we reach the first visible one
+    if(screen_y + rows > NUM_ROWS-1){
+        scroll_lines(screen_y + rows - (NUM_ROWS-1));
+        screen_y = (NUM_ROWS-1) - rows;
+    }
+
+    ATTRIB = text_attrib();
+    attrib = (uint16_t)((uint8_t)ATTRIB) << 8;
+
+    for(i = 0; i < n; i++){
+        c = buf[i];
+        if(c == '\0'){
+            continue;
+        }
+        if(c == '\b'){
+            erase_char();
+            continue;
+        }
+        if(screen_y < 0){
+            //this row has already scrolled off, only track the position
+            if(screen_x == NUM_COLS-1){
+                ofFlag = 1;
+            }else if(c != '\n' && c != '\r'){
+                screen_x++;
+                continue;
+            }
+            screen_y++;
+            screen_x = 0;
+            continue;
+        }
+        cell = (uint16_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1));
+        MARK_DIRTY(screen_y);
+        if(screen_x == NUM_COLS-1){
+            //last column, the character is drawn and we wrap like putc does
+            *cell = attrib | c;
+            ofFlag = 1;
+        }else if(c != '\n' && c != '\r'){
+            *cell = attrib | c;
+            screen_x++;
+            continue;
+        }
+        //new line, either from the character itself or from wrapping around
+        if(screen_y != NUM_ROWS-1){
+            screen_y++;
+        }else{
+            scroll_screen();
+        }
+        screen_x = 0;
+    }
+    console_flush(); //copy the changed rows and move the cursor once for the whole buffer
 }
 
 /* int8_t* itoa(uint32_t value, int8_t* buf, int32_t radix);
@@ -590,7 +964,8 @@ void* memcpy(void* dest, const void* src, uint32_t n) {
 }
 
 /* void* memmove(void* dest, const void* src, uint32_t n);
- * Description: Optimized memmove (used for overlapping memory areas)
+ * Description: Optimized memmove (used for overlapping memory areas). Forward moves go a dword
+ *              at a time, moves to a higher overlapping address still go backwards byte by byte
  * Inputs:      void* dest = destination of move
  *         const void* src = source of move
  *              uint32_t n = number of byets to move
@@ -602,12 +977,21 @@ void* memmove(void* dest, const void* src, uint32_t n) {
             movw    %%dx, %%es                  \n\
             cld                                 \n\
             cmp     %%edi, %%esi                \n\
-            jae     .memmove_go                 \n\
+            jb      .memmove_back               \n\
+            movl    %%ecx, %%edx                \n\
+            shrl    $2, %%ecx                   \n\
+            andl    $0x3, %%edx                 \n\
+            rep     movsl                       \n\
+            movl    %%edx, %%ecx                \n\
+            rep     movsb                       \n\
+            jmp     .memmove_done               \n\
+            .memmove_back:                      \n\
             leal    -1(%%esi, %%ecx), %%esi     \n\
             leal    -1(%%edi, %%ecx), %%edi     \n\
             std                                 \n\
-            .memmove_go:                        \n\
             rep     movsb                       \n\
+            cld                                 \n\
+            .memmove_done:                      \n\
             "
             :
             : "D"(dest), "S"(src), "c"(n)
@@ -686,4 +1070,5 @@ void test_interrupts(void) {
     for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
         video_mem[i << 1]++;
     }
+    out_con->dirty = ALL_ROWS;
 }
@@ -14,7 +14,10 @@ int screen_x;
 int screen_y;
 
 int32_t printf(int8_t *format, ...);
+int32_t snprintf(int8_t* str, int32_t size, int8_t* format, ...);
+int32_t vsnprintf(int8_t* str, int32_t size, int8_t* format, int32_t* args);
 void putc(uint8_t c);
+void putbuf(const uint8_t* buf, int32_t n);
 int32_t puts(int8_t *s);
 int8_t *itoa(uint32_t value, int8_t* buf, int32_t radix);
 int8_t *strrev(int8_t* s);
@@ -40,6 +43,23 @@ int setup_flag;
 
 void update_cursor(void);
 void scroll_screen(void);
+void scroll_lines(int32_t lines);
+
+/* Virtual consoles, one backing page per terminal */
+#define NUM_TERMINALS 3
+
+void console_init(void);
+int32_t console_select(int32_t t);
+void console_show(int32_t t);
+void console_set_mapped(int32_t t, int32_t mapped);
+void console_flush(void);
+int32_t console_dirty(void);
+int32_t console_shown(void);
+
+/* Extra outputs that get a copy of everything printed, like the serial port */
+#define MAX_CONSOLE_SINKS 4
+typedef void (*console_sink_t)(const uint8_t* buf, int32_t n);
+int32_t console_add_sink(console_sink_t sink);
 
 
 /* Port read functions */
@@ -86,6 +106,43 @@ static inline uint32_t inl(port) {
     return val;
 }
 
+/* Reads the 64-bit time stamp counter */
+static inline uint64_t rdtsc(void) {
+    uint64_t val;
+    asm volatile ("rdtsc"
+            : "=A"(val)
+    );
+    return val;
+}
+
+/* Reads the 64-bit model specific register "msr" into hi:lo */
+#define rdmsr(msr, lo, hi)              \
+do {                                    \
+    asm volatile ("rdmsr"               \
+            : "=a"(lo), "=d"(hi)        \
+            : "c"(msr)                  \
+    );                                  \
+} while (0)
+
+/* Writes hi:lo into the 64-bit model specific register "msr" */
+#define wrmsr(msr, lo, hi)              \
+do {                                    \
+    asm volatile ("wrmsr"               \
+            :                           \
+            : "c"(msr), "a"(lo), "d"(hi)\
+            : "memory"                  \
+    );                                  \
+} while (0)
+
+/* Executes cpuid for leaf "leaf" and stores the four result registers */
+#define cpuid(leaf, a, b, c, d)         \
+do {                                    \
+    asm volatile ("cpuid"               \
+            : "=a"(a), "=b"(b), "=c"(c), "=d"(d) \
+            : "a"(leaf), "c"(0)         \
+    );                                  \
+} while (0)
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
@@ -0,0 +1,275 @@
+#include "lock.h"
+#include "sched.h"
+#include "device.h"
+#include "system_calls.h"
+
+/* counters of every named lock, in the order they were set up */
+static lock_stat_t* locks[MAX_LOCKS];
+static int32_t num_locks;
+/* every mutex, so lock_drop_all can find the ones a dying process owns */
+static mutex_t* mutexes[MAX_LOCKS];
+static int32_t num_mutexes;
+
+static const table_pointer_t lockstat_ops = { device_open_none, device_close_none, lockstat_read, lockstat_write };
+
+/* 
+ *   lock_register
+ *   DESCRIPTION: Names a lock's counters and lists them in the lockstat device. Locks past MAX_LOCKS still
+ *   count, they are just not shown
+ *   INPUTS: stat -- the lock's counters, name -- shown by lockstat, cut to LOCK_NAME_LEN - 1 characters
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void lock_register(lock_stat_t* stat, const int8_t* name) {
+    strncpy(stat->name, name, LOCK_NAME_LEN - 1);
+    stat->name[LOCK_NAME_LEN - 1] = '\0';
+    if (num_locks < MAX_LOCKS) {
+        locks[num_locks++] = stat;
+    }
+}
+
+/* 
+ *   lock_init
+ *   DESCRIPTION: Registers the "lockstat" device
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void lock_init(void) {
+    register_device("lockstat", &lockstat_ops);
+}
+
+/* 
+ *   spin_init
+ *   DESCRIPTION: Sets up a free spinlock
+ *   INPUTS: lock -- the lock, name -- name lockstat shows it under, NULL to leave it out
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void spin_init(spinlock_t* lock, const int8_t* name) {
+    memset(lock, 0, sizeof(*lock));
+    if (name != NULL) {
+        lock_register(&lock->stat, name);
+    }
+}
+
+/* 
+ *   ticket_lock / ticket_unlock
+ *   DESCRIPTION: Takes a ticket and spins until it is served, then counts the time the lock was held once it
+ *   is dropped. Waiting is a read-only spin, only the holder writes owner. The cpu does not note the lock as
+ *   held, these are for the kernel lock, which bkl_depth keeps track of
+ *   INPUTS: lock -- the lock
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: the caller keeps interrupts off if an interrupt handler can take the same lock
+ */
+void ticket_lock(spinlock_t* lock) {
+    uint16_t ticket = 1;
+    uint64_t start;
+
+    asm volatile ("lock xaddw %0, %1" : "+r"(ticket), "+m"(lock->next) : : "memory", "cc");
+    if (ticket != lock->owner) {
+        start = rdtsc();
+        while (ticket != lock->owner) {
+            asm volatile ("pause");
+        }
+        lock->stat.contended++;
+        lock->stat.wait_cycles += rdtsc() - start;
+    }
+    lock->stat.acquired++;
+    lock->held_at = rdtsc();
+}
+
+void ticket_unlock(spinlock_t* lock) {
+    uint32_t held = (uint32_t)(rdtsc() - lock->held_at);
+
+    lock->stat.hold_cycles += held;
+    if (held > lock->stat.hold_max) {
+        lock->stat.hold_max = held;
+    }
+    asm volatile ("" : : : "memory");
+    lock->owner++;
+}
+
+/* 
+ *   spin_lock / spin_unlock
+ *   DESCRIPTION: ticket_lock and ticket_unlock that also note the lock in the cpu's held list, so
+ *   lock_drop_all can give back what a system call held when an exception kills its process
+ *   INPUTS: lock -- the lock
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: the caller keeps interrupts off if an interrupt handler can take the same lock
+ */
+void spin_lock(spinlock_t* lock) {
+    cpu_t* cpu;
+
+    ticket_lock(lock);
+    cpu = this_cpu();
+    if (cpu->num_held < CPU_HELD_LOCKS) {
+        cpu->held[cpu->num_held++] = lock;
+    }
+}
+
+void spin_unlock(spinlock_t* lock) {
+    cpu_t* cpu = this_cpu();
+    int32_t i;
+
+    for (i = cpu->num_held - 1; i >= 0; i--) {
+        if (cpu->held[i] == lock) {
+            cpu->num_held--;
+            for (; i < cpu->num_held; i++) {
+                cpu->held[i] = cpu->held[i + 1];
+            }
+            break;
+        }
+    }
+    ticket_unlock(lock);
+}
+
+/* 
+ *   spin_wait
+ *   DESCRIPTION: sched_wait for code holding a spinlock. The lock is dropped while other tasks run and taken
+ *   again before returning. Interrupts stay off in between so no wakeup is missed
+ *   INPUTS: lock -- held by the caller
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller has interrupts off
+ */
+void spin_wait(spinlock_t* lock) {
+    spin_unlock(lock);
+    sched_wait();
+    spin_lock(lock);
+}
+
+/* 
+ *   mutex_init
+ *   DESCRIPTION: Sets up a free mutex
+ *   INPUTS: m -- the mutex, name -- name lockstat shows it under, NULL to leave it out
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void mutex_init(mutex_t* m, const int8_t* name) {
+    memset(m, 0, sizeof(*m));
+    spin_init(&m->lock, NULL);
+    m->owner = -1;
+    if (name != NULL) {
+        lock_register(&m->stat, name);
+    }
+    if (num_mutexes < MAX_LOCKS) {
+        mutexes[num_mutexes++] = m;
+    }
+}
+
+/* 
+ *   mutex_lock / mutex_unlock
+ *   DESCRIPTION: Takes the mutex, waiting in sched_wait while another task holds it, and gives it back,
+ *   waking the waiters. Not for interrupt handlers, which cannot wait
+ *   INPUTS: m -- the mutex
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: may switch tasks
+ */
+void mutex_lock(mutex_t* m) {
+    uint32_t flags;
+    uint64_t start;
+
+    spin_lock_irqsave(&m->lock, flags);
+    if (m->held) {
+        start = rdtsc();
+        m->waiters++;
+        while (m->held) {
+            spin_wait(&m->lock);
+        }
+        m->waiters--;
+        m->stat.contended++;
+        m->stat.wait_cycles += rdtsc() - start;
+    }
+    m->held = 1;
+    m->owner = this_cpu()->pid;
+    m->stat.acquired++;
+    m->held_at = rdtsc();
+    spin_unlock_irqrestore(&m->lock, flags);
+}
+
+void mutex_unlock(mutex_t* m) {
+    uint32_t flags;
+    uint32_t held;
+
+    spin_lock_irqsave(&m->lock, flags);
+    held = (uint32_t)(rdtsc() - m->held_at);
+    m->stat.hold_cycles += held;
+    if (held > m->stat.hold_max) {
+        m->stat.hold_max = held;
+    }
+    m->held = 0;
+    m->owner = -1;
+    if (m->waiters > 0) {
+        sched_wake_all();
+    }
+    spin_unlock_irqrestore(&m->lock, flags);
+}
+
+/* 
+ *   lock_drop_all
+ *   DESCRIPTION: Gives back what a process killed by an exception held: the spinlocks this cpu took for the
+ *   system call it was in and the mutexes it owns. What they guard may be left half updated, but no cpu or
+ *   task waits for them forever
+ *   INPUTS: pid -- the process being killed
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller has interrupts off and holds the kernel lock
+ */
+void lock_drop_all(int32_t pid) {
+    cpu_t* cpu = this_cpu();
+    int32_t i;
+
+    while (cpu->num_held > 0) {
+        spin_unlock(cpu->held[cpu->num_held - 1]);
+    }
+    for (i = 0; i < num_mutexes; i++) {
+        if (mutexes[i]->held && mutexes[i]->owner == pid) {
+            mutexes[i]->held = 0;
+            mutexes[i]->owner = -1;
+            if (mutexes[i]->waiters > 0) {
+                sched_wake_all();
+            }
+        }
+    }
+}
+
+/* 
+ *   lockstat_read
+ *   DESCRIPTION: Reads a lock_stats_t snapshot of the counters of every registered lock, like a regular file
+ *   INPUTS: fd -- file descriptor, buf -- destination, nbytes -- size of buf
+ *   OUTPUTS: number of bytes copied, 0 at the end
+ *   SIDE EFFECTS: advances the file position
+ */
+int32_t lockstat_read(int32_t fd, void* buf, int32_t nbytes) {
+    static lock_stats_t snap;
+    uint32_t flags;
+    int32_t i;
+
+    cli_and_save(flags);
+    memset(&snap, 0, sizeof(snap));
+    snap.num_locks = num_locks;
+    for (i = 0; i < num_locks; i++) {
+        snap.lock[i] = *locks[i];
+    }
+    restore_flags(flags);
+
+    return device_read_snapshot(fd, &snap, sizeof(snap), buf, nbytes);
+}
+
+/* 
+ *   lockstat_write
+ *   DESCRIPTION: Any write clears the counters of every lock
+ *   INPUTS: ignored
+ *   OUTPUTS: nbytes
+ *   SIDE EFFECTS: none
+ */
+int32_t lockstat_write(int32_t fd, const void* buf, int32_t nbytes) {
+    uint32_t flags;
+    int32_t i;
+
+    cli_and_save(flags);
+    for (i = 0; i < num_locks; i++) {
+        memset((uint8_t *)locks[i] + LOCK_NAME_LEN, 0, sizeof(lock_stat_t) - LOCK_NAME_LEN);
+    }
+    restore_flags(flags);
+    return nbytes;
+}
@@ -0,0 +1,82 @@
+#ifndef _X_LOCK_H
+#define _X_LOCK_H
+
+#include "types.h"
+#include "lib.h"
+
+/* locks whose counters the lockstat device shows */
+#define MAX_LOCKS       16
+#define LOCK_NAME_LEN   12
+
+/* contention counters of one lock, the layout is shared with the user level lockstat tool */
+typedef struct lock_stat {
+    int8_t name[LOCK_NAME_LEN];
+    uint32_t acquired;
+    uint32_t contended;             //acquisitions that found the lock taken
+    uint64_t wait_cycles;           //spent spinning, or sleeping for a mutex
+    uint64_t hold_cycles;
+    uint32_t hold_max;
+} lock_stat_t;
+
+/* what the lockstat device reads */
+typedef struct lock_stats {
+    uint32_t num_locks;
+    lock_stat_t lock[MAX_LOCKS];
+} lock_stats_t;
+
+/*
+ * Ticket spinlock. A cpu takes the next ticket and spins until owner gets to it, so cpus get the lock in the
+ * order they asked for it. Holding one with interrupts on is only safe if no interrupt handler takes it too,
+ * the _irqsave variants are for everything else
+ */
+typedef struct spinlock {
+    volatile uint16_t next;         //ticket the next cpu to ask gets
+    volatile uint16_t owner;        //ticket being served, the lock is free when it equals next
+    uint64_t held_at;               //rdtsc when it was taken
+    lock_stat_t stat;
+} spinlock_t;
+
+/* sleeping lock for long critical sections in process context, waiters give the cpu to other tasks */
+typedef struct mutex {
+    spinlock_t lock;                //guards the fields below
+    int32_t held;
+    int32_t owner;                  //pid holding it, -1 for kernel code outside any process
+    int32_t waiters;
+    uint64_t held_at;
+    lock_stat_t stat;
+} mutex_t;
+
+/* spinlock that is held from the start, for the kernel lock */
+#define SPINLOCK_HELD   { .next = 1, .owner = 0 }
+
+void spin_init(spinlock_t* lock, const int8_t* name);
+void spin_lock(spinlock_t* lock);
+void spin_unlock(spinlock_t* lock);
+void ticket_lock(spinlock_t* lock);
+void ticket_unlock(spinlock_t* lock);
+void spin_wait(spinlock_t* lock);
+void mutex_init(mutex_t* m, const int8_t* name);
+void mutex_lock(mutex_t* m);
+void mutex_unlock(mutex_t* m);
+void lock_register(lock_stat_t* stat, const int8_t* name);
+void lock_drop_all(int32_t pid);
+
+/* takes a spinlock with interrupts off, saving the interrupt flag in flags */
+#define spin_lock_irqsave(lock, flags)  \
+do {                                    \
+    cli_and_save(flags);                \
+    spin_lock(lock);                    \
+} while (0)
+
+/* drops a spinlock and puts the interrupt flag back the way spin_lock_irqsave found it */
+#define spin_unlock_irqrestore(lock, flags) \
+do {                                    \
+    spin_unlock(lock);                  \
+    restore_flags(flags);               \
+} while (0)
+
+void lock_init(void);
+int32_t lockstat_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t lockstat_write(int32_t fd, const void* buf, int32_t nbytes);
+
+#endif
@@ -1,16 +1,58 @@
 #include "page.h"
+#include "lib.h"
+#include "smp.h"
+#include "system_calls.h"
+#include "device.h"
 
 //align page directory and table by their number of entries (4*1024 = 4096)
 pd_desc_t pd[1024] __attribute__((aligned(4 * 1024)));
 pt_desc_t pt[1024] __attribute__((aligned(4 * 1024)));
 pt_desc_t vm[1024] __attribute__((aligned(4 * 1024)));
+/* the kernel's 4MB in 4KB pages, so the guard page under each kernel stack can be left out */
+static pt_desc_t kpt[1024] __attribute__((aligned(4 * 1024)));
 
+/*
+ * Every process has a directory of its own: the kernel entries of pd, kept the same in all of them by
+ * page_share, and a table for its 4MB of user space holding only the pages it uses. pd itself is what a cpu
+ * runs on before its first process
+ */
+static pd_desc_t proc_pd[MAX_PROCESSES][DIRECTORY_SIZE] __attribute__((aligned(4 * 1024)));
+static pt_desc_t proc_pt[MAX_PROCESSES][TABLE_SIZE] __attribute__((aligned(4 * 1024)));
+static uint32_t proc_pages[MAX_PROCESSES];
+/*
+ * Bumped whenever a directory's user mappings are torn down or rebuilt. A cpu only skips the CR3 load of a
+ * switch when it still has the same generation loaded, entries of a pid's earlier process are never reused
+ */
+static uint32_t proc_gen[MAX_PROCESSES];
+/* a process's heap runs from the page past its image up to its break, sbrk moves the break */
+static uint32_t proc_heap[MAX_PROCESSES];
+static uint32_t proc_brk[MAX_PROCESSES];
+
+/*
+ * 4KB frames of physical user memory above the kernel, one bit each. There are enough for every process to
+ * fill its whole 4MB, which is as much as a table maps, so a process can only be refused pages past that
+ */
+#define USER_FRAMES     (MAX_PROCESSES * TABLE_SIZE)
+static uint32_t frame_used[USER_FRAMES / 32];
+static uint32_t frames_used;
+/* directories mapping each frame, more than one after a fork until the sharers write to it or halt */
+static uint8_t frame_ref[USER_FRAMES];
+static uint32_t cow_copies;
+static uint32_t cow_reuses;
+static uint32_t demand_pages;
+/* a shared page is copied through here, the writer's mapping of it is read only until the copy is in */
+static uint8_t cow_buf[FOUR_KB_SIZE] __attribute__((aligned(4 * 1024)));
+
+/* CR4 bits every cpu turns on, PSE and PGE when there is one */
+static uint32_t cr4_bits = CR4_PSE;
 
+static const table_pointer_t vmstat_ops = { device_open_none, device_close_none, vmstat_read, vmstat_write };
 
 //inline assembly to set control register 3 to the page 
 //directory address, set the page extension bit of control
 //register 4, and turn on paging as supervisor in control
-//register 0.
+//register 0, with write protection so the kernel's own
+//writes to copy on write pages fault like the user's.
 /* 
  *   page_setup()
  *   DESCRIPTION: Sets the corresponding needed bits to CR3, CR0, and CR4 CPU registers
@@ -24,37 +66,91 @@ void page_setup(){
         "mov %%eax, %%cr3;" 
 
         "mov %%cr4, %%eax;"                
-        "or $0x00000010, %%eax;"         
+        "or %1, %%eax;"         
         "mov %%eax, %%cr4;"                
                                         
         "mov %%cr0, %%eax;"                
-        "or $0x80000001, %%eax;"
+        "or %2, %%eax;"
         "mov %%eax, %%cr0;"         
                                         
-        : : "r"(pd) : "%eax"             
+        : : "r"(pd), "r"(cr4_bits), "r"(0x80000001 | CR0_WP) : "%eax"             
+    );
+}
+
+/* 
+ *   page_cpu_init()
+ *   DESCRIPTION: Turns on the CR4 bits and write protection the boot cpu uses on another cpu, the trampoline
+ *   only sets PSE and paging
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: global pages stay in this cpu's TLB across CR3 loads from here on
+ */
+void page_cpu_init(){
+    asm volatile(
+        "mov %%cr4, %%eax;"
+        "or %0, %%eax;"
+        "mov %%eax, %%cr4;"
+        "mov %%cr0, %%eax;"
+        "or %1, %%eax;"
+        "mov %%eax, %%cr0;"
+        : : "r"(cr4_bits), "r"(CR0_WP) : "%eax"
     );
 }
 
 /* 
  *   page_setup_paging()
- *   DESCRIPTION: CR3 is reloaded so that TLBs can be flushed
+ *   DESCRIPTION: CR3 is reloaded with this cpu's page directory so that TLBs can be flushed
  *   INPUTS: none
  *   OUTPUTS: none
- *   SIDE EFFECTS: TLBs can be flushed 
+ *   SIDE EFFECTS: TLBs can be flushed, except for the global kernel pages
  */
 void page_setup_paging() {
+    cpu_t* cpu = this_cpu();
+
+    cpu->tlb_full++;
     asm volatile(   
         "mov %0, %%eax;"                              
         "mov %%eax, %%cr3;"       
                                         
-        : : "r"(pd) : "%eax"             
+        : : "r"(cpu->pd) : "%eax", "memory"
     );
 }
 
+/* 
+ *   page_flush_one()
+ *   DESCRIPTION: Drops a single page's translation from this cpu's TLB, for a change to one entry that
+ *   should not cost every other translation
+ *   INPUTS: address -- virtual address in the page, a 4MB page goes as a whole
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+static void page_flush_one(uint32_t address) {
+    this_cpu()->tlb_page++;
+    asm volatile ("invlpg (%0)" : : "r"(address) : "memory");
+}
+
 //macro to find index into page directory
 #define PDindex(p)  p>>22
 //macro to find index into page table
 #define PTindex(p)  p>>12 & 0x3FF
+//macro to round an address up to the next page
+#define PAGE_UP(a)  (((a) + FOUR_KB_SIZE - 1) & ~(FOUR_KB_SIZE - 1))
+
+/* 
+ *   page_share()
+ *   DESCRIPTION: Copies a kernel entry of pd to every process's directory, for mappings every process needs
+ *   the same
+ *   INPUTS: index -- directory entry
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: nobody caches a not present entry, so nothing needs flushing
+ */
+static void page_share(uint32_t index){
+    int i;
+
+    for(i = 0; i < MAX_PROCESSES; i++){
+        proc_pd[i][index] = pd[index];
+    }
+}
 
 // array to store addresses for each terminal 
 int VIDEO_PAGE_ADDRESSES[4] = { VIDEO_MEM_ADDRESS, VIDEO_PAGE_ONE, VIDEO_PAGE_TWO, VIDEO_PAGE_THREE };
@@ -63,12 +159,31 @@ int VIDEO_PAGE_ADDRESSES[4] = { VIDEO_MEM_ADDRESS, VIDEO_PAGE_ONE, VIDEO_PAGE_TW
 void start_paging() {
    // printf("Kernel paging");
    
-    //assign kernel address to upper 10 bits, set PS (page size), set P (present bit), set RW (read/write)
-    pd[PDindex(KERNEL_ADDRESS)].val = (KERNEL_ADDRESS & 0xE00000);  //only set first three bits as kernel address
+    uint32_t eax, ebx, ecx, edx;
+    int i;
+
+    //the kernel pages are the same in every directory, with PGE they survive the CR3 load of a switch
+    cpuid(1, eax, ebx, ecx, edx);
+    if(edx & CPUID_PGE){
+        cr4_bits |= CR4_PGE;
+    }
+
+    //map the kernel 4KB at a time at the same address, global and kernel only
+    for(i = 0; i < TABLE_SIZE; i++){
+        kpt[i].val = KERNEL_ADDRESS + i * FOUR_KB_SIZE;
+        kpt[i].p = 1;
+        kpt[i].rw = 1;
+        kpt[i].g = 1;
+    }
+    //except for the guard page at the bottom of the boot stack and of every process's kernel stack
+    for(i = -1; i < MAX_PROCESSES; i++){
+        kpt[PTindex(KSLOT(i))].p = 0;
+    }
+
+    //assign the kernel table address, set P (present bit), set RW (read/write)
+    pd[PDindex(KERNEL_ADDRESS)].val = (unsigned int)kpt;
     pd[PDindex(KERNEL_ADDRESS)].p = 1;
     pd[PDindex(KERNEL_ADDRESS)].rw = 1;
-    pd[PDindex(KERNEL_ADDRESS)].ps = 1;
-    pd[PDindex(KERNEL_ADDRESS)].g = 1;
 
     //assign page table address, set US (user/supervisor),  set P (present bit), set RW (read/write)
     pd[PDindex(VIDEO_MEM_ADDRESS)].val = (unsigned int)pt;
@@ -81,75 +196,675 @@ void start_paging() {
     pt[PTindex(VIDEO_MEM_ADDRESS)].p = 1;
     pt[PTindex(VIDEO_MEM_ADDRESS)].rw = 1;
     pt[PTindex(VIDEO_MEM_ADDRESS)].us = 0; // 1 because user should have access to video memory, else 0
+    pt[PTindex(VIDEO_MEM_ADDRESS)].g = 1;
 
     // assign video mem page for terminal 1
     pt[PTindex(VIDEO_PAGE_ONE)].val = VIDEO_PAGE_ONE;
     pt[PTindex(VIDEO_PAGE_ONE)].p = 1;
     pt[PTindex(VIDEO_PAGE_ONE)].rw = 1;
     pt[PTindex(VIDEO_PAGE_ONE)].us = 0; // 1 because user should have access to video memory, else 0
+    pt[PTindex(VIDEO_PAGE_ONE)].g = 1;
 
     // assign video mem page for terminal 1
     pt[PTindex(VIDEO_PAGE_TWO)].val = VIDEO_PAGE_TWO;
     pt[PTindex(VIDEO_PAGE_TWO)].p = 1;
     pt[PTindex(VIDEO_PAGE_TWO)].rw = 1;
     pt[PTindex(VIDEO_PAGE_TWO)].us = 0; // 1 because user should have access to video memory, else 0
+    pt[PTindex(VIDEO_PAGE_TWO)].g = 1;
     
     // assign video mem page for terminal 1
     pt[PTindex(VIDEO_PAGE_THREE)].val = VIDEO_PAGE_THREE;
     pt[PTindex(VIDEO_PAGE_THREE)].p = 1;
     pt[PTindex(VIDEO_PAGE_THREE)].rw = 1;
     pt[PTindex(VIDEO_PAGE_THREE)].us = 0; // 1 because user should have access to video memory, else 0
+    pt[PTindex(VIDEO_PAGE_THREE)].g = 1;
 
     page_setup(); 
 }
 
 /* 
  *   program_paging(uint8_t pid)
- *   DESCRIPTION: Remaps the address for program virtual address in virtual memory to a different 
- *   location in phsycial memory based on the process we are at, this is in multiples of 4MB
- *   after 8MB kernel page 
+ *   DESCRIPTION: Switches this cpu to a process's directory, its user space is whatever page_map_user put in
+ *   the process's table. Without PCIDs, which need long mode, a switch to another directory drops its TLB
+ *   entries; only a return to the one still loaded keeps them
  *   INPUTS: uint8_t pid
  *   OUTPUTS: none
- *   SIDE EFFECTS: program virtual address gets mapped to a diffrent address in physical memory
+ *   SIDE EFFECTS: loads CR3 unless the same generation of the directory is loaded already
  */
 void program_paging(uint8_t pid) {
+    cpu_t* cpu = this_cpu();
 
-    // maps to the correspodning physical memory address based on whichp process we are at
-    pd[PDindex(PROG_VIR_ADDRESS)].val = ((PROGRAM_ADDRESS + (0x400000 * pid)) & 0xE00000);  //only set first three bits as shell address
-    pd[PDindex(PROG_VIR_ADDRESS)].p = 1;
-    pd[PDindex(PROG_VIR_ADDRESS)].rw = 1;
-    pd[PDindex(PROG_VIR_ADDRESS)].ps = 1;
-    pd[PDindex(PROG_VIR_ADDRESS)].us = 1;
-
-    /* clears TLBS, sets up normal paging scheme */
+    /* back to what is still loaded, the idle loop in between only touched global kernel pages */
+    if(cpu->pd == proc_pd[pid] && cpu->pd_gen == proc_gen[pid]){
+        cpu->tlb_kept++;
+        return;
+    }
+    cpu->pd = proc_pd[pid];
+    cpu->pd_gen = proc_gen[pid];
     page_setup_paging();
 }
 
+/* 
+ *   page_dir_create(int32_t pid)
+ *   DESCRIPTION: Sets up a new process's directory: the kernel entries, and its user table with nothing in it
+ *   INPUTS: pid -- the process, its pages were released when the last one in the slot halted
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void page_dir_create(int32_t pid) {
+    pd_desc_t* dir = proc_pd[pid];
+
+    memcpy(dir, pd, sizeof(proc_pd[0]));
+    proc_gen[pid]++;
+    dir[PDindex(USER_SPACE)].val = (unsigned int)proc_pt[pid];
+    dir[PDindex(USER_SPACE)].p = 1;
+    dir[PDindex(USER_SPACE)].rw = 1;
+    dir[PDindex(USER_SPACE)].us = 1;
+}
+
+/* 
+ *   frame_alloc / frame_free
+ *   DESCRIPTION: Take a 4KB frame of user memory, and drop a directory's reference to one, which gives it
+ *   back once no directory maps it
+ *   INPUTS: frame -- physical address of a frame frame_alloc handed out
+ *   OUTPUTS: physical address of the frame, 0 when there is none left
+ *   SIDE EFFECTS: none, the caller holds the kernel lock
+ */
+static uint32_t frame_alloc(void) {
+    uint32_t i, bit;
+
+    for(i = 0; i < USER_FRAMES / 32; i++){
+        if(frame_used[i] != 0xFFFFFFFF){
+            for(bit = 0; frame_used[i] & (1 << bit); bit++);
+            frame_used[i] |= 1 << bit;
+            frame_ref[i * 32 + bit] = 1;
+            frames_used++;
+            return PROGRAM_ADDRESS + (i * 32 + bit) * FOUR_KB_SIZE;
+        }
+    }
+    return 0;
+}
+
+static void frame_free(uint32_t frame) {
+    uint32_t n = (frame - PROGRAM_ADDRESS) / FOUR_KB_SIZE;
+
+    if(--frame_ref[n] != 0){
+        return;
+    }
+    frame_used[n / 32] &= ~(1 << (n % 32));
+    frames_used--;
+}
+
+/* 
+ *   page_map_user(int32_t pid, uint32_t address, uint32_t pages)
+ *   DESCRIPTION: Backs a range of a process's user space with zeroed frames, pages already there are kept
+ *   INPUTS: pid -- the process, its directory is the one loaded on this cpu; address -- page aligned start
+ *   in user space; pages -- number of 4KB pages
+ *   OUTPUTS: 0, -1 if the range leaves user space or the frames ran out, the pages mapped so far stay
+ *   SIDE EFFECTS: the new pages are zeroed through their mapping
+ */
+int32_t page_map_user(int32_t pid, uint32_t address, uint32_t pages) {
+    pt_desc_t* table = proc_pt[pid];
+    uint32_t frame;
+
+    if(address < USER_SPACE || pages > TABLE_SIZE || address + pages * FOUR_KB_SIZE > USER_SPACE + USER_SPACE_SIZE){
+        return -1;
+    }
+    for(; pages > 0; pages--, address += FOUR_KB_SIZE){
+        if(table[PTindex(address)].p){
+            continue;
+        }
+        if((frame = frame_alloc()) == 0){
+            return -1;
+        }
+        table[PTindex(address)].val = frame;
+        table[PTindex(address)].p = 1;
+        table[PTindex(address)].rw = 1;
+        table[PTindex(address)].us = 1;
+        proc_pages[pid]++;
+        memset((void *)address, 0, FOUR_KB_SIZE);
+    }
+    return 0;
+}
+
+/* 
+ *   page_release(int32_t pid)
+ *   DESCRIPTION: Gives back every frame of a halting process and takes its vidmap table out of its directory
+ *   INPUTS: pid -- the process
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: flushes the TLB when the directory is the loaded one. Another cpu that still has it loaded
+ *   sees the new generation and reloads it before running the slot's next process
+ */
+void page_release(int32_t pid) {
+    pt_desc_t* table = proc_pt[pid];
+    int i;
+
+    for(i = 0; i < TABLE_SIZE; i++){
+        if(table[i].p){
+            frame_free(table[i].val & 0xFFFFF000);
+        }
+        table[i].val = 0;
+    }
+    proc_pd[pid][PDindex(VIDMAP_ADDRESS)].val = 0;
+    proc_pages[pid] = 0;
+    proc_heap[pid] = 0;
+    proc_brk[pid] = 0;
+    proc_gen[pid]++;
+    /* the whole address space went, one CR3 load is cheaper than an invlpg per page */
+    if(this_cpu()->pd == proc_pd[pid]){
+        page_setup_paging();
+    }
+}
+
+/* 
+ *   page_fork(int32_t parent, int32_t child)
+ *   DESCRIPTION: Gives a new process the parent's user space without copying it. Both tables point at the
+ *   same frames, the writable ones read only and marked PTE_COW in both, and page_cow_fault hands out a
+ *   private copy to whichever of them writes first. The vidmap table is shared as it is
+ *   INPUTS: parent -- the calling process, child -- a free slot for the new one
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: the parent's writable pages turn read only, the parent's directory gets a new generation so
+ *   no cpu keeps their writable translations
+ */
+void page_fork(int32_t parent, int32_t child) {
+    pt_desc_t* from = proc_pt[parent];
+    pt_desc_t* to = proc_pt[child];
+    cpu_t* cpu = this_cpu();
+    int i;
+
+    page_dir_create(child);
+    for(i = 0; i < TABLE_SIZE; i++){
+        /* pages reserved but never touched stay that way, each gets its own frame when it is */
+        if(!from[i].p){
+            to[i] = from[i];
+            continue;
+        }
+        if(from[i].rw){
+            from[i].rw = 0;
+            from[i].avl = PTE_COW;
+        }
+        to[i] = from[i];
+        frame_ref[((from[i].val & 0xFFFFF000) - PROGRAM_ADDRESS) / FOUR_KB_SIZE]++;
+        proc_pages[child]++;
+    }
+    proc_pd[child][PDindex(VIDMAP_ADDRESS)] = proc_pd[parent][PDindex(VIDMAP_ADDRESS)];
+    proc_heap[child] = proc_heap[parent];
+    proc_brk[child] = proc_brk[parent];
+
+    proc_gen[parent]++;
+    if(cpu->pd == proc_pd[parent]){
+        cpu->pd_gen = proc_gen[parent];
+        page_setup_paging();
+    }
+}
+
+/* 
+ *   page_cow_fault(uint32_t address, uint32_t error)
+ *   DESCRIPTION: Resolves a write to a page page_fork shared. The last process still mapping the frame just
+ *   gets it writable again, any other gets a copy of its own. Writes by the kernel to a user buffer land here
+ *   too, CR0.WP makes them fault
+ *   INPUTS: address -- faulting address from CR2, error -- error code the cpu pushed
+ *   OUTPUTS: 0 if the write can be retried, -1 for a fault that is not a copy on write one, or when the frames
+ *   ran out
+ *   SIDE EFFECTS: drops the page from this cpu's TLB, only this cpu runs the process
+ */
+int32_t page_cow_fault(uint32_t address, uint32_t error) {
+    int32_t pid = this_cpu()->pid;
+    pt_desc_t* entry;
+    uint32_t frame, copy;
+
+    if(pid < 0 || (error & (PF_PRESENT | PF_WRITE)) != (PF_PRESENT | PF_WRITE) ||
+       address < USER_SPACE || address >= USER_SPACE + USER_SPACE_SIZE){
+        return -1;
+    }
+    entry = &proc_pt[pid][PTindex(address)];
+    if(!entry->p || entry->avl != PTE_COW){
+        return -1;
+    }
+    address &= ~(FOUR_KB_SIZE - 1);
+    frame = entry->val & 0xFFFFF000;
+
+    if(frame_ref[(frame - PROGRAM_ADDRESS) / FOUR_KB_SIZE] == 1){
+        entry->rw = 1;
+        entry->avl = 0;
+        page_flush_one(address);
+        cow_reuses++;
+        return 0;
+    }
+    if((copy = frame_alloc()) == 0){
+        return -1;
+    }
+    memcpy(cow_buf, (void *)address, FOUR_KB_SIZE);
+    frame_free(frame);
+    entry->val = copy;
+    entry->p = 1;
+    entry->rw = 1;
+    entry->us = 1;
+    page_flush_one(address);
+    memcpy((void *)address, cow_buf, FOUR_KB_SIZE);
+    cow_copies++;
+    return 0;
+}
+
+/* 
+ *   page_heap_init(int32_t pid, uint32_t image_end)
+ *   DESCRIPTION: Starts a new program's heap empty, on the page past its image
+ *   INPUTS: pid -- the process, image_end -- first address past its image and bss
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void page_heap_init(int32_t pid, uint32_t image_end) {
+    proc_heap[pid] = PAGE_UP(image_end);
+    proc_brk[pid] = proc_heap[pid];
+}
+
+/* 
+ *   page_reserve / page_unmap
+ *   DESCRIPTION: Mark a range of the calling process's user space PTE_LAZY, and take a range out of it again,
+ *   giving back the frames that were touched
+ *   INPUTS: pid -- the process, its directory is the one loaded on this cpu; address -- page aligned start;
+ *   pages -- number of 4KB pages, all in user space
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: page_unmap drops the pages from this cpu's TLB and gives the directory a new generation,
+ *   another cpu the process ran on before reloads it instead of using what it still has cached
+ */
+static void page_reserve(int32_t pid, uint32_t address, uint32_t pages) {
+    pt_desc_t* table = proc_pt[pid];
+
+    for(; pages > 0; pages--, address += FOUR_KB_SIZE){
+        table[PTindex(address)].val = 0;
+        table[PTindex(address)].avl = PTE_LAZY;
+    }
+}
+
+static void page_unmap(int32_t pid, uint32_t address, uint32_t pages) {
+    pt_desc_t* table = proc_pt[pid];
+    cpu_t* cpu = this_cpu();
+    int32_t dropped = 0;
+
+    for(; pages > 0; pages--, address += FOUR_KB_SIZE){
+        if(table[PTindex(address)].p){
+            frame_free(table[PTindex(address)].val & 0xFFFFF000);
+            proc_pages[pid]--;
+            page_flush_one(address);
+            dropped = 1;
+        }
+        table[PTindex(address)].val = 0;
+    }
+    if(dropped){
+        proc_gen[pid]++;
+        if(cpu->pd == proc_pd[pid]){
+            cpu->pd_gen = proc_gen[pid];
+        }
+    }
+}
+
+/* 
+ *   page_demand_fault(uint32_t address, uint32_t error)
+ *   DESCRIPTION: Backs a page sbrk or mmap reserved with a zeroed frame on its first touch, by the process or
+ *   by the kernel on its behalf
+ *   INPUTS: address -- faulting address from CR2, error -- error code the cpu pushed
+ *   OUTPUTS: 0 if the access can be retried, -1 for a fault on a page nothing reserved, or when the frames ran
+ *   out
+ *   SIDE EFFECTS: none to flush, a not present entry is never cached
+ */
+int32_t page_demand_fault(uint32_t address, uint32_t error) {
+    int32_t pid = this_cpu()->pid;
+    pt_desc_t* entry;
+    uint32_t frame;
+
+    if(pid < 0 || (error & PF_PRESENT) || address < USER_SPACE || address >= USER_SPACE + USER_SPACE_SIZE){
+        return -1;
+    }
+    entry = &proc_pt[pid][PTindex(address)];
+    if(entry->p || entry->avl != PTE_LAZY || (frame = frame_alloc()) == 0){
+        return -1;
+    }
+    entry->val = frame;
+    entry->p = 1;
+    entry->rw = 1;
+    entry->us = 1;
+    proc_pages[pid]++;
+    demand_pages++;
+    memset((void *)(address & ~(FOUR_KB_SIZE - 1)), 0, FOUR_KB_SIZE);
+    return 0;
+}
+
+/* 
+ *   sbrk(int32_t increment)
+ *   DESCRIPTION: Moves the calling process's heap break. Pages the heap grows over are only reserved, the
+ *   first touch of each backs it; pages it shrinks off are given back
+ *   INPUTS: increment -- bytes to grow the heap by, negative to shrink it, 0 to read the break
+ *   OUTPUTS: the old break, -1 if the heap would run into a mapping, the stack or below its start
+ *   SIDE EFFECTS: none
+ */
+int32_t sbrk(int32_t increment) {
+    int32_t pid = this_cpu()->pid;
+    uint32_t old, new, from, to, page;
+
+    if(pid < 0){
+        return -1;
+    }
+    old = proc_brk[pid];
+    new = old + (uint32_t)increment;
+    from = PAGE_UP(old);
+    to = PAGE_UP(new);
+    if(increment >= 0){
+        if(new < old || new > USER_MMAP_TOP){
+            return -1;
+        }
+        /* mmap may have taken pages right above the break */
+        for(page = from; page < to; page += FOUR_KB_SIZE){
+            if(proc_pt[pid][PTindex(page)].val != 0){
+                return -1;
+            }
+        }
+        page_reserve(pid, from, (to - from) / FOUR_KB_SIZE);
+    } else {
+        if(new > old || new < proc_heap[pid]){
+            return -1;
+        }
+        page_unmap(pid, to, (from - to) / FOUR_KB_SIZE);
+    }
+    proc_brk[pid] = new;
+    return old;
+}
+
+/* 
+ *   mmap(int32_t length)
+ *   DESCRIPTION: Reserves a run of free pages between the heap's break and the stack for the calling process,
+ *   anonymous and zero filled on first touch. Runs are taken from the top down so the heap keeps room to grow
+ *   INPUTS: length -- bytes, rounded up to whole pages
+ *   OUTPUTS: address of the first page, -1 if no run that long is free
+ *   SIDE EFFECTS: none
+ */
+int32_t mmap(int32_t length) {
+    int32_t pid = this_cpu()->pid;
+    uint32_t pages, run, low, i;
+
+    if(pid < 0 || length <= 0 || length > USER_SPACE_SIZE){
+        return -1;
+    }
+    pages = PAGE_UP((uint32_t)length) / FOUR_KB_SIZE;
+    low = PAGE_UP(proc_brk[pid]);
+    low = PTindex(low);
+    run = 0;
+    for(i = (USER_MMAP_TOP - USER_SPACE) / FOUR_KB_SIZE; i > low; i--){
+        run = (proc_pt[pid][i - 1].val != 0) ? 0 : run + 1;
+        if(run == pages){
+            page_reserve(pid, USER_SPACE + (i - 1) * FOUR_KB_SIZE, pages);
+            return USER_SPACE + (i - 1) * FOUR_KB_SIZE;
+        }
+    }
+    return -1;
+}
+
+/* 
+ *   munmap(void* address, int32_t length)
+ *   DESCRIPTION: Gives back pages mmap reserved for the calling process, touched or not
+ *   INPUTS: address -- page aligned start, length -- bytes, rounded up to whole pages
+ *   OUTPUTS: 0, -1 for a range that is not between the heap's break and the stack
+ *   SIDE EFFECTS: the range faults again if used
+ */
+int32_t munmap(void* address, int32_t length) {
+    int32_t pid = this_cpu()->pid;
+    uint32_t start = (uint32_t)address;
+    uint32_t pages;
+
+    if(pid < 0 || length <= 0 || length > USER_SPACE_SIZE || (start & (FOUR_KB_SIZE - 1))){
+        return -1;
+    }
+    pages = PAGE_UP((uint32_t)length) / FOUR_KB_SIZE;
+    if(start < PAGE_UP(proc_brk[pid]) || start > USER_MMAP_TOP || pages > (USER_MMAP_TOP - start) / FOUR_KB_SIZE){
+        return -1;
+    }
+    page_unmap(pid, start, pages);
+    return 0;
+}
+
+/* 
+ *   page_user_pages(int32_t pid)
+ *   DESCRIPTION: Number of 4KB pages a process has mapped in user space
+ *   INPUTS: pid -- the process
+ *   OUTPUTS: the count
+ *   SIDE EFFECTS: none
+ */
+uint32_t page_user_pages(int32_t pid) {
+    return proc_pages[pid];
+}
+
+/* 
+ *   page_user_ok(const void* address, uint32_t len)
+ *   DESCRIPTION: Checks that a buffer a system call was handed lies in pages the calling process has mapped
+ *   INPUTS: address, len -- the buffer
+ *   OUTPUTS: 1 if the kernel can use it, 0 if it would fault
+ *   SIDE EFFECTS: none
+ */
+int32_t page_user_ok(const void* address, uint32_t len) {
+    int32_t pid = this_cpu()->pid;
+    uint32_t start = (uint32_t)address;
+    uint32_t page;
+
+    /* compared as what is left of user space past start, start + len can wrap around */
+    if(pid < 0 || start < USER_SPACE || start >= USER_SPACE + USER_SPACE_SIZE || len > USER_SPACE + USER_SPACE_SIZE - start){
+        return 0;
+    }
+    for(page = start & ~(FOUR_KB_SIZE - 1); page < start + len; page += FOUR_KB_SIZE){
+        /* a reserved page is backed by the fault the kernel's own access takes */
+        if(!proc_pt[pid][PTindex(page)].p && proc_pt[pid][PTindex(page)].avl != PTE_LAZY){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* 
+ *   page_user_str_ok(const uint8_t* s, uint32_t max)
+ *   DESCRIPTION: page_user_ok for a string a system call was handed, whose length is only known by reading it.
+ *   Each page is checked before its first byte is read
+ *   INPUTS: s -- the string, max -- most bytes the caller reads of it
+ *   OUTPUTS: 1 if every byte up to its NUL, or the first max, can be read, 0 if one would fault
+ *   SIDE EFFECTS: none
+ */
+int32_t page_user_str_ok(const uint8_t* s, uint32_t max) {
+    uint32_t i;
+
+    for(i = 0; i < max; i++){
+        if((i == 0 || ((uint32_t)&s[i] & (FOUR_KB_SIZE - 1)) == 0) && !page_user_ok(&s[i], 1)){
+            return 0;
+        }
+        if(s[i] == '\0'){
+            break;
+        }
+    }
+    return 1;
+}
+
+
+/* 
+ *   page_vidmap_mapped(int32_t pid)
+ *   DESCRIPTION: Whether a process has the vidmap pages in its directory, from its own vidmap call or its
+ *   parent's before fork
+ *   INPUTS: pid -- the process
+ *   OUTPUTS: 1 if so, 0 if not
+ *   SIDE EFFECTS: none
+ */
+int32_t page_vidmap_mapped(int32_t pid){
+    return proc_pd[pid][PDindex(VIDMAP_ADDRESS)].p;
+}
+
+
+/* 
+ *   vidmap_page()
+ *   DESCRIPTION: Points the vidmap page of a terminal at real video memory when that terminal is on screen and at
+ *   its backing page otherwise
+ *   INPUTS: terminal -- terminal number (1-3), visible -- whether the terminal is on screen
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: changes vm entry terminal-1, the caller flushes the TLB
+ */
+static void vidmap_page(int terminal, int visible){
+    vm[terminal - 1].val = VIDEO_PAGE_ADDRESSES[visible ? 0 : terminal];
+    vm[terminal - 1].p = 1;
+    vm[terminal - 1].us = 1;
+    vm[terminal - 1].rw = 1;
+}
 
 /* 
  *   vidmap_paging()
- *   DESCRIPTION: Initializes the table and directory with the correct values for their entries for vidmap
- *   INPUTS: screenstart
+ *   DESCRIPTION: Initializes the table and directory with the correct values for their entries for vidmap. Every
+ *   terminal gets its own page in the vidmap table, so a program on a terminal that is not shown draws into that
+ *   terminal's backing page instead of over the screen
+ *   INPUTS: screenstart, terminal -- terminal of the calling process
  *   OUTPUTS: none
- *   SIDE EFFECTS: assigns the screen start pointer to the vidmap address
+ *   SIDE EFFECTS: assigns the screen start pointer to the vidmap address of the terminal
  */
 void vidmap_paging(int8_t** screen_start, int terminal){
+    /* only the calling process's directory gets the table, it goes with the process to any cpu */
+    pd_desc_t* dir = this_cpu()->pd;
+
     //assign page table address, set US (user/supervisor),  set P (present bit)
-    pd[PDindex(VIDMAP_ADDRESS)].val = (unsigned int)vm;
-    pd[PDindex(VIDMAP_ADDRESS)].p = 1;
-    pd[PDindex(VIDMAP_ADDRESS)].us = 1;
-    pd[PDindex(VIDMAP_ADDRESS)].rw = 1;
-    //assign video memory address, set US (user/supervisor),  set P (present bit)
-    vm[0].val = VIDEO_MEM_ADDRESS;
-    vm[0].p = 1;
-    vm[0].us = 1;
-    vm[0].rw = 1;
+    dir[PDindex(VIDMAP_ADDRESS)].val = (unsigned int)vm;
+    dir[PDindex(VIDMAP_ADDRESS)].p = 1;
+    dir[PDindex(VIDMAP_ADDRESS)].us = 1;
+    dir[PDindex(VIDMAP_ADDRESS)].rw = 1;
+    //assign video memory or the backing page, set US (user/supervisor),  set P (present bit)
+    vidmap_page(terminal, terminal == console_shown());
 
     /*assigns the screen start pointer to the vidmap address */
-    *screen_start = (int8_t *)VIDMAP_ADDRESS;
+    *screen_start = (int8_t *)(VIDMAP_ADDRESS + (terminal - 1) * FOUR_KB_SIZE);
 
-    /* clears TLBS, sets up normal paging scheme */
-    page_setup_paging();
+    /* only this page can have changed */
+    page_flush_one(VIDMAP_ADDRESS + (terminal - 1) * FOUR_KB_SIZE);
+}
+
+/* 
+ *   vidmap_switch()
+ *   DESCRIPTION: Swaps the vidmap pages on a terminal switch, the old terminal's programs now draw into its
+ *   backing page and the new terminal's programs into video memory
+ *   INPUTS: old_terminal -- terminal taken off screen, new_terminal -- terminal now on screen
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: drops the changed pages from this cpu's TLB, the other cpus flush theirs whole before it returns
+ */
+void vidmap_switch(int old_terminal, int new_terminal){
+    int changed = 0;
+
+    if(vm[old_terminal - 1].p){
+        vidmap_page(old_terminal, 0);
+        page_flush_one(VIDMAP_ADDRESS + (old_terminal - 1) * FOUR_KB_SIZE);
+        changed = 1;
+    }
+    if(vm[new_terminal - 1].p){
+        vidmap_page(new_terminal, 1);
+        page_flush_one(VIDMAP_ADDRESS + (new_terminal - 1) * FOUR_KB_SIZE);
+        changed = 1;
+    }
+    if(changed){
+        smp_tlb_flush();
+    }
 }
 
+/* 
+ *   mmio_paging()
+ *   DESCRIPTION: Maps the 4MB region holding a device's registers at the same virtual address, kernel only,
+ *   global and uncached so every access reaches the device
+ *   INPUTS: address -- physical address of the registers
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: drops the region from the TLB
+ */
+void mmio_paging(uint32_t address){
+    pd[PDindex(address)].val = address & 0xFFC00000;
+    pd[PDindex(address)].p = 1;
+    pd[PDindex(address)].rw = 1;
+    pd[PDindex(address)].ps = 1;
+    pd[PDindex(address)].pcd = 1;
+    pd[PDindex(address)].pwt = 1;
+    pd[PDindex(address)].g = 1;
+    page_share(PDindex(address));
+
+    page_flush_one(address);
+}
 
+/* 
+ *   low_paging()
+ *   DESCRIPTION: Maps a 4KB page of the first 4MB at the same address, kernel only. Used for the page the
+ *   other cpus start in, which must stay mapped while they turn paging on
+ *   INPUTS: address -- page aligned physical address below 4MB
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: drops the page from the TLB
+ */
+void low_paging(uint32_t address){
+    pt[PTindex(address)].val = address;
+    pt[PTindex(address)].p = 1;
+    pt[PTindex(address)].rw = 1;
+    pt[PTindex(address)].us = 0;
+    pt[PTindex(address)].g = 1;
+
+    page_flush_one(address);
+}
+
+/* 
+ *   page_init()
+ *   DESCRIPTION: Registers the "vmstat" device that reads the TLB flush counters and user memory in use
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: a new name can be opened
+ */
+void page_init(void){
+    register_device("vmstat", &vmstat_ops);
+}
+
+/* 
+ *   vmstat_read
+ *   DESCRIPTION: Reads a vm_stat_t snapshot of every cpu's flush counters and the user frames in use, like a
+ *   regular file
+ *   INPUTS: fd -- file descriptor, buf -- destination, nbytes -- size of buf
+ *   OUTPUTS: number of bytes copied, 0 at the end
+ *   SIDE EFFECTS: advances the file position
+ */
+int32_t vmstat_read(int32_t fd, void* buf, int32_t nbytes){
+    static vm_stat_t snap;
+    uint32_t flags;
+    int32_t i;
+
+    cli_and_save(flags);
+    memset(&snap, 0, sizeof(snap));
+    snap.num_cpus = num_cpus;
+    snap.global_pages = (cr4_bits & CR4_PGE) ? 1 : 0;
+    snap.frames = USER_FRAMES;
+    snap.frames_used = frames_used;
+    snap.cow_copies = cow_copies;
+    snap.cow_reuses = cow_reuses;
+    snap.demand_pages = demand_pages;
+    for(i = 0; i < num_cpus; i++){
+        snap.cpu[i].tlb_full = cpus[i].tlb_full;
+        snap.cpu[i].tlb_page = cpus[i].tlb_page;
+        snap.cpu[i].tlb_kept = cpus[i].tlb_kept;
+    }
+    restore_flags(flags);
+
+    return device_read_snapshot(fd, &snap, sizeof(snap), buf, nbytes);
+}
+
+/* 
+ *   vmstat_write
+ *   DESCRIPTION: Any write clears the flush, copy on write and demand paging counters
+ *   INPUTS: ignored
+ *   OUTPUTS: nbytes
+ *   SIDE EFFECTS: none
+ */
+int32_t vmstat_write(int32_t fd, const void* buf, int32_t nbytes){
+    uint32_t flags;
+    int32_t i;
+
+    cli_and_save(flags);
+    cow_copies = 0;
+    cow_reuses = 0;
+    demand_pages = 0;
+    for(i = 0; i < num_cpus; i++){
+        cpus[i].tlb_full = 0;
+        cpus[i].tlb_page = 0;
+        cpus[i].tlb_kept = 0;
+    }
+    restore_flags(flags);
+    return nbytes;
+}
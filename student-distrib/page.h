@@ -1,3 +1,6 @@
+#ifndef _X_PAGE_H
+#define _X_PAGE_H
+
 #include "x86_desc.h"
 
 #define DIRECTORY_SIZE 1024             // number of entries in the directory and table
@@ -17,6 +20,26 @@
 #define   PROG_VIR_ADDRESS    0x08000000
 #define   VIDMAP_ADDRESS      0x8400000 
 #define   USER_SPACE          0x8000000
+#define   USER_SPACE_SIZE     0x400000  //one table's worth of 4KB pages per process
+#define   PROG_IMAGE_ADDRESS  0x08048000    //where execute copies a program file
+#define   USER_STACK_PAGES    16        //pages below the top of user space every program gets for its stack
+/* mmap hands out pages from here down to the heap's break */
+#define   USER_MMAP_TOP       (USER_SPACE + USER_SPACE_SIZE - USER_STACK_PAGES * FOUR_KB_SIZE)
+
+/* CR4 page size extension and global page enable, cpuid leaf 1 edx bit for the latter */
+#define   CR4_PSE             0x00000010
+#define   CR4_PGE             0x00000080
+#define   CPUID_PGE           (1 << 13)
+/* CR0 write protect, supervisor writes to read only pages fault as well, so the kernel copies shared pages too */
+#define   CR0_WP              0x00010000
+
+/* avl bits of a user page table entry: read only only until written, see page_fork */
+#define   PTE_COW             0x1
+/* avl bits of a not present one: reserved by sbrk or mmap, backed by a zeroed frame when first touched */
+#define   PTE_LAZY            0x2
+/* page fault error code bits */
+#define   PF_PRESENT          0x1
+#define   PF_WRITE            0x2
 
 extern pd_desc_t pd[1024];              //initialize array of page directory entry structs
 
@@ -27,10 +50,54 @@ extern pt_desc_t vm[1024];              //initialize array of page table entry s
 int VIDEO_PAGE_ADDRESSES[4];
 
 
+/* one cpu's TLB flushes as the vmstat device reads them */
+typedef struct vm_cpu_stat {
+    uint32_t tlb_full;              //CR3 loads
+    uint32_t tlb_page;              //invlpg of a single page
+    uint32_t tlb_kept;              //process switches that kept the loaded directory and its TLB
+} vm_cpu_stat_t;
+
+/* what the vmstat device reads */
+typedef struct vm_stat {
+    uint32_t num_cpus;
+    uint32_t global_pages;          //1 when the kernel pages stay in the TLB across CR3 loads
+    uint32_t frames;                //4KB frames of user memory
+    uint32_t frames_used;
+    uint32_t cow_copies;            //writes to a shared page that copied it
+    uint32_t cow_reuses;            //writes to a page whose other users had gone, made writable in place
+    uint32_t demand_pages;          //heap and mmap pages backed on their first touch
+    vm_cpu_stat_t cpu[MAX_CPUS];
+} vm_stat_t;
+
 /* set up the paging by setting bits for linux registers */
 void page_setup();       
+void page_cpu_init();
 void page_setup_paging();               
 void start_paging();
 void program_paging(uint8_t pid);
+/* per process user space, see page.c */
+void page_dir_create(int32_t pid);
+int32_t page_map_user(int32_t pid, uint32_t address, uint32_t pages);
+void page_release(int32_t pid);
+void page_fork(int32_t parent, int32_t child);
+int32_t page_cow_fault(uint32_t address, uint32_t error);
+void page_heap_init(int32_t pid, uint32_t image_end);
+int32_t page_demand_fault(uint32_t address, uint32_t error);
+/* heap and anonymous mapping system calls */
+int32_t sbrk(int32_t increment);
+int32_t mmap(int32_t length);
+int32_t munmap(void* address, int32_t length);
+uint32_t page_user_pages(int32_t pid);
+int32_t page_user_ok(const void* address, uint32_t len);
+int32_t page_user_str_ok(const uint8_t* s, uint32_t max);
+int32_t page_vidmap_mapped(int32_t pid);
 void vidmap_paging(int8_t** screen_start, int terminal);
+void vidmap_switch(int old_terminal, int new_terminal);
+void mmio_paging(uint32_t address);
+void low_paging(uint32_t address);
+
+void page_init(void);
+int32_t vmstat_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t vmstat_write(int32_t fd, const void* buf, int32_t nbytes);
 
+#endif
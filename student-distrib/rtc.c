@@ -1,6 +1,13 @@
 #include "rtc.h"
+#include "timer.h"
+#include "sched.h"
+#include "lock.h"
 
 int rtcFlag = 0; //interrupt flag
+/* the CMOS index and data ports are a pair, a write to the index must not be split from its data access */
+static spinlock_t rtc_lock;
+/* open rtc files, the interrupt is only unmasked while there is one so an idle system gets no RTC wakeups */
+static int32_t rtc_users = 0;
 
 /* 
  *   rtc_init
@@ -10,6 +17,7 @@ int rtcFlag = 0; //interrupt flag
  *   Return: none
  */
 void rtc_init(){
+    spin_init(&rtc_lock, "rtc");
     enable_irq(2);
 
     outb(0x8B, 0x70);		// select register B, and disable NMI
@@ -22,9 +30,7 @@ void rtc_init(){
     prev = inb(0x71);
     outb(0x8A, 0x70);     
     outb((prev & 0xF0) | 0x06, 0x71); // max (1024)
-    
-
-    enable_irq(8);
+    //irq 8 stays masked until the first rtc_open
 }
 
 
@@ -40,15 +46,19 @@ void rtc_handler(){
     //     test_interrupts();
     // }
     // printf("hello this is working");
+    spin_lock(&rtc_lock);
     outb(0x0C, 0x70);	// select register C
     inb(0x71);		// just throw away contents
+    spin_unlock(&rtc_lock);
     rtcFlag = 1;
+    sched_wake_all();
     send_eoi(8);
 }
 
 /* 
  *   rtc_open
- *   DESCRIPTION: Sets the value of the rtc frequency to the lowest value (2 hz)
+ *   DESCRIPTION: Sets the value of the rtc frequency to the lowest value (2 hz) and unmasks the interrupt for
+ *   the first user
  *   INPUTS: filename -- name of file
  *   OUTPUTS: none
  *   Return: 0
@@ -57,15 +67,51 @@ void rtc_handler(){
 int32_t rtc_open (const uint8_t* filename) {
     char prev;
     char hz_freq = 0x0F;
+    uint32_t flags;
     //set frequency rate to 2 hz
+    spin_lock_irqsave(&rtc_lock, flags);
     outb(0x8A, 0x70);     
     prev = inb(0x71);
     outb(0x8A, 0x70);     
     outb((prev & 0xF0) | hz_freq, 0x71);
+    if(rtc_users++ == 0){
+        enable_irq(8);
+    }
+    spin_unlock_irqrestore(&rtc_lock, flags);
     return 0;
 }
 
+/* 
+ *   rtc_close
+ *   DESCRIPTION: Masks the interrupt again when the last user closes the rtc
+ *   INPUTS: fd -- file descriptor index
+ *   OUTPUTS: none
+ *   Return: 0
+ */
 int32_t rtc_close(int32_t fd) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&rtc_lock, flags);
+    if(rtc_users > 0 && --rtc_users == 0){
+        disable_irq(8);
+    }
+    spin_unlock_irqrestore(&rtc_lock, flags);
+    return 0;
+}
+
+/* 
+ *   rtc_dup
+ *   DESCRIPTION: Counts the copy of an open rtc a forked child gets as another user, each copy is closed
+ *   INPUTS: fd -- file descriptor index
+ *   OUTPUTS: none
+ *   Return: 0
+ */
+int32_t rtc_dup(int32_t fd) {
+    uint32_t flags;
+
+    spin_lock_irqsave(&rtc_lock, flags);
+    rtc_users++;
+    spin_unlock_irqrestore(&rtc_lock, flags);
     return 0;
 }
 
@@ -80,9 +126,15 @@ int32_t rtc_close(int32_t fd) {
  */
 
 int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes) {
-    //block until an interrupt happens
+    uint32_t flags;
+
+    //block until an interrupt happens, other tasks run in between
+    cli_and_save(flags);
 	rtcFlag = 0;
-    while(!rtcFlag) {}
+    while(!rtcFlag) {
+        sched_wait();
+    }
+    restore_flags(flags);
     return 0;
 }
 
@@ -122,16 +174,17 @@ int32_t rtc_change_frequency(int buf){
     // 32768 >> (rate - 1)
     char freq = (32768 - log) & 0x0F; //"Converts" our desired frequency to the char frequency rate 
     char prev;
+    uint32_t flags;
     if(freq == 0x00){
         return -1;
     }else{
-        //update the frequency rate
-        cli();
+        //update the frequency rate, callers can be in interrupt context so the flag is put back as it was
+        spin_lock_irqsave(&rtc_lock, flags);
         outb(0x8A, 0x70);     
         prev = inb(0x71);
         outb(0x8A, 0x70);     
         outb((prev & 0xF0) | freq, 0x71);
-        sti();
+        spin_unlock_irqrestore(&rtc_lock, flags);
         return 0;
     }
 }
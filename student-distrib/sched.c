@@ -0,0 +1,698 @@
+#include "sched.h"
+#include "system_calls.h"
+#include "keyboard.h"
+#include "page.h"
+#include "apic.h"
+#include "timer.h"
+#include "klog.h"
+#include "device.h"
+#include "acct.h"
+
+/*
+ * One task per terminal and one per process started by fork. A task is a stack of processes, of which only
+ * the top one runs: the others are blocked in execute. Each cpu has a queue of the runnable tasks given to it
+ * and takes turns between them every SCHED_SLICE_MS, or whenever the running one waits. A cpu that runs out
+ * of tasks steals one from the cpu with the most waiting, and sits in its idle loop when there is nothing to
+ * steal
+ */
+task_t tasks[NUM_TASKS];
+static uint32_t task_stack[NUM_TERMINALS + 1][TASK_STACK_SIZE / 4];
+
+static const table_pointer_t schedstat_ops = { device_open_none, device_close_none, schedstat_read, schedstat_write };
+
+/*
+ *   rq_push / rq_pop
+ *   DESCRIPTION: Adds a task to the back of the queue of its level on a cpu, takes the one at the front of the
+ *   highest level that has one
+ *   INPUTS: cpu -- whose queue, t -- task not on any queue
+ *   OUTPUTS: rq_pop returns the task, NULL when every level is empty
+ *   SIDE EFFECTS: caller holds the kernel lock with interrupts off
+ */
+static void rq_push(cpu_t* cpu, task_t* t) {
+    t->next = NULL;
+    t->cpu = cpu->id;
+    t->state = TASK_RUNNABLE;
+    if (cpu->rq_tail[t->prio] != NULL) {
+        cpu->rq_tail[t->prio]->next = t;
+    } else {
+        cpu->rq_head[t->prio] = t;
+    }
+    cpu->rq_tail[t->prio] = t;
+    cpu->rq_len++;
+}
+
+static task_t* rq_pop(cpu_t* cpu) {
+    task_t* t = NULL;
+    int32_t level;
+
+    for (level = 0; level < SCHED_LEVELS && t == NULL; level++) {
+        t = cpu->rq_head[level];
+        if (t != NULL) {
+            cpu->rq_head[level] = t->next;
+            if (cpu->rq_head[level] == NULL) {
+                cpu->rq_tail[level] = NULL;
+            }
+            cpu->rq_len--;
+            t->next = NULL;
+        }
+    }
+    return t;
+}
+
+/*
+ *   rq_best
+ *   DESCRIPTION: Highest level a task waits at on a cpu
+ *   INPUTS: cpu -- whose queue
+ *   OUTPUTS: the level, SCHED_LEVELS when nothing waits
+ *   SIDE EFFECTS: none
+ */
+static int32_t rq_best(cpu_t* cpu) {
+    int32_t level;
+
+    for (level = 0; level < SCHED_LEVELS; level++) {
+        if (cpu->rq_head[level] != NULL) {
+            break;
+        }
+    }
+    return level;
+}
+
+/*
+ *   sched_charge
+ *   DESCRIPTION: Checks whether a running task used up its time at its level and drops it one level if so.
+ *   The bottom level keeps its tasks, they take turns there
+ *   INPUTS: t -- task running on some cpu, now -- timer_ticks()
+ *   OUTPUTS: 1 if its time was up, 0 if not
+ *   SIDE EFFECTS: caller holds the kernel lock with interrupts off
+ */
+static int32_t sched_charge(task_t* t, uint32_t now) {
+    if (t->used + (now - t->run_start) < (SCHED_SLICE_MS << t->prio)) {
+        return 0;
+    }
+    if (t->prio < SCHED_LEVELS - 1) {
+        t->prio++;
+    }
+    t->used = 0;
+    t->run_start = now;
+    return 1;
+}
+
+/*
+ *   sched_steal
+ *   DESCRIPTION: Finds work for a cpu whose queue is empty. The victim is the busy cpu with the most tasks
+ *   waiting. Its lowest level goes first, those tasks would wait longest there, and within a level the task
+ *   that has waited longest, the one with the least left in that cpu's cache. Tasks that ran within
+ *   SCHED_CACHE_HOT_MS are skipped, their own cpu gets to them soon enough with their working set still
+ *   cached. A later tick tries again once they have cooled
+ *   INPUTS: thief -- this cpu
+ *   OUTPUTS: 1 if a task was moved onto the thief's queue, 0 if not
+ *   SIDE EFFECTS: caller holds the kernel lock with interrupts off
+ */
+static int32_t sched_steal(cpu_t* thief) {
+    cpu_t* victim = NULL;
+    task_t* prev;
+    task_t* t;
+    uint32_t now = timer_ticks();
+    int32_t i;
+    int32_t level;
+
+    for (i = 0; i < num_cpus; i++) {
+        if (&cpus[i] == thief || cpus[i].current == NULL || cpus[i].rq_len == 0) {
+            continue;
+        }
+        if (victim == NULL || cpus[i].rq_len > victim->rq_len) {
+            victim = &cpus[i];
+        }
+    }
+    if (victim == NULL) {
+        return 0;
+    }
+
+    for (level = SCHED_LEVELS - 1; level >= 0; level--) {
+        prev = NULL;
+        for (t = victim->rq_head[level]; t != NULL; prev = t, t = t->next) {
+            if (now - t->last_ran < SCHED_CACHE_HOT_MS) {
+                continue;
+            }
+            if (prev != NULL) {
+                prev->next = t->next;
+            } else {
+                victim->rq_head[level] = t->next;
+            }
+            if (victim->rq_tail[level] == t) {
+                victim->rq_tail[level] = prev;
+            }
+            victim->rq_len--;
+            victim->stolen++;
+            thief->steals++;
+            t->migrations++;
+            rq_push(thief, t);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ *   sched_kick_idle
+ *   DESCRIPTION: Wakes the idle cpus when some busy cpu has tasks waiting, so they can steal them
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+static void sched_kick_idle(void) {
+    int32_t i;
+
+    if (!sched_need_tick()) {
+        return;
+    }
+    for (i = 0; i < num_cpus; i++) {
+        if (cpus[i].current == NULL && cpus[i].rq_len == 0) {
+            smp_kick(i);
+        }
+    }
+}
+
+/*
+ *   task_load
+ *   DESCRIPTION: Makes a task current on a cpu: its top process gets the cpu's TSS stack and program page
+ *   INPUTS: cpu -- this cpu, t -- task taken off its run queue
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: flushes the TLB
+ */
+static void task_load(cpu_t* cpu, task_t* t) {
+    int32_t pid = t->pid;
+
+    cpu->current = t;
+    cpu->pid = pid;
+    cpu->need_resched = 0;
+    t->state = TASK_RUNNING;
+    t->run_start = timer_ticks();
+    if (pid >= 0) {
+        cpu->tss->esp0 = KSTACK_TOP(pid);
+        program_paging(pid);
+    }
+}
+
+/*
+ *   task_start
+ *   DESCRIPTION: First thing a task runs, switched to by schedule with the kernel lock held and interrupts off.
+ *   Starts the terminal's shell, which does not come back
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+static void task_start(void) {
+    task_t* t = this_cpu()->current;
+
+    sti();
+    execute((const uint8_t*)"shell");
+
+    cli();
+    klog(KLOG_ERR, "sched: no shell for terminal %d", t->terminal);
+    t->state = TASK_EMPTY;
+    schedule();
+}
+
+/*
+ *   task_init
+ *   DESCRIPTION: Sets up a task so that the first sched_switch to it returns into task_start
+ *   INPUTS: t -- task, terminal -- its terminal
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+static void task_init(task_t* t, int32_t terminal) {
+    uint32_t* sp = &task_stack[terminal][TASK_STACK_SIZE / 4];
+
+    t->terminal = terminal;
+    t->pid = -1;
+    *--sp = 0;                          //return address of task_start, which never returns
+    *--sp = (uint32_t)task_start;       //where sched_switch returns to
+    *--sp = 0;                          //ebp
+    *--sp = 0;                          //ebx
+    *--sp = 0;                          //esi
+    *--sp = 0;                          //edi
+    t->esp = (uint32_t)sp;
+}
+
+/*
+ *   sched_init
+ *   DESCRIPTION: Registers the "schedstat" device
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void sched_init(void) {
+    register_device("schedstat", &schedstat_ops);
+}
+
+/*
+ *   sched_start
+ *   DESCRIPTION: Creates the terminals' tasks, spreads them over the cpus that came up and turns the boot
+ *   code into cpu 0's idle loop
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: never returns
+ */
+void sched_start(void) {
+    int32_t i;
+
+    cli();
+    for (i = 1; i <= NUM_TERMINALS; i++) {
+        task_init(&tasks[i], i);
+        rq_push(&cpus[(i - 1) % num_cpus], &tasks[i]);
+    }
+    sched_idle();
+}
+
+/*
+ *   sched_idle
+ *   DESCRIPTION: A cpu's idle loop. Runs its queue until it is empty, then looks for a task to steal every time
+ *   it wakes up. The boot cpu halts through timer_idle, which stops the tick as well
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: called holding the kernel lock once, never returns
+ */
+void sched_idle(void) {
+    cpu_t* cpu = this_cpu();
+
+    for (;;) {
+        cli();
+        if (cpu->rq_len > 0 || sched_steal(cpu)) {
+            schedule();
+        } else if (cpu->id == 0) {
+            timer_idle();
+        } else {
+            cpu_halt();
+        }
+    }
+}
+
+/*
+ *   schedule
+ *   DESCRIPTION: Switches to the first task of the highest level on this cpu's queue. The running task goes to
+ *   the back of its level unless it is waiting. With the queue empty a task is stolen from another cpu, and
+ *   the idle loop runs when there is none. Returns once the caller is switched back to, possibly on another cpu
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller holds the kernel lock exactly once with interrupts off, the lock stays with the cpu
+ */
+void schedule(void) {
+    cpu_t* cpu = this_cpu();
+    task_t* prev = cpu->current;
+    task_t* next;
+    uint32_t* save;
+    uint32_t now = timer_ticks();
+
+    if (prev != NULL) {
+        sched_charge(prev, now);
+        prev->used += now - prev->run_start;
+        prev->run_start = now;
+        if (prev->state == TASK_RUNNING) {
+            rq_push(cpu, prev);
+        }
+    }
+    if (cpu->rq_len == 0) {
+        sched_steal(cpu);
+    }
+    next = rq_pop(cpu);
+    if (next == prev) {
+        cpu->need_resched = 0;
+        if (next != NULL) {
+            next->state = TASK_RUNNING;
+        }
+        return;
+    }
+
+    save = (prev != NULL) ? &prev->esp : &cpu->idle_esp;
+    acct_charge(0);
+    if (prev != NULL) {
+        prev->last_ran = now;
+        acct_switch(prev->state == TASK_RUNNABLE);
+    }
+    cpu->switches++;
+    if (next != NULL) {
+        task_load(cpu, next);
+        sched_switch(save, next->esp);
+    } else {
+        cpu->current = NULL;
+        cpu->pid = -1;
+        sched_switch(save, cpu->idle_esp);
+    }
+}
+
+/*
+ *   sched_wait
+ *   DESCRIPTION: Gives the cpu away until the next sched_wake_all. Callers check what they wait for with
+ *   interrupts off and check again after, since every wakeup wakes every waiter. Kernel code running before
+ *   sched_start just halts
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller has interrupts off
+ */
+void sched_wait(void) {
+    task_t* t = this_cpu()->current;
+
+    if (t == NULL) {
+        timer_idle();
+        return;
+    }
+    t->state = TASK_WAITING;
+    schedule();
+}
+
+/*
+ *   sched_wake_all
+ *   DESCRIPTION: Puts every waiting task back on its cpu's queue, called by whatever a task can be waiting
+ *   for: keyboard input, the RTC and expiring timers. An idle cpu is woken to run it, and a cpu running a
+ *   task of a lower level is told to switch
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller has interrupts off
+ */
+void sched_wake_all(void) {
+    task_t* t;
+    cpu_t* cpu;
+    int32_t i;
+
+    for (i = 1; i < NUM_TASKS; i++) {
+        t = &tasks[i];
+        if (t->state != TASK_WAITING) {
+            continue;
+        }
+        cpu = &cpus[t->cpu];
+        rq_push(cpu, t);
+        if (cpu->current == NULL) {
+            smp_kick(t->cpu);
+        } else if (t->prio < cpu->current->prio) {
+            cpu->need_resched = 1;
+            smp_kick(t->cpu);
+        }
+    }
+    sched_kick_idle();
+}
+
+/*
+ *   sched_preempt
+ *   DESCRIPTION: Switches away from the running task when something set need_resched. Only a task interrupted
+ *   in user mode is switched away from, kernel code always runs until it waits or returns
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: called from an interrupt handler after its EOI
+ */
+void sched_preempt(void) {
+    cpu_t* cpu = this_cpu();
+
+    if (cpu->current != NULL && cpu->need_resched && cpu->bkl_depth == 1) {
+        schedule();
+    }
+}
+
+/*
+ *   sched_reset_levels
+ *   DESCRIPTION: Puts every task back at its base level, requeueing the runnable ones at their new level
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller holds the kernel lock with interrupts off
+ */
+static void sched_reset_levels(void) {
+    task_t* queued[NUM_TASKS];
+    int32_t i, c, n;
+
+    for (c = 0; c < num_cpus; c++) {
+        n = 0;
+        while (cpus[c].rq_len > 0) {
+            queued[n++] = rq_pop(&cpus[c]);
+        }
+        for (i = 0; i < n; i++) {
+            queued[i]->prio = queued[i]->nice;
+            queued[i]->used = 0;
+            rq_push(&cpus[c], queued[i]);
+        }
+    }
+    for (i = 1; i < NUM_TASKS; i++) {
+        if (tasks[i].state != TASK_RUNNABLE) {
+            tasks[i].prio = tasks[i].nice;
+            tasks[i].used = 0;
+            tasks[i].run_start = timer_ticks();
+        }
+    }
+}
+
+/*
+ *   sched_tick
+ *   DESCRIPTION: Called by the boot cpu's tick every SCHED_SLICE_MS. Only the boot cpu gets the timer
+ *   interrupt, so it charges the task running on every cpu, tells the cpus whose task used up its time at
+ *   its level or has a higher one waiting to switch, and the idle ones to look for tasks to steal. Every
+ *   SCHED_RESET_MS all tasks go back to their base level
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: may switch tasks
+ */
+void sched_tick(void) {
+    static uint32_t last_reset;
+    uint32_t now = timer_ticks();
+    task_t* t;
+    int32_t i;
+
+    if (now - last_reset >= SCHED_RESET_MS) {
+        last_reset = now;
+        sched_reset_levels();
+    }
+
+    for (i = 0; i < num_cpus; i++) {
+        t = cpus[i].current;
+        if (t == NULL) {
+            continue;
+        }
+        if ((sched_charge(t, now) && cpus[i].rq_len > 0) || rq_best(&cpus[i]) < t->prio) {
+            cpus[i].need_resched = 1;
+            smp_kick(i);
+        }
+    }
+    sched_kick_idle();
+    sched_preempt();
+}
+
+/*
+ *   sched_boost
+ *   DESCRIPTION: Called by a task about to wait for terminal input. It goes back to its base level, so it
+ *   preempts the cpu hogs as soon as a key wakes it
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller has interrupts off
+ */
+void sched_boost(void) {
+    task_t* t = this_cpu()->current;
+
+    if (t != NULL) {
+        t->prio = t->nice;
+        t->used = 0;
+        t->run_start = timer_ticks();
+    }
+}
+
+/*
+ *   sched_renice
+ *   DESCRIPTION: Sets the base level of the running task, when its top process changes or asks for it
+ *   INPUTS: nice -- 0 to SCHED_LEVELS - 1
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void sched_renice(int32_t nice) {
+    task_t* t = this_cpu()->current;
+    uint32_t flags;
+
+    if (t == NULL) {
+        return;
+    }
+    cli_and_save(flags);
+    t->nice = nice;
+    t->prio = nice;
+    t->used = 0;
+    t->run_start = timer_ticks();
+    if (rq_best(this_cpu()) < nice) {
+        this_cpu()->need_resched = 1;
+    }
+    restore_flags(flags);
+}
+
+/*
+ *   sched_fork
+ *   DESCRIPTION: Gives a process started by fork a task of its own, queued on this cpu behind its parent's at
+ *   the parent's base level. It counts as cold, so an idle cpu can steal it right away
+ *   INPUTS: pid -- the new process, esp -- its kernel stack, set up so the first sched_switch to it returns
+ *   into its entry
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void sched_fork(int32_t pid, uint32_t esp) {
+    task_t* parent = this_cpu()->current;
+    task_t* t = &tasks[FORK_TASK(pid)];
+    uint32_t flags;
+
+    cli_and_save(flags);
+    memset(t, 0, sizeof(*t));
+    t->terminal = parent->terminal;
+    t->pid = pid;
+    t->esp = esp;
+    t->nice = parent->nice;
+    t->prio = parent->nice;
+    t->run_start = timer_ticks();
+    t->last_ran = t->run_start - SCHED_CACHE_HOT_MS;
+    rq_push(this_cpu(), t);
+    sched_kick_idle();
+    restore_flags(flags);
+}
+
+/*
+ *   sched_exit
+ *   DESCRIPTION: Ends the running task, once halt has let go of the last process of a task fork started
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller holds the kernel lock exactly once with interrupts off, never returns
+ */
+void sched_exit(void) {
+    task_t* t = this_cpu()->current;
+
+    t->state = TASK_EMPTY;
+    t->pid = -1;
+    schedule();
+}
+
+/*
+ *   sched_task_of
+ *   DESCRIPTION: Finds the task a process is the top of
+ *   INPUTS: pid -- the process
+ *   OUTPUTS: the task, NULL if the process is blocked under a child or not running at all
+ *   SIDE EFFECTS: none
+ */
+task_t* sched_task_of(int32_t pid) {
+    int32_t i;
+
+    for (i = 1; i < NUM_TASKS; i++) {
+        if (tasks[i].state != TASK_EMPTY && tasks[i].pid == pid) {
+            return &tasks[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ *   nice
+ *   DESCRIPTION: Moves the calling process's base level by inc, clamped to the levels there are. Programs it
+ *   executes start at its level
+ *   INPUTS: inc -- levels to go down, negative to go up
+ *   OUTPUTS: the new level
+ *   SIDE EFFECTS: none
+ */
+int32_t nice(int32_t inc) {
+    pcb_t* pcb;
+    int32_t level;
+
+    if (this_cpu()->pid < 0) {
+        return -1;
+    }
+    pcb = PCB_ADDR(this_cpu()->pid);
+    level = pcb->nice + inc;
+    if (level < 0) {
+        level = 0;
+    }
+    if (level > SCHED_LEVELS - 1) {
+        level = SCHED_LEVELS - 1;
+    }
+    pcb->nice = level;
+    sched_renice(level);
+    return level;
+}
+
+/*
+ *   sched_ipi
+ *   DESCRIPTION: IPI_RESCHED_VECTOR handler. A cpu running a task ends its slice, an idle one just wakes up
+ *   and finds its queue
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: may switch tasks
+ */
+void sched_ipi(void) {
+    apic_eoi();
+    sched_preempt();
+}
+
+/*
+ *   sched_need_tick
+ *   DESCRIPTION: Whether some cpu has tasks taking turns, which the boot cpu's tick has to keep going for
+ *   INPUTS: none
+ *   OUTPUTS: 1 if so, 0 if not
+ *   SIDE EFFECTS: none
+ */
+int32_t sched_need_tick(void) {
+    int32_t i;
+
+    for (i = 0; i < num_cpus; i++) {
+        if (cpus[i].current != NULL && cpus[i].rq_len > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ *   schedstat_read
+ *   DESCRIPTION: Reads a sched_stat_t snapshot of every cpu's queue and counters and every terminal task's
+ *   placement and migrations, like a regular file
+ *   INPUTS: fd -- file descriptor, buf -- destination, nbytes -- size of buf
+ *   OUTPUTS: number of bytes copied, 0 at the end
+ *   SIDE EFFECTS: advances the file position
+ */
+int32_t schedstat_read(int32_t fd, void* buf, int32_t nbytes) {
+    static sched_stat_t snap;
+    uint32_t flags;
+    int32_t i;
+
+    cli_and_save(flags);
+    memset(&snap, 0, sizeof(snap));
+    snap.num_cpus = num_cpus;
+    for (i = 0; i < num_cpus; i++) {
+        snap.cpu[i].online = cpus[i].online;
+        snap.cpu[i].running = (cpus[i].current != NULL) ? cpus[i].current->terminal : 0;
+        snap.cpu[i].queued = cpus[i].rq_len;
+        snap.cpu[i].switches = cpus[i].switches;
+        snap.cpu[i].steals = cpus[i].steals;
+        snap.cpu[i].stolen = cpus[i].stolen;
+    }
+    for (i = 0; i < NUM_TERMINALS; i++) {
+        snap.task[i].cpu = tasks[i + 1].cpu;
+        snap.task[i].state = tasks[i + 1].state;
+        snap.task[i].migrations = tasks[i + 1].migrations;
+        snap.task[i].prio = tasks[i + 1].prio;
+        snap.task[i].nice = tasks[i + 1].nice;
+    }
+    restore_flags(flags);
+
+    return device_read_snapshot(fd, &snap, sizeof(snap), buf, nbytes);
+}
+
+/*
+ *   schedstat_write
+ *   DESCRIPTION: Any write clears the switch, steal and migration counters
+ *   INPUTS: ignored
+ *   OUTPUTS: nbytes
+ *   SIDE EFFECTS: none
+ */
+int32_t schedstat_write(int32_t fd, const void* buf, int32_t nbytes) {
+    uint32_t flags;
+    int32_t i;
+
+    cli_and_save(flags);
+    for (i = 0; i < num_cpus; i++) {
+        cpus[i].switches = 0;
+        cpus[i].steals = 0;
+        cpus[i].stolen = 0;
+    }
+    for (i = 1; i <= NUM_TERMINALS; i++) {
+        tasks[i].migrations = 0;
+    }
+    restore_flags(flags);
+    return nbytes;
+}
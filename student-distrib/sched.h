@@ -0,0 +1,97 @@
+#ifndef _X_SCHED_H
+#define _X_SCHED_H
+
+#include "types.h"
+#include "smp.h"
+#include "lib.h"
+#include "system_calls.h"
+
+/*
+ * Multi level feedback queue. A task runs SCHED_SLICE_MS << level at its level before dropping one level, so
+ * the cpu hogs sink while tasks that wait for the keyboard stay on top and preempt them when they wake. A
+ * task waiting for terminal input goes back to its base level, and every SCHED_RESET_MS all of them do so a
+ * task that sank cannot starve. The base level is the nice value of the task's top process
+ */
+#define SCHED_SLICE_MS      10
+#define SCHED_RESET_MS      1000
+/* a task that ran this recently still has its working set in its cpu's cache and is not stolen */
+#define SCHED_CACHE_HOT_MS  5
+/* stack a task starts on, until execute moves it onto its first process's kernel stack */
+#define TASK_STACK_SIZE     4096
+/* one task per terminal, 1 to NUM_TERMINALS, then one for each process fork can start */
+#define NUM_TASKS           (NUM_TERMINALS + 1 + MAX_PROCESSES)
+#define FORK_TASK(pid)      (NUM_TERMINALS + 1 + (pid))
+
+#define TASK_EMPTY          0
+#define TASK_RUNNABLE       1       //on a run queue
+#define TASK_RUNNING        2       //current on its cpu
+#define TASK_WAITING        3       //in sched_wait until the next sched_wake_all
+
+/* a chain of processes, only its top process ever runs. A terminal's starts with its shell, a forked one with the child */
+typedef struct task {
+    int32_t terminal;
+    int32_t pid;                    //top process of the chain, -1 before the first execute
+    int32_t state;
+    int32_t cpu;                    //cpu whose run queue it is on
+    uint32_t esp;                   //saved kernel stack pointer while switched out
+    struct task* next;              //run queue link
+    uint32_t last_ran;              //tick it was last switched away from
+    uint32_t migrations;            //times it was moved to another cpu
+    int32_t prio;                   //level it is queued at, 0 to SCHED_LEVELS - 1
+    int32_t nice;                   //level it goes back to when boosted
+    uint32_t used;                  //ms run at its level before the current turn
+    uint32_t run_start;             //tick its current turn started
+} task_t;
+
+/* what the schedstat device reads */
+typedef struct sched_cpu_stat {
+    uint32_t online;
+    uint32_t running;               //terminal of the task running now, 0 when idle
+    uint32_t queued;                //runnable tasks waiting for the cpu
+    uint32_t switches;
+    uint32_t steals;
+    uint32_t stolen;
+} sched_cpu_stat_t;
+
+typedef struct sched_task_stat {
+    uint32_t cpu;                   //cpu it runs or waits on
+    uint32_t state;
+    uint32_t migrations;
+    uint32_t prio;
+    uint32_t nice;
+} sched_task_stat_t;
+
+typedef struct sched_stat {
+    uint32_t num_cpus;
+    sched_cpu_stat_t cpu[MAX_CPUS];
+    sched_task_stat_t task[NUM_TERMINALS];
+} sched_stat_t;
+
+extern task_t tasks[NUM_TASKS];
+
+void sched_init(void);
+void sched_start(void);
+void sched_idle(void);
+void schedule(void);
+void sched_wait(void);
+void sched_wake_all(void);
+void sched_tick(void);
+void sched_preempt(void);
+void sched_boost(void);
+void sched_renice(int32_t nice);
+void sched_fork(int32_t pid, uint32_t esp);
+void sched_exit(void);
+task_t* sched_task_of(int32_t pid);
+void sched_ipi(void);
+int32_t sched_need_tick(void);
+
+/* nice system call */
+int32_t nice(int32_t inc);
+
+int32_t schedstat_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t schedstat_write(int32_t fd, const void* buf, int32_t nbytes);
+
+/* in system_calls_asm.S, saves the callee saved registers and esp into *save and resumes the stack at esp */
+void sched_switch(uint32_t* save, uint32_t esp);
+
+#endif
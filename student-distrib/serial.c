@@ -0,0 +1,118 @@
+#include "serial.h"
+#include "klog.h"
+
+/* set once serial_init found a UART */
+static int serial_present = 0;
+
+/* bytes queued for the UART, writers add at tx_head and the interrupt takes from tx_tail */
+static uint8_t tx_ring[SERIAL_TX_SIZE];
+static uint32_t tx_head = 0;
+static uint32_t tx_tail = 0;
+
+/* 
+ *   serial_init
+ *   DESCRIPTION: Sets COM1 to 115200 8N1 with FIFOs, checks with a loopback byte that there is a UART at all and
+ *   enables its interrupt
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   Return: 0 if the UART is there, -1 if not
+ */
+int32_t serial_init(void){
+    outb(0x00, COM1_PORT + UART_IER);                   //no interrupts while we set it up
+    outb(UART_LCR_DLAB, COM1_PORT + UART_LCR);
+    outb(SERIAL_BAUD_DIVISOR & 0xFF, COM1_PORT + UART_DATA);
+    outb((SERIAL_BAUD_DIVISOR >> 8) & 0xFF, COM1_PORT + UART_IER);
+    outb(UART_LCR_8N1, COM1_PORT + UART_LCR);
+    outb(UART_FCR_ENABLE, COM1_PORT + UART_FCR);
+
+    //a byte sent in loopback mode has to come back, otherwise nothing is on the port
+    outb(UART_MCR_LOOPBACK, COM1_PORT + UART_MCR);
+    outb(0xAE, COM1_PORT + UART_DATA);
+    if((inb(COM1_PORT + UART_DATA) & 0xFF) != 0xAE){
+        klog(KLOG_INFO, "serial: no UART on COM1");
+        return -1;
+    }
+    outb(UART_MCR_NORMAL, COM1_PORT + UART_MCR);
+
+    serial_present = 1;
+    enable_irq(COM1_IRQ);
+    klog(KLOG_INFO, "serial: COM1 at %u baud", 115200 / SERIAL_BAUD_DIVISOR);
+    return 0;
+}
+
+/* 
+ *   serial_fill_fifo
+ *   DESCRIPTION: Moves up to a FIFO's worth of queued bytes to the UART if its transmit FIFO is empty. Called with
+ *   interrupts off
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   Return: none
+ */
+static void serial_fill_fifo(void){
+    int32_t i;
+
+    if(!(inb(COM1_PORT + UART_LSR) & UART_LSR_THRE)){
+        return;
+    }
+    for(i = 0; i < SERIAL_FIFO_DEPTH && tx_tail != tx_head; i++){
+        outb(tx_ring[tx_tail & (SERIAL_TX_SIZE - 1)], COM1_PORT + UART_DATA);
+        tx_tail++;
+    }
+}
+
+/* 
+ *   serial_write
+ *   DESCRIPTION: Console sink, queues bytes for COM1 and lets the transmit interrupt send them. '\n' goes out as
+ *   "\r\n" and '\0' is skipped like on screen. When the queue is full we wait for the UART instead of dropping
+ *   output, so logs stay complete
+ *   INPUTS: buf -- bytes to send, n -- number of bytes
+ *   OUTPUTS: none
+ *   Return: none
+ */
+void serial_write(const uint8_t* buf, int32_t n){
+    uint32_t flags;
+    int32_t i;
+    uint8_t c;
+
+    if(!serial_present){
+        return;
+    }
+    cli_and_save(flags);
+    for(i = 0; i < n; i++){
+        c = buf[i];
+        if(c == '\0'){
+            continue;
+        }
+        //room for the byte and the '\r' that may go in front of it
+        while(tx_head - tx_tail > SERIAL_TX_SIZE - 2){
+            serial_fill_fifo();
+        }
+        if(c == '\n'){
+            tx_ring[tx_head & (SERIAL_TX_SIZE - 1)] = '\r';
+            tx_head++;
+        }
+        tx_ring[tx_head & (SERIAL_TX_SIZE - 1)] = c;
+        tx_head++;
+    }
+    //start sending now, the interrupt takes over once the FIFO runs empty
+    serial_fill_fifo();
+    outb(tx_tail != tx_head ? UART_IER_THRE : 0x00, COM1_PORT + UART_IER);
+    restore_flags(flags);
+}
+
+/* 
+ *   serial_handler
+ *   DESCRIPTION: COM1 interrupt. The transmit FIFO ran empty, refill it and stop the interrupt once the queue is
+ *   empty
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   Return: none
+ */
+void serial_handler(){
+    inb(COM1_PORT + UART_FCR);      //reading the identification register acknowledges the interrupt
+    serial_fill_fifo();
+    if(tx_tail == tx_head){
+        outb(0x00, COM1_PORT + UART_IER);
+    }
+    send_eoi(COM1_IRQ);
+}
@@ -0,0 +1,39 @@
+#ifndef _X_SERIAL_H
+#define _X_SERIAL_H
+
+#include "types.h"
+#include "lib.h"
+#include "i8259.h"
+
+/* COM1 16550 UART */
+#define COM1_PORT           0x3F8
+#define COM1_IRQ            4
+
+/* register offsets from the base port */
+#define UART_DATA           0   //THR on write, RBR on read, divisor low byte while DLAB is set
+#define UART_IER            1   //interrupt enable, divisor high byte while DLAB is set
+#define UART_FCR            2   //FIFO control on write, interrupt identification on read
+#define UART_LCR            3   //line control
+#define UART_MCR            4   //modem control
+#define UART_LSR            5   //line status
+#define UART_SCRATCH        7
+
+#define UART_LCR_DLAB       0x80
+#define UART_LCR_8N1        0x03
+#define UART_FCR_ENABLE     0xC7    //enable and clear both FIFOs, 14 byte receive trigger
+#define UART_MCR_LOOPBACK   0x1E
+#define UART_MCR_NORMAL     0x0B    //DTR, RTS and OUT2, OUT2 routes the interrupt to the PIC
+#define UART_IER_THRE       0x02    //interrupt when the transmit FIFO is empty
+#define UART_LSR_THRE       0x20
+
+/* divisor of the 115200 baud base clock, 1 is the fastest rate */
+#define SERIAL_BAUD_DIVISOR 1
+/* bytes the transmit FIFO takes once it is empty */
+#define SERIAL_FIFO_DEPTH   16
+/* bytes waiting for the UART, must be a power of two */
+#define SERIAL_TX_SIZE      4096
+
+int32_t serial_init(void);
+void serial_write(const uint8_t* buf, int32_t n);
+
+#endif
@@ -0,0 +1,310 @@
+#include "smp.h"
+#include "apic.h"
+#include "page.h"
+#include "lib.h"
+#include "klog.h"
+#include "clock.h"
+#include "sysenter.h"
+#include "sched.h"
+#include "lock.h"
+#include "acct.h"
+
+/* the boot cpu is cpu 0, it holds the kernel lock from the start and keeps the TSS and directory it booted with */
+cpu_t cpus[MAX_CPUS] = {
+    [0] = { .id = 0, .online = 1, .pid = -1, .bkl_depth = 1, .tss = &tss, .pd = pd },
+};
+int32_t num_cpus = 1;
+
+/* the other cpus' TSSs and idle stacks */
+static tss_t cpu_tss[MAX_CPUS - 1];
+static uint8_t ap_stack[MAX_CPUS - 1][AP_STACK_SIZE] __attribute__((aligned(16)));
+
+/* cpu being started, ap_main picks its entry up from here */
+static cpu_t* volatile ap_booting;
+
+/*
+ * Big kernel lock. Held by whichever cpu is running kernel code, so everything the kernel was written to do on
+ * one cpu stays as it was. User code runs in parallel, and a cpu drops the lock while it halts. The boot cpu
+ * holds it from the start
+ */
+static spinlock_t bkl = SPINLOCK_HELD;
+
+/* counts smp_tlb_flush calls, each cpu notes in tlb_seen the last one it flushed for */
+static volatile uint32_t tlb_flush_gen;
+
+static void ap_main(void);
+
+/*
+ *   bkl_acquire / bkl_release
+ *   DESCRIPTION: Takes and drops the big kernel lock, a ticket lock so the cpus waiting for it get it in turn.
+ *   A cpu spinning for it cannot take the TLB IPI, so smp_tlb_flush does not wait for it, and it flushes
+ *   here instead once it has the lock
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller has interrupts off
+ */
+void bkl_acquire(void) {
+    cpu_t* cpu = this_cpu();
+
+    cpu->bkl_waiting = 1;
+    ticket_lock(&bkl);
+    cpu->bkl_waiting = 0;
+    if (cpu->tlb_seen != tlb_flush_gen) {
+        cpu->tlb_seen = tlb_flush_gen;
+        page_setup_paging();
+    }
+}
+
+void bkl_release(void) {
+    ticket_unlock(&bkl);
+}
+
+/*
+ *   kernel_enter / kernel_exit
+ *   DESCRIPTION: Bracket every way into the kernel: interrupts, exceptions and system calls. The outermost
+ *   entry on a cpu takes the big kernel lock and the matching exit drops it. Anything that leaves for user
+ *   mode without returning through its entry (execute) calls kernel_exit itself first
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: may spin until another cpu leaves the kernel
+ */
+void kernel_enter(void) {
+    uint32_t flags;
+    cpu_t* cpu;
+
+    cli_and_save(flags);
+    cpu = this_cpu();
+    if (cpu->bkl_depth++ == 0) {
+        bkl_acquire();
+        acct_charge(1);
+    }
+    restore_flags(flags);
+}
+
+void kernel_exit(void) {
+    uint32_t flags;
+    cpu_t* cpu;
+
+    cli_and_save(flags);
+    cpu = this_cpu();
+    if (cpu->bkl_depth == 1) {
+        acct_charge(0);
+    }
+    if (--cpu->bkl_depth == 0) {
+        bkl_release();
+    }
+    restore_flags(flags);
+}
+
+/*
+ *   cpu_halt
+ *   DESCRIPTION: Halts until the next interrupt with the kernel lock dropped, so the other cpus can use the
+ *   kernel meanwhile. sti only takes effect after the hlt, an interrupt in between cannot be missed
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller has interrupts off and holds the lock once, returns the same way
+ */
+void cpu_halt(void) {
+    cpu_t* cpu = this_cpu();
+    int32_t depth = cpu->bkl_depth;
+
+    cpu->bkl_depth = 0;
+    bkl_release();
+    asm volatile ("sti; hlt; cli" : : : "memory");
+    bkl_acquire();
+    cpu->bkl_depth = depth;
+}
+
+/*
+ *   smp_kick
+ *   DESCRIPTION: Makes another cpu look at its run queue, which also wakes it out of hlt
+ *   INPUTS: cpu -- index into cpus
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void smp_kick(int32_t cpu) {
+    if (cpu == this_cpu()->id || !cpus[cpu].online || !apic_enabled) {
+        return;
+    }
+    lapic_send_ipi(cpus[cpu].apic_id, IPI_RESCHED_VECTOR);
+}
+
+/*
+ *   smp_tlb_flush
+ *   DESCRIPTION: Makes the other cpus drop their TLBs after a shared page table changed, and waits until each
+ *   one has, so none of them still writes through the old translation once this returns. A cpu spinning on
+ *   the kernel lock has interrupts off and cannot answer while this cpu holds it. It is not waited for,
+ *   bkl_acquire flushes before it runs anything
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: the caller flushes its own TLB, holds the kernel lock
+ */
+void smp_tlb_flush(void) {
+    cpu_t* self = this_cpu();
+    uint32_t gen;
+    int32_t i;
+
+    if (num_cpus < 2) {
+        return;
+    }
+    gen = ++tlb_flush_gen;
+    self->tlb_seen = gen;
+    lapic_send_others(IPI_TLB_VECTOR);
+    for (i = 0; i < num_cpus; i++) {
+        if (&cpus[i] == self || !cpus[i].online) {
+            continue;
+        }
+        while (cpus[i].tlb_seen != gen && !cpus[i].bkl_waiting) {
+            asm volatile ("pause");
+        }
+    }
+}
+
+/*
+ *   smp_tlb_ipi
+ *   DESCRIPTION: IPI_TLB_VECTOR handler, reloads cr3 and tells smp_tlb_flush it did. Runs without the kernel
+ *   lock
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void smp_tlb_ipi(void) {
+    cpu_t* cpu = this_cpu();
+    uint32_t gen = tlb_flush_gen;
+
+    page_setup_paging();
+    cpu->tlb_seen = gen;
+    apic_eoi();
+}
+
+/*
+ *   smp_delay_us
+ *   DESCRIPTION: Busy waits on the TSC clock
+ *   INPUTS: us -- microseconds
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+static void smp_delay_us(uint32_t us) {
+    uint64_t end = clock_ns() + (uint64_t)us * 1000;
+
+    while (clock_ns() < end) {
+        asm volatile ("pause");
+    }
+}
+
+/*
+ *   cpu_setup
+ *   DESCRIPTION: Gives a cpu its TSS, with a descriptor in its GDT slot. It starts on the boot page directory
+ *   and moves to each process's own as it runs them
+ *   INPUTS: cpu -- entry in cpus, id and apic_id filled in
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+static void cpu_setup(cpu_t* cpu) {
+    seg_desc_t the_tss_desc;
+
+    cpu->tss = &cpu_tss[cpu->id - 1];
+    cpu->pd = pd;
+    cpu->pid = -1;
+
+    the_tss_desc.granularity   = 0x0;
+    the_tss_desc.opsize        = 0x0;
+    the_tss_desc.reserved      = 0x0;
+    the_tss_desc.avail         = 0x0;
+    the_tss_desc.seg_lim_19_16 = TSS_SIZE & 0x000F0000;
+    the_tss_desc.present       = 0x1;
+    the_tss_desc.dpl           = 0x0;
+    the_tss_desc.sys           = 0x0;
+    the_tss_desc.type          = 0x9;
+    the_tss_desc.seg_lim_15_00 = TSS_SIZE & 0x0000FFFF;
+
+    SET_TSS_PARAMS(the_tss_desc, cpu->tss, tss_size);
+    cpu_tss_desc_ptr[cpu->id - 1] = the_tss_desc;
+
+    cpu->tss->ldt_segment_selector = KERNEL_LDT;
+    cpu->tss->ss0 = KERNEL_DS;
+    cpu->tss->esp0 = (uint32_t)&ap_stack[cpu->id - 1][AP_STACK_SIZE];
+}
+
+/*
+ *   smp_init
+ *   DESCRIPTION: Starts the application processors the MP table lists with INIT, STARTUP, STARTUP. They come
+ *   up one at a time through the real mode trampoline, which is copied to AP_TRAMPOLINE and told the GDT,
+ *   page directory, stack and C entry of the cpu being started. A cpu that does not answer is left alone
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: the started cpus wait for the kernel lock, which this cpu holds until it goes idle
+ */
+void smp_init(void) {
+    uint8_t* tramp = (uint8_t*)AP_TRAMPOLINE;
+    cpu_t* cpu;
+    uint64_t deadline;
+    int32_t i;
+
+    //its hold time counts from here, nothing could contend for it during boot
+    bkl.held_at = rdtsc();
+    lock_register(&bkl.stat, "kernel");
+    if (!apic_enabled || apic_num_cpus < 2) {
+        klog(KLOG_INFO, "smp: 1 cpu");
+        return;
+    }
+
+    low_paging(AP_TRAMPOLINE);
+    memcpy(tramp, ap_trampoline, ap_trampoline_end - ap_trampoline);
+    memcpy(tramp + (ap_tramp_gdt - ap_trampoline), &gdt_desc, 6);
+    *(uint32_t*)(tramp + ((uint8_t*)&ap_tramp_entry - ap_trampoline)) = (uint32_t)ap_main;
+
+    for (i = 1; i < apic_num_cpus; i++) {
+        cpu = &cpus[num_cpus];
+        cpu->id = num_cpus;
+        cpu->apic_id = apic_cpu_ids[i];
+        cpu_setup(cpu);
+
+        *(uint32_t*)(tramp + ((uint8_t*)&ap_tramp_cr3 - ap_trampoline)) = (uint32_t)cpu->pd;
+        *(uint32_t*)(tramp + ((uint8_t*)&ap_tramp_esp - ap_trampoline)) = (uint32_t)&ap_stack[cpu->id - 1][AP_STACK_SIZE];
+        ap_booting = cpu;
+
+        lapic_send_init(cpu->apic_id);
+        smp_delay_us(AP_INIT_DELAY_US);
+        lapic_send_startup(cpu->apic_id, AP_TRAMPOLINE >> 12);
+        smp_delay_us(AP_SIPI_DELAY_US);
+        if (!cpu->online) {
+            lapic_send_startup(cpu->apic_id, AP_TRAMPOLINE >> 12);
+        }
+        deadline = clock_ns() + (uint64_t)AP_BOOT_TIMEOUT_US * 1000;
+        while (!cpu->online && clock_ns() < deadline) {
+            asm volatile ("pause");
+        }
+        if (!cpu->online) {
+            klog(KLOG_WARN, "smp: cpu with APIC id %u did not start", cpu->apic_id);
+            continue;
+        }
+        num_cpus++;
+    }
+    klog(KLOG_INFO, "smp: %d cpus online", num_cpus);
+}
+
+/*
+ *   ap_main
+ *   DESCRIPTION: C entry of an application processor, called by the trampoline on its idle stack with paging
+ *   on. Loads the shared IDT, the boot cpu's CR4 bits, its own TSS, the LDT, its local APIC and sysenter MSRs, then waits for the
+ *   kernel lock and runs its run queue
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: never returns
+ */
+static void ap_main(void) {
+    cpu_t* cpu = ap_booting;
+
+    asm volatile ("lidt idt_desc_ptr" : : : "memory");
+    page_cpu_init();
+    ltr(CPU_TSS_BASE + ((cpu->id - 1) << 3));
+    lldt(KERNEL_LDT);
+    lapic_cpu_init();
+    sysenter_cpu_init();
+
+    cpu->online = 1;
+    bkl_acquire();
+    cpu->bkl_depth = 1;
+    sched_idle();
+}
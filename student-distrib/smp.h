@@ -0,0 +1,98 @@
+#ifndef _X_SMP_H
+#define _X_SMP_H
+
+#include "x86_desc.h"
+
+/* the application processors start in real mode at this page, copied there from smp_asm.S */
+#define AP_TRAMPOLINE       0x8000
+/* stack each application processor runs its idle loop on */
+#define AP_STACK_SIZE       4096
+/* how long the INIT and the STARTUP IPIs are given, and how long a cpu has to come up */
+#define AP_INIT_DELAY_US    10000
+#define AP_SIPI_DELAY_US    200
+#define AP_BOOT_TIMEOUT_US  100000
+
+/* priority levels of a run queue, 0 runs first. See sched.h */
+#define SCHED_LEVELS        4
+/* spinlocks a cpu keeps track of holding at once, see lock.c */
+#define CPU_HELD_LOCKS      8
+
+#ifndef ASM
+
+struct task;
+struct spinlock;
+
+/* everything the kernel used to keep in globals for the one cpu it ran on */
+typedef struct cpu {
+    int32_t id;                     //index into cpus
+    uint32_t apic_id;
+    volatile int32_t online;
+    int32_t pid;                    //process running here, -1 when none
+    struct task* current;           //task running here, NULL in the idle loop
+    struct task* rq_head[SCHED_LEVELS];     //runnable tasks waiting for this cpu, one queue per priority
+    struct task* rq_tail[SCHED_LEVELS];
+    int32_t rq_len;                 //tasks on all of them
+    volatile int32_t need_resched;  //a task that should run before the current one is waiting
+    uint32_t idle_esp;              //saved stack pointer of the idle loop while a task runs
+    int32_t bkl_depth;              //kernel entries nested on this cpu, the lock is held while non zero
+    struct spinlock* held[CPU_HELD_LOCKS];  //spinlocks taken here and not dropped yet, innermost last
+    int32_t num_held;
+    uint32_t switches;              //task switches, to and from the idle loop included
+    uint32_t steals;                //tasks taken from another cpu's queue
+    uint32_t stolen;                //tasks another cpu took from this one's queue
+    uint64_t acct_tsc;              //rdtsc at the last user/kernel boundary or process change, see acct.c
+    tss_t* tss;
+    pd_desc_t* pd;                  //directory loaded, pd or the one of the last process run here
+    uint32_t pd_gen;                //generation of that directory when it was loaded, see page.c
+    uint32_t tlb_full;              //CR3 loads, each drops every TLB entry that is not global
+    uint32_t tlb_page;              //single pages dropped with invlpg
+    uint32_t tlb_kept;              //process switches that found its directory still loaded
+    volatile uint32_t tlb_seen;     //last smp_tlb_flush this cpu has flushed for
+    volatile int32_t bkl_waiting;   //spinning for the kernel lock with interrupts off
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+extern int32_t num_cpus;
+
+/*
+ *   this_cpu
+ *   DESCRIPTION: Finds the cpu running this from its task register, each cpu loaded its own TSS selector
+ *   INPUTS: none
+ *   OUTPUTS: the cpu's entry in cpus
+ *   SIDE EFFECTS: none
+ */
+static inline cpu_t* this_cpu(void) {
+    uint16_t sel;
+
+    asm volatile ("str %0" : "=r"(sel));
+    if (sel < CPU_TSS_BASE) {
+        return &cpus[0];
+    }
+    return &cpus[((sel - CPU_TSS_BASE) >> 3) + 1];
+}
+
+void smp_init(void);
+void kernel_enter(void);
+void kernel_exit(void);
+void bkl_release(void);
+void bkl_acquire(void);
+void cpu_halt(void);
+void smp_kick(int32_t cpu);
+void smp_tlb_flush(void);
+void smp_tlb_ipi(void);
+
+/* IPI handlers in idt_handler.S */
+void ipi_tlb_asm(void);
+void ipi_resched_asm(void);
+
+/* real mode entry of the application processors, in smp_asm.S */
+extern uint8_t ap_trampoline[];
+extern uint8_t ap_trampoline_end[];
+extern uint8_t ap_tramp_gdt[];
+extern uint32_t ap_tramp_cr3;
+extern uint32_t ap_tramp_esp;
+extern uint32_t ap_tramp_entry;
+
+#endif
+
+#endif
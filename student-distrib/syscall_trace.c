@@ -0,0 +1,183 @@
+#include "syscall_trace.h"
+#include "device.h"
+#include "lib.h"
+#include "smp.h"
+
+/* per process ring of the most recent system calls, indexed by pid */
+static syscall_record_t trace_ring[MAX_PROCESSES][SYSCALL_RING_SIZE];
+/* total number of records written to each ring since the process started */
+static uint32_t trace_head[MAX_PROCESSES];
+/* counters and latency histograms per system call number */
+static syscall_stats_t syscall_stats[NUM_SYSCALLS];
+
+static const table_pointer_t strace_ops = { device_open_none, device_close_none, strace_read, strace_write };
+static const table_pointer_t sysstat_ops = { device_open_none, device_close_none, sysstat_read, sysstat_write };
+
+/* 
+ *   syscall_trace_init()
+ *   DESCRIPTION: Clears all counters and rings and registers the "strace" and "sysstat" devices
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: two new names can be opened
+ */
+void syscall_trace_init() {
+    memset(trace_head, 0, sizeof(trace_head));
+    memset(syscall_stats, 0, sizeof(syscall_stats));
+    register_device("strace", &strace_ops);
+    register_device("sysstat", &sysstat_ops);
+}
+
+/* 
+ *   syscall_trace_reset(int pid)
+ *   DESCRIPTION: Empties the ring of a pid, called when execute hands the pid to a new program
+ *   INPUTS: pid
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void syscall_trace_reset(int pid) {
+    if (pid < 0 || pid >= MAX_PROCESSES) { return; }
+    trace_head[pid] = 0;
+}
+
+/* 
+ *   syscall_trace_record(...)
+ *   DESCRIPTION: Called by syscall_dispatch after every system call. Bumps the counters of the call,
+ *   adds the latency to its log2 histogram and appends an entry to the calling process's ring
+ *   INPUTS: pid of the caller, system call number, the three arguments, return value and cycles taken
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void syscall_trace_record(int pid, uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3, int32_t ret, uint64_t cycles) {
+    uint32_t flags;
+    uint32_t cyc;
+    uint32_t bucket;
+    syscall_stats_t* stats;
+    syscall_record_t* rec;
+
+    if (num < 1 || num > NUM_SYSCALLS) { return; }
+
+    /* clamp to 32 bits, only execute of a long running program gets anywhere near that */
+    cyc = (cycles >> 32) ? 0xFFFFFFFF : (uint32_t)cycles;
+    bucket = 0;
+    if (cyc != 0) {
+        asm ("bsrl %1, %0" : "=r"(bucket) : "r"(cyc));
+    }
+
+    /* keyboard interrupts can start a shell in the middle of a call, keep the update atomic */
+    cli_and_save(flags);
+
+    stats = &syscall_stats[num - 1];
+    stats->count++;
+    if (ret < 0) {
+        stats->errors++;
+    }
+    stats->total_cycles += cyc;
+    if (cyc > stats->max_cycles) {
+        stats->max_cycles = cyc;
+    }
+    stats->hist[bucket]++;
+
+    if (pid >= 0 && pid < MAX_PROCESSES) {
+        rec = &trace_ring[pid][trace_head[pid] & (SYSCALL_RING_SIZE - 1)];
+        rec->pid = pid;
+        rec->num = num;
+        rec->args[0] = arg1;
+        rec->args[1] = arg2;
+        rec->args[2] = arg3;
+        rec->ret = ret;
+        rec->cycles = cyc;
+        trace_head[pid]++;
+    }
+
+    restore_flags(flags);
+}
+
+/* 
+ *   strace_read(int32_t fd, void* buf, int32_t nbytes)
+ *   DESCRIPTION: Copies whole syscall_record_t entries of the selected pid (pid 0 unless changed with write)
+ *   from the oldest one still in the ring. The file position holds the sequence number of the next record
+ *   INPUTS: file descriptor, buffer and its size in bytes
+ *   OUTPUTS: number of bytes copied, 0 once the reader has caught up
+ *   SIDE EFFECTS: advances the file position
+ */
+int32_t strace_read(int32_t fd, void* buf, int32_t nbytes) {
+    pcb_t* curr_pcb;
+    file_entry_t* entry;
+    uint32_t pid, pos, head;
+    int32_t copied = 0;
+
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
+    entry = &curr_pcb->file_array[fd];
+
+    pid = entry->inode_idx;
+    if (pid >= MAX_PROCESSES) { return -1; }
+
+    head = trace_head[pid];
+    pos = entry->position;
+    /* the ring was reset by a new execute since the last read */
+    if (pos > head) { pos = 0; }
+    /* entries older than one ring have been overwritten */
+    if (head - pos > SYSCALL_RING_SIZE) { pos = head - SYSCALL_RING_SIZE; }
+
+    while (pos < head && copied + (int32_t)sizeof(syscall_record_t) <= nbytes) {
+        memcpy((uint8_t *)buf + copied, &trace_ring[pid][pos & (SYSCALL_RING_SIZE - 1)], sizeof(syscall_record_t));
+        copied += sizeof(syscall_record_t);
+        pos++;
+    }
+    entry->position = pos;
+    return copied;
+}
+
+/* 
+ *   strace_write(int32_t fd, const void* buf, int32_t nbytes)
+ *   DESCRIPTION: Selects which pid's ring the fd reads and rewinds to its oldest record
+ *   INPUTS: file descriptor, buffer holding an int32_t pid, nbytes (at least 4)
+ *   OUTPUTS: nbytes on success, -1 for a bad pid
+ *   SIDE EFFECTS: changes the fd's pid and position
+ */
+int32_t strace_write(int32_t fd, const void* buf, int32_t nbytes) {
+    pcb_t* curr_pcb;
+    int32_t pid;
+
+    if (nbytes < (int32_t)sizeof(int32_t)) { return -1; }
+    pid = *(const int32_t *)buf;
+    if (pid < 0 || pid >= MAX_PROCESSES) { return -1; }
+
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
+    curr_pcb->file_array[fd].inode_idx = pid;
+    curr_pcb->file_array[fd].position = 0;
+    return nbytes;
+}
+
+/* 
+ *   sysstat_read(int32_t fd, void* buf, int32_t nbytes)
+ *   DESCRIPTION: Reads the syscall_stats_t array (one entry per system call number) like a regular file
+ *   INPUTS: file descriptor, buffer and its size in bytes
+ *   OUTPUTS: number of bytes copied, 0 at the end
+ *   SIDE EFFECTS: advances the file position
+ */
+int32_t sysstat_read(int32_t fd, void* buf, int32_t nbytes) {
+    uint32_t flags;
+    int32_t copied;
+
+    cli_and_save(flags);
+    copied = device_read_snapshot(fd, syscall_stats, sizeof(syscall_stats), buf, nbytes);
+    restore_flags(flags);
+    return copied;
+}
+
+/* 
+ *   sysstat_write(int32_t fd, const void* buf, int32_t nbytes)
+ *   DESCRIPTION: Any write clears the counters and histograms
+ *   INPUTS: ignored
+ *   OUTPUTS: nbytes
+ *   SIDE EFFECTS: zeroes syscall_stats
+ */
+int32_t sysstat_write(int32_t fd, const void* buf, int32_t nbytes) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    memset(syscall_stats, 0, sizeof(syscall_stats));
+    restore_flags(flags);
+    return nbytes;
+}
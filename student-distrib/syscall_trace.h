@@ -0,0 +1,40 @@
+#ifndef _X_SYSCALL_TRACE_H
+#define _X_SYSCALL_TRACE_H
+
+#include "types.h"
+#include "system_calls.h"
+
+/* latency histogram buckets, bucket i counts calls that took [2^i, 2^(i+1)) cycles */
+#define SYSCALL_HIST_BUCKETS 32
+/* number of records kept per process, must be a power of two */
+#define SYSCALL_RING_SIZE 64
+
+/* one strace-style entry, the layout is shared with the user level strace tool */
+typedef struct syscall_record {
+    uint32_t pid;
+    uint32_t num;
+    uint32_t args[3];
+    int32_t ret;
+    uint32_t cycles;
+} syscall_record_t;
+
+/* per system call number counters, the layout is shared with the user level strace tool */
+typedef struct syscall_stats {
+    uint32_t count;
+    uint32_t errors;
+    uint64_t total_cycles;
+    uint32_t max_cycles;
+    uint32_t hist[SYSCALL_HIST_BUCKETS];
+} syscall_stats_t;
+
+void syscall_trace_init();
+void syscall_trace_reset(int pid);
+void syscall_trace_record(int pid, uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3, int32_t ret, uint64_t cycles);
+
+/* device file operations for "strace" (per process records) and "sysstat" (counters and histograms) */
+int32_t strace_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t strace_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t sysstat_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t sysstat_write(int32_t fd, const void* buf, int32_t nbytes);
+
+#endif
@@ -0,0 +1,46 @@
+#include "sysenter.h"
+#include "klog.h"
+#include "smp.h"
+
+/* 
+ *   sysenter_init()
+ *   DESCRIPTION: Checks that the cpu supports sysenter/sysexit and programs the MSRs so that sysenter
+ *   lands in sysenter_asm with the kernel code segment. sysexit derives the user code and stack
+ *   selectors from IA32_SYSENTER_CS (+16 and +24), which matches the GDT layout in x86_desc.S
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: writes IA32_SYSENTER_CS, IA32_SYSENTER_ESP and IA32_SYSENTER_EIP
+ */
+void sysenter_init() {
+    uint32_t eax, ebx, ecx, edx;
+
+    sysenter_enabled = 0;
+
+    cpuid(1, eax, ebx, ecx, edx);
+    /* family 6 model < 3 stepping < 3 reports SEP but does not implement it */
+    if (!(edx & CPUID_SEP) || ((eax & 0xFFF) < 0x633 && ((eax >> 8) & 0xF) == 6)) {
+        klog(KLOG_INFO, "sysenter: not supported, using int $0x80 only");
+        return;
+    }
+
+    sysenter_enabled = 1;
+    sysenter_cpu_init();
+    klog(KLOG_INFO, "sysenter: enabled");
+}
+
+/* 
+ *   sysenter_cpu_init()
+ *   DESCRIPTION: Programs the calling cpu's sysenter MSRs, every cpu has its own. The stack sysenter lands on
+ *   is the esp0 field of the cpu's TSS, the entry stub loads the process kernel stack from it
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: writes IA32_SYSENTER_CS, IA32_SYSENTER_ESP and IA32_SYSENTER_EIP
+ */
+void sysenter_cpu_init() {
+    if (!sysenter_enabled) {
+        return;
+    }
+    wrmsr(IA32_SYSENTER_CS, KERNEL_CS, 0);
+    wrmsr(IA32_SYSENTER_ESP, (uint32_t)&this_cpu()->tss->esp0, 0);
+    wrmsr(IA32_SYSENTER_EIP, (uint32_t)sysenter_asm, 0);
+}
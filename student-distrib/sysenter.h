@@ -0,0 +1,24 @@
+#ifndef _X_SYSENTER_H
+#define _X_SYSENTER_H
+
+#include "x86_desc.h"
+#include "lib.h"
+
+/* model specific registers used by sysenter/sysexit */
+#define IA32_SYSENTER_CS    0x174
+#define IA32_SYSENTER_ESP   0x175
+#define IA32_SYSENTER_EIP   0x176
+
+/* cpuid leaf 1 edx bit for sysenter/sysexit support (SEP) */
+#define CPUID_SEP           (1 << 11)
+
+/* set to 1 once the sysenter MSRs have been programmed */
+int sysenter_enabled;
+
+/* fast system call entry point in idt_handler.S */
+void sysenter_asm();
+
+void sysenter_init();
+void sysenter_cpu_init();
+
+#endif
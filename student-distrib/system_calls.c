@@ -3,75 +3,262 @@
 #include "keyboard.h"
 #include "x86_desc.h"
 #include "rtc.h"
+#include "device.h"
+#include "syscall_trace.h"
+#include "tty.h"
+#include "clock.h"
+#include "timer.h"
+#include "smp.h"
+#include "sched.h"
+#include "lock.h"
+#include "acct.h"
+#include "kstack.h"
 
 #include "lib.h"
 
-/* we hav 2 processes, we add one to determine which process we are at */
-int process_index = -1; 
-
 /* checkes to see how many processes are available to us */
-int available_process[6] = {0, 0, 0, 0, 0, 0};
+int available_process[MAX_PROCESSES] = {0, 0, 0, 0, 0, 0};
+/* guards available_process, the pid of every task and the fork state in the pcbs */
+static spinlock_t proc_lock;
+
+/* system call functions in idt_handler.S, indexed by system call number - 1 */
+extern int32_t (*idt_jumptable[NUM_SYSCALLS])(uint32_t, uint32_t, uint32_t);
+
+/* 
+ *   syscall_dispatch(uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+ *   DESCRIPTION: Common C entry for idtSyscall_asm and sysenter_asm. Checks the call number, calls through
+ *   idt_jumptable and records the call and its TSC latency for the strace and sysstat devices
+ *   INPUTS: system call number (eax) and the three arguments (ebx, ecx, edx)
+ *   OUTPUTS: return value of the system call, -1 for a bad number
+ *   SIDE EFFECTS: NONE
+ */
+int32_t syscall_dispatch(uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    /* execute comes back here through finish_halt, which does not restore ebx/esi/edi,
+     * so everything used after the call is kept in memory */
+    volatile int pid;
+    volatile uint32_t call = num;
+    volatile uint32_t args[3];
+    volatile uint64_t start;
+    int32_t ret;
+
+    if (num < 1 || num > NUM_SYSCALLS) { return -1; }
+
+    /* the big kernel lock is held from here until the call returns, or execute leaves for user mode */
+    kernel_enter();
+    pid = this_cpu()->pid;
+    acct_syscall(pid);
+
+    /* halt never comes back here, so it is logged on the way in */
+    if (num == SYS_HALT) {
+        syscall_trace_record(pid, num, arg1, arg2, arg3, 0, 0);
+    }
+
+    args[0] = arg1;
+    args[1] = arg2;
+    args[2] = arg3;
+    start = rdtsc();
+    ret = idt_jumptable[num - 1](arg1, arg2, arg3);
+    syscall_trace_record(pid, call, args[0], args[1], args[2], ret, rdtsc() - start);
+    kernel_exit();
+    return ret;
+}
+
+/* 
+ *   process_init()
+ *   DESCRIPTION: Sets up the process table lock
+ *   INPUTS: NONE
+ *   OUTPUTS: NONE
+ *   SIDE EFFECTS: NONE
+ */
+void process_init(void) {
+    spin_init(&proc_lock, "proc");
+}
+
+/* 
+ *   fork_release_children(int32_t pid)
+ *   DESCRIPTION: Lets go of the processes a halting process started with fork. Those that halted already and
+ *   were never waited for give their slots back, the others free their own once they halt
+ *   INPUTS: pid -- the halting process
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller holds proc_lock
+ */
+static void fork_release_children(int32_t pid) {
+    pcb_t* pcb;
+    int32_t c;
+
+    for (c = 0; c < MAX_PROCESSES; c++) {
+        pcb = PCB_ADDR(c);
+        if (!available_process[c] || !pcb->forked || pcb->parent_id != pid) {
+            continue;
+        }
+        if (pcb->zombie) {
+            available_process[c] = 0;
+        } else {
+            pcb->parent_id = -1;
+        }
+    }
+}
+
+/* 
+ *   vidmap_shared(int32_t pid, int term)
+ *   DESCRIPTION: Whether a process other than the halting one still draws into a terminal through vidmap, one
+ *   forked beside it or its parent before it
+ *   INPUTS: pid -- the halting process, term -- its terminal
+ *   OUTPUTS: 1 if so, 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int vidmap_shared(int32_t pid, int term) {
+    int32_t p;
+
+    for (p = 0; p < MAX_PROCESSES; p++) {
+        if (p != pid && available_process[p] && !PCB_ADDR(p)->zombie && PCB_ADDR(p)->terminal == term &&
+            page_vidmap_mapped(p)) {
+            return 1;
+        }
+    }
+    return 0;
+}
 
 /* 
  *   halt()
- *   DESCRIPTION: Terminates a process, returning the status to the parent process.
+ *   DESCRIPTION: Terminates a process, returning the status to the parent process. A process fork started
+ *   ends its task instead, its status is kept for the parent's wait
  *   INPUTS: status - The exit status to be returned to the parent process.
  *   OUTPUTS: Returns 0 on success, or -1 on error.
- *   SIDE EFFECTS: May affect process table and system resources.
+ *   SIDE EFFECTS: May affect process table and system resources. Never returns to the caller, so interrupts
+ *   stay off until the parent's own return to user mode restores its flags
  */
 int32_t halt (uint8_t status){
     cli();
     uint32_t retstat = status;
+    cpu_t* cpu = this_cpu();
+    task_t* task = cpu->current;
+    int term = current_terminal();
     /* determines the current process index */
-    process_index = top_terminal_pid[terminal];
-
-    if(process_index == 0 || process_index == 1 || process_index == 2){
+    cpu->pid = task->pid;
+    /* an exception that kills a process inside a system call comes here one kernel entry deeper, maybe
+     * holding locks the call took. The parent's frame finish_halt returns into holds the kernel lock once */
+    cpu->bkl_depth = 1;
+    lock_drop_all(cpu->pid);
+    /* the program no longer draws through vidmap, the console goes back to its backing page */
+    if (!vidmap_shared(cpu->pid, term)) {
+        console_set_mapped(term, 0);
+    }
+    /* a program that quits in raw mode leaves line editing on for the shell */
+    tty_release(cpu->pid);
+    /* and its alarm must not go off for whoever gets the slot next */
+    timer_release(cpu->pid);
+    /* warn about a kernel stack that came close to its guard page before the slot is painted again */
+    kstack_check(cpu->pid);
+    /* its user pages go back, the directory of whoever runs next is loaded below or by execute */
+    page_release(cpu->pid);
+    /* its forked children outlive it */
+    spin_lock(&proc_lock);
+    fork_release_children(cpu->pid);
+    spin_unlock(&proc_lock);
+
+    if(cpu->pid == 0 || cpu->pid == 1 || cpu->pid == 2){
         // return 0; // Ignore
         pcb_t* curr_pcb;
-        curr_pcb = (pcb_t *) (END_KERNEL - ((process_index + 1) * (PCB_SIZE)));
+        curr_pcb = PCB_ADDR(cpu->pid);
         /* resets the process to available */
-        top_terminal_pid[terminal] = -1;
+        spin_lock(&proc_lock);
+        task->pid = -1;
         available_process[curr_pcb->process_id] = 0;
-        sti();
+        spin_unlock(&proc_lock);
         execute((const uint8_t*) "shell");
     }
 
     /* allocate and type cast the memory to a pcb struct */
     pcb_t* curr_pcb;
-    curr_pcb = (pcb_t *) (END_KERNEL - ((process_index + 1) * (PCB_SIZE))); // PCB_SIZE is 8KB
+    curr_pcb = PCB_ADDR(cpu->pid);
 
-    // clear fd array;
+    // close whatever is still open, so devices like the rtc know they lost a user
     int i;
     for(i=2; i<8; i++){
+        if(curr_pcb->file_array[i].flags == 1){
+            close(i);
+        }
         curr_pcb->file_array[i].flags = 0;
     }
 
-    /* allocate for the shell in memory */
-    top_terminal_pid[terminal] = curr_pcb->parent_id;
-    /* sets process to available*/
-    available_process[curr_pcb->process_id] = 0;
-
-    /* setting TSS */
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = END_KERNEL - ((curr_pcb->parent_id + 1) * (PCB_SIZE));
-
     /* reset squash flag if status reaches max IDT index = 255 */
     if(status == 255 && squashFlag){ 
         retstat = 256; /* 256 represents total number of IDT entries */
         squashFlag = 0;
     }
 
-    process_index = curr_pcb->parent_id;
+    /* a forked process is the bottom of its own task, nothing to return to: its parent collects the status
+     * with wait. The slot stays taken until then, so nobody reuses this stack before the switch away */
+    if(curr_pcb->forked){
+        spin_lock(&proc_lock);
+        if(curr_pcb->parent_id >= 0){
+            curr_pcb->exit_status = retstat;
+            curr_pcb->zombie = 1;
+        } else {
+            available_process[curr_pcb->process_id] = 0;
+        }
+        spin_unlock(&proc_lock);
+        acct_charge(0);
+        sched_wake_all();
+        sched_exit();
+    }
+
+    /* allocate for the shell in memory */
+    spin_lock(&proc_lock);
+    task->pid = curr_pcb->parent_id;
+    /* sets process to available*/
+    available_process[curr_pcb->process_id] = 0;
+    spin_unlock(&proc_lock);
+
+    /* setting TSS */
+    cpu->tss->ss0 = KERNEL_DS;
+    cpu->tss->esp0 = KSTACK_TOP(curr_pcb->parent_id);
+
+    acct_charge(0);
+    cpu->pid = curr_pcb->parent_id;
+    sched_renice(PCB_ADDR(curr_pcb->parent_id)->nice);
 
     program_paging(curr_pcb->parent_id);
 
     /* call finish halt function */
-    sti();
     finish_halt(curr_pcb->ebp, retstat);
     return -1;
 
 }
 
+/* 
+ *   program_end(uint32_t inode)
+ *   DESCRIPTION: Finds where a program's image ends once loaded: past the file copied to PROG_IMAGE_ADDRESS,
+ *   or past the end of a loadable ELF segment, whose bss is not in the file. Kept clear of the stack pages
+ *   INPUTS: inode -- the program file
+ *   OUTPUTS: first user address past the image
+ *   SIDE EFFECTS: none
+ */
+static uint32_t program_end(uint32_t inode) {
+    uint32_t end = PROG_IMAGE_ADDRESS + inodes[inode].length;
+    uint32_t phoff, ph[ELF_PHDR_WORDS];
+    uint16_t phentsize, phnum, n;
+
+    if (read_data(inode, ELF_PHOFF, (uint8_t *)&phoff, sizeof(phoff)) == sizeof(phoff) &&
+        read_data(inode, ELF_PHENTSIZE, (uint8_t *)&phentsize, sizeof(phentsize)) == sizeof(phentsize) &&
+        read_data(inode, ELF_PHNUM, (uint8_t *)&phnum, sizeof(phnum)) == sizeof(phnum)) {
+        for (n = 0; n < phnum; n++) {
+            if (read_data(inode, phoff + n * phentsize, (uint8_t *)ph, sizeof(ph)) != sizeof(ph)) {
+                break;
+            }
+            /* type, offset, vaddr, paddr, filesz, memsz */
+            if (ph[0] == ELF_PT_LOAD && ph[2] >= USER_SPACE && ph[2] + ph[5] > end) {
+                end = ph[2] + ph[5];
+            }
+        }
+    }
+    if (end > USER_SPACE + USER_SPACE_SIZE - USER_STACK_PAGES * FOUR_KB_SIZE) {
+        end = USER_SPACE + USER_SPACE_SIZE - USER_STACK_PAGES * FOUR_KB_SIZE;
+    }
+    return end;
+}
+
 /* 
  *   execute()
  *   DESCRIPTION: Executes a new process, replacing the current process image with a new process image.
@@ -87,9 +274,17 @@ int32_t execute (const uint8_t* command) {
     // uint8_t * cur_cmd;
     // *cur_cmd = *(command);
     uint8_t cur_cmd[256];
-    for(j=0; j<strlen((char*)(command)) + 1; j++){
+    /* check if we have a valid command, the kernel starts each terminal's first shell and programs all others */
+    if (command == NULL) {
+        return -1;
+    }
+    if (this_cpu()->current->pid >= 0 && !page_user_str_ok(command, sizeof(cur_cmd))) {
+        return -1;
+    }
+    for(j=0; j<sizeof(cur_cmd) - 1 && command[j] != '\0'; j++){
         cur_cmd[j] = command[j];
     }
+    cur_cmd[j] = '\0';
     //strncpy((char*)cur_cmd, (char*)command, strlen((char*)(command)) + 1);
 
     
@@ -102,11 +297,6 @@ int32_t execute (const uint8_t* command) {
     dentry_t file_info;
 //old pcb stuff
 
-    /* check if we have a valid command */
-    if (command == NULL) {
-        return -1;
-    }
-
     // FIND THE FILE NAME
     i = 0;
     while(command[i] == ' '){ i+=1; }
@@ -144,33 +334,70 @@ int32_t execute (const uint8_t* command) {
         return -1;
     }
 
+    /* how much of user space the program needs besides its stack */
+    uint32_t image_end = program_end(file_info.inode_n);
+
     // SET UP PAGING
-    int old_process_index = top_terminal_pid[terminal];
+    cpu_t* cpu = this_cpu();
+    task_t* task = cpu->current;
+    int term = current_terminal();
+    uint32_t flags;
+    spin_lock_irqsave(&proc_lock, flags);
+    int old_process_index = task->pid;
     /* determines proces index */
-    process_index = next_available_process();
+    int pid = next_available_process();
 
     /* checks to see if process index exists or not */
-    if (process_index != -1) {
-        available_process[process_index] = 1;
-        top_terminal_pid[terminal] = process_index;
+    if (pid != -1) {
+        /* the time up to here was the parent's */
+        acct_charge(0);
+        acct_start(pid, (int8_t*)file_name);
+        cpu->pid = pid;
+        available_process[pid] = 1;
+        task->pid = pid;
+        spin_unlock_irqrestore(&proc_lock, flags);
+        syscall_trace_reset(pid);
     }
     else {
+        spin_unlock_irqrestore(&proc_lock, flags);
         return -1;
     }
 
 
-    /* determine which process we need to allocate memory for */
-    program_paging(process_index);
+    /* a directory of its own holding only the pages it uses: the image with its bss, and the stack */
+    page_dir_create(pid);
+    program_paging(pid);
+    if (page_map_user(pid, PROG_IMAGE_ADDRESS, (image_end - PROG_IMAGE_ADDRESS + FOUR_KB_SIZE - 1) / FOUR_KB_SIZE) ||
+        page_map_user(pid, USER_SPACE + USER_SPACE_SIZE - USER_STACK_PAGES * FOUR_KB_SIZE, USER_STACK_PAGES)) {
+        page_release(pid);
+        spin_lock_irqsave(&proc_lock, flags);
+        available_process[pid] = 0;
+        task->pid = old_process_index;
+        spin_unlock_irqrestore(&proc_lock, flags);
+        cpu->pid = old_process_index;
+        if (old_process_index >= 0) {
+            program_paging(old_process_index);
+        }
+        return -1;
+    }
+
+    /* the heap starts empty past the image, sbrk grows it */
+    page_heap_init(pid, image_end);
 
     // LOAD PROGRAM TO VIRTUAL ADDRESS
 
-    read_data(file_info.inode_n, 0, (uint8_t *)0x08048000, 0x400000);
+    read_data(file_info.inode_n, 0, (uint8_t *)PROG_IMAGE_ADDRESS, image_end - PROG_IMAGE_ADDRESS);
 
     pcb_t* curr_pcb;
-    curr_pcb = (pcb_t *) (END_KERNEL - ((process_index + 1) * (PCB_SIZE))); // PCB_SIZE is 8KB
+    curr_pcb = PCB_ADDR(pid);
 
-    curr_pcb->process_id = process_index;
+    curr_pcb->process_id = pid;
     curr_pcb->parent_id = old_process_index;
+    curr_pcb->terminal = term;
+    curr_pcb->forked = 0;
+    curr_pcb->zombie = 0;
+    curr_pcb->nice = (old_process_index >= 0) ? PCB_ADDR(old_process_index)->nice : 0;
+    sched_renice(curr_pcb->nice);
     //start looking at argument with pcb
     uint8_t arg_length = 0;
     if(cur_cmd[i] != NULL){
@@ -193,6 +420,8 @@ int32_t execute (const uint8_t* command) {
     curr_pcb->file_array[1].flags = 1;
     curr_pcb->file_array[0].table_pointer.read = terminal_read;
     curr_pcb->file_array[1].table_pointer.write = terminal_write;
+    curr_pcb->file_array[0].table_pointer.ioctl = terminal_ioctl;
+    curr_pcb->file_array[1].table_pointer.ioctl = terminal_ioctl;
 
     /* initialize the rest of the FD to 0 */
     for (i = 2; i < 8; i++) {
@@ -210,52 +439,206 @@ int32_t execute (const uint8_t* command) {
         : "=r"(curr_pcb->ebp)
     );
 
+    /* fill the kernel stack with the canary so its high water mark can be read later */
+    kstack_paint(pid);
+
     /* setting TSS */
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = END_KERNEL - ((process_index + 1) * (PCB_SIZE));
+    cpu->tss->ss0 = KERNEL_DS;
+    cpu->tss->esp0 = KSTACK_TOP(pid);
 
+    /* iret does not come back through the entry that took the kernel lock */
+    kernel_exit();
     finish_execute(starting_address);
-    /*  popl %edx
-    orl $0x200, %edx
-    pushl %edx */
 
     return 0;
 
 }
 
 /* 
- *   restoreExec(int pid)
- *   DESCRIPTION: restores old ebp upon calling execute function 
- *   INPUTS: int pid
- *   OUTPUTS: NONE
- *   SIDE EFFECTS: NONE
+ *   fork_user_regs(int32_t pid, user_regs_t* regs)
+ *   DESCRIPTION: Reads the user registers a process entered its current system call with off the top of its
+ *   kernel stack. int 0x80 left the cpu's frame there with idtSyscall_asm's pushes below it, ss on top.
+ *   sysenter_asm only pushed the registers, ebp holding the user stack with the return address on it
+ *   INPUTS: pid -- the calling process, regs -- filled in
+ *   OUTPUTS: 0, -1 if the user stack sysenter was given is not mapped
+ *   SIDE EFFECTS: none
  */
-void restoreExec(int pid) {
-    /* get the current pcb */
-    pcb_t* curr_pcb;
-    curr_pcb = (pcb_t *) (END_KERNEL - ((pid + 1) * (PCB_SIZE)));
-    /* set up TSS  */
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = END_KERNEL - ((curr_pcb->process_id + 1) * (PCB_SIZE));
+static int32_t fork_user_regs(int32_t pid, user_regs_t* regs) {
+    uint32_t* top = (uint32_t *)KSTACK_TOP(pid);
+
+    if (top[-1] == USER_DS) {
+        regs->esp = top[-2];
+        regs->eflags = top[-3];
+        regs->eip = top[-5];
+        top -= 5;
+    } else {
+        if (!page_user_ok((void *)top[-1], sizeof(uint32_t))) {
+            return -1;
+        }
+        regs->esp = top[-1];
+        regs->eflags = 0x202;
+        regs->eip = *(uint32_t *)top[-1];
+    }
+    regs->ebp = top[-1];
+    regs->edi = top[-2];
+    regs->esi = top[-3];
+    regs->edx = top[-4];
+    regs->ecx = top[-5];
+    regs->ebx = top[-6];
+    return 0;
+}
 
-    /* call the paging scheme */
-    program_paging(pid);
-    finish_restore_exe(curr_pcb->old_ebp);
+/* 
+ *   fork_start(user_regs_t* regs)
+ *   DESCRIPTION: First thing a forked child's task runs, switched to by schedule with the kernel lock held and
+ *   interrupts off. task_load has loaded its kernel stack and pages already
+ *   INPUTS: regs -- what it starts with, kept at the top of its kernel stack
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: never returns
+ */
+static void fork_start(user_regs_t* regs) {
+    /* iret does not come back through the entry that took the kernel lock */
+    kernel_exit();
+    finish_fork(regs);
+}
+
+/* 
+ *   fork()
+ *   DESCRIPTION: Starts a copy of the calling process: the same user space, shared copy on write by
+ *   page_fork, the same open files, arguments and nice level. The child gets a task of its own on the same
+ *   terminal and runs beside the parent, returning 0 from the call. Its halt status is kept for wait
+ *   INPUTS: none
+ *   OUTPUTS: to the parent, the child's pid, -1 if no slot is free
+ *   SIDE EFFECTS: the parent's writable pages become read only until one of the two writes them
+ */
+int32_t fork (void) {
+    user_regs_t regs;
+    cpu_t* cpu = this_cpu();
+    int parent = cpu->pid;
+    int32_t child;
+    pcb_t* child_pcb;
+    uint32_t* sp;
+    uint32_t flags;
+    int i;
+
+    if (parent < 0 || fork_user_regs(parent, &regs) == -1) {
+        return -1;
+    }
+
+    spin_lock_irqsave(&proc_lock, flags);
+    child = next_available_process();
+    if (child == -1) {
+        spin_unlock_irqrestore(&proc_lock, flags);
+        return -1;
+    }
+    acct_start(child, acct_name(parent));
+    available_process[child] = 1;
+    spin_unlock_irqrestore(&proc_lock, flags);
+    syscall_trace_reset(child);
+
+    child_pcb = PCB_ADDR(child);
+    memcpy(child_pcb, PCB_ADDR(parent), sizeof(pcb_t));
+    child_pcb->process_id = child;
+    child_pcb->parent_id = parent;
+    child_pcb->forked = 1;
+    child_pcb->zombie = 0;
+    /* both copies of a file get closed, the ones that count their users need to know about the second */
+    for (i = 2; i < 8; i++) {
+        if (child_pcb->file_array[i].flags == 1 && child_pcb->file_array[i].table_pointer.dup != NULL) {
+            child_pcb->file_array[i].table_pointer.dup(i);
+        }
+    }
+
+    page_fork(parent, child);
+    kstack_paint(child);
+
+    /* the first sched_switch to the child returns into fork_start with the registers as its argument */
+    sp = (uint32_t *)((user_regs_t *)KSTACK_TOP(child) - 1);
+    memcpy(sp, &regs, sizeof(regs));
+    *--sp = (uint32_t)((user_regs_t *)KSTACK_TOP(child) - 1);
+    *--sp = 0;                          //return address of fork_start, which never returns
+    *--sp = (uint32_t)fork_start;       //where sched_switch returns to
+    *--sp = 0;                          //ebp
+    *--sp = 0;                          //ebx
+    *--sp = 0;                          //esi
+    *--sp = 0;                          //edi
+    sched_fork(child, (uint32_t)sp);
+    return child;
+}
+
+/* 
+ *   wait(int32_t* status)
+ *   DESCRIPTION: Waits for one of the caller's forked children to halt and frees its slot
+ *   INPUTS: status -- where the child's halt status goes, NULL to drop it
+ *   OUTPUTS: the child's pid, -1 if the caller has no forked children or status is not a user pointer
+ *   SIDE EFFECTS: may switch tasks
+ */
+int32_t wait (int32_t* status) {
+    int32_t pid = this_cpu()->pid;
+    int32_t c, children, exit_status;
+    pcb_t* pcb;
+    uint32_t flags;
+
+    if (pid < 0 || (status != NULL && !page_user_ok(status, sizeof(*status)))) {
+        return -1;
+    }
+
+    spin_lock_irqsave(&proc_lock, flags);
+    for (;;) {
+        children = 0;
+        for (c = 0; c < MAX_PROCESSES; c++) {
+            pcb = PCB_ADDR(c);
+            if (!available_process[c] || !pcb->forked || pcb->parent_id != pid) {
+                continue;
+            }
+            if (pcb->zombie) {
+                exit_status = pcb->exit_status;
+                available_process[c] = 0;
+                spin_unlock_irqrestore(&proc_lock, flags);
+                if (status != NULL) {
+                    *status = exit_status;
+                }
+                return c;
+            }
+            children++;
+        }
+        if (children == 0) {
+            spin_unlock_irqrestore(&proc_lock, flags);
+            return -1;
+        }
+        /* halt wakes every task once the child is a zombie */
+        spin_wait(&proc_lock);
+    }
+}
+
+/* 
+ *   current_terminal()
+ *   DESCRIPTION: finds the terminal of the task running on this cpu, which all of its processes belong to
+ *   INPUTS: none
+ *   OUTPUTS: terminal number, the one on screen when no task is running
+ *   SIDE EFFECTS: NONE
+ */
+int current_terminal(void) {
+    task_t* t = this_cpu()->current;
 
+    if (t == NULL) {
+        return terminal;
+    }
+    return t->terminal;
 }
 
 /* 
  *   next_available_process()
- *   DESCRIPTION: Iterates through the top_terminal_pid and determines next available slot for a process
+ *   DESCRIPTION: Iterates through the available processes and determines next available slot for a process
  *   to be run in
  *   INPUTS: NONE
  *   OUTPUTS: -1 on failure and process index
- *   SIDE EFFECTS: NONE
+ *   SIDE EFFECTS: caller holds proc_lock
  */
 int next_available_process() {
     int i = 0;
     /* check to see if terminal exists or not */
-    if(top_terminal_pid[terminal] == -1) {
+    if(this_cpu()->current == NULL || this_cpu()->current->pid == -1) {
         /* keeps checking until one spot is open*/
         while (available_process[i] == 1) {
             i++;
@@ -295,7 +678,7 @@ int next_available_process() {
 int32_t read_file_pcb (int32_t fd, void* buf, int32_t nbytes) {
     /* type case pcb to memory location of current process */
     pcb_t* curr_pcb;
-    curr_pcb = (pcb_t *) (END_KERNEL - ((process_index + 1) * (PCB_SIZE))); // PCB_SIZE is 8KB
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
 
     if (fd == 0){
         return terminal_read(fd, buf, nbytes);
@@ -323,7 +706,7 @@ int32_t read_file_pcb (int32_t fd, void* buf, int32_t nbytes) {
 int32_t read_dir_pcb (int32_t fd, void* buf, int32_t nbytes){
     /* type case pcb to memory location of current process */
     pcb_t* curr_pcb;
-    curr_pcb = (pcb_t *) (END_KERNEL - ((process_index + 1) * (PCB_SIZE))); // PCB_SIZE is 8KB
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
 
     /* check to see if the current position/file index is valid */
     if (curr_pcb->file_array[fd].position >= boot_block->dir_entries_n){
@@ -355,7 +738,7 @@ int32_t read_dir_pcb (int32_t fd, void* buf, int32_t nbytes){
 int32_t close_file_pcb (int32_t fd){
     /* type case pcb to memory location of current process */
     pcb_t* curr_pcb;
-    curr_pcb = (pcb_t *) (END_KERNEL - ((process_index + 1) * (PCB_SIZE))); // PCB_SIZE is 8KB
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
     /* check to see if the file is not stdin or stdout */
     if(fd > 1 && fd < 8){
         if(curr_pcb->file_array[fd].flags == 0){
@@ -381,7 +764,7 @@ int32_t close_file_pcb (int32_t fd){
 int32_t close_dir_pcb (int32_t fd){
     /* type case pcb to memory location of current process */
     pcb_t* curr_pcb;
-    curr_pcb = (pcb_t *) (END_KERNEL - ((process_index + 1) * (PCB_SIZE))); // PCB_SIZE is 8KB
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
     /* check to see if the directory is not stdin or stdout */
     if(fd > 1 && fd < 8){
         if(curr_pcb->file_array[fd].flags == 0){
@@ -411,8 +794,10 @@ int32_t read (int32_t fd, void* buf, int32_t nbytes){
 
     /* check for boundaries */
     if(fd < 0 || fd > 8 || fd == 1 || buf == NULL || nbytes < 0){return -1;}
+    /* the file types write into buf with locks held, a fault there would never give them back */
+    if(!page_user_ok(buf, nbytes)){return -1;}
 
-    curr_pcb = (pcb_t *) (END_KERNEL - ((process_index + 1) * (PCB_SIZE))); // PCB_SIZE is 8KB
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
 
     /* check is flags are in use or not */
     if(curr_pcb->file_array[fd].flags == 0){return -1;}
@@ -438,8 +823,9 @@ int32_t write (int32_t fd, const void* buf, int32_t nbytes){
 
      /* check for boundaries */
     if(fd < 0 || fd > 8 || fd == 0 || buf == NULL || nbytes < 0){return -1;}
+    if(!page_user_ok(buf, nbytes)){return -1;}
 
-    curr_pcb = (pcb_t *) (END_KERNEL - ((process_index + 1) * (PCB_SIZE))); // PCB_SIZE is 8KB
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
 
     /* check is flags are in use or not */
     if(curr_pcb->file_array[fd].flags == 0){return -1;}
@@ -463,14 +849,17 @@ int32_t open (const uint8_t* filename){
     int32_t file_desc = 0;
     unsigned j;
 
-    curr_pcb = (pcb_t *) (END_KERNEL - ((process_index + 1) * (PCB_SIZE))); // PCB_SIZE is 8KB
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
+    if(filename == NULL || !page_user_str_ok(filename, 32)){return -1;}
 
     /* keep the filename within 32 characters regardless of input length*/
     uint8_t fn[33];
-    for(j=0; j<32; j++){
+    for(j=0; j<32 && filename[j] != '\0'; j++){
         fn[j] = filename[j];
     }
-    fn[32] = '\0';
+    for(; j<33; j++){
+        fn[j] = '\0';
+    }
     
     while(curr_pcb->file_array[file_desc].flags == 1) { 
         file_desc++;  
@@ -479,6 +868,19 @@ int32_t open (const uint8_t* filename){
             return -1;
         } 
     }
+    /* kernel devices are not in the file system image, check them first */
+    const table_pointer_t* dev = find_device(fn);
+    if (dev != NULL) {
+        if (dev->open(fn) == -1) {
+            return -1;
+        }
+        curr_pcb->file_array[file_desc].table_pointer = *dev;
+        curr_pcb->file_array[file_desc].inode_idx = 0;
+        curr_pcb->file_array[file_desc].position = 0;
+        curr_pcb->file_array[file_desc].flags = 1;
+        return file_desc;
+    }
+
     /* create a dentry and check to to see if we can find the file_name*/
     if (read_dentry_by_name (fn, &file_info) == -1) { 
         return -1; 
@@ -497,6 +899,8 @@ int32_t open (const uint8_t* filename){
         curr_pcb->file_array[file_desc].table_pointer.write = write_dir;
         curr_pcb->file_array[file_desc].table_pointer.close = close_dir_pcb;
         curr_pcb->file_array[file_desc].table_pointer.open = open_dir; 
+        curr_pcb->file_array[file_desc].table_pointer.ioctl = NULL;
+        curr_pcb->file_array[file_desc].table_pointer.dup = NULL;
 
     } else if (file_info.file_type == 2) {    // Opening File
 
@@ -504,6 +908,8 @@ int32_t open (const uint8_t* filename){
         curr_pcb->file_array[file_desc].table_pointer.write = write_file;
         curr_pcb->file_array[file_desc].table_pointer.close = close_file_pcb;
         curr_pcb->file_array[file_desc].table_pointer.open = open_file;
+        curr_pcb->file_array[file_desc].table_pointer.ioctl = NULL;
+        curr_pcb->file_array[file_desc].table_pointer.dup = NULL;
 
     } else if (file_info.file_type == 0) {    // Opening Rtc
 
@@ -511,6 +917,8 @@ int32_t open (const uint8_t* filename){
         curr_pcb->file_array[file_desc].table_pointer.write = rtc_write;
         curr_pcb->file_array[file_desc].table_pointer.close = rtc_close;
         curr_pcb->file_array[file_desc].table_pointer.open = rtc_open; 
+        curr_pcb->file_array[file_desc].table_pointer.ioctl = NULL;
+        curr_pcb->file_array[file_desc].table_pointer.dup = rtc_dup;
     }
 
     /* return FD*/
@@ -533,7 +941,7 @@ int32_t close (int32_t fd){
     if(fd < 2 || fd > 8){return -1;}
 
     pcb_t* curr_pcb;
-    curr_pcb = (pcb_t *) (END_KERNEL - ((process_index + 1) * (PCB_SIZE))); // PCB_SIZE is 8KB
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
 
     /* check is flags are in use or not */
     if(curr_pcb->file_array[fd].flags == 0){return -1;}
@@ -558,12 +966,13 @@ int32_t close (int32_t fd){
 int32_t getargs (uint8_t* buf, int32_t nbytes){
     /* get current pcb by type casting */
     pcb_t* curr_pcb;
-    curr_pcb = (pcb_t *) (END_KERNEL - ((process_index + 1) * (PCB_SIZE)));
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
 
     /* check if there is even an argument or not */
     if (curr_pcb->cur_arg[0] == NULL){ return -1; }
     /* check if size of arg is valid */
     if(strlen((char*)(curr_pcb->cur_arg)) > nbytes){ return -1;}
+    if(!page_user_ok(buf, strlen((char*)(curr_pcb->cur_arg)) + 1)){ return -1;}
     /*if there is, copy it into the buffer */
     strncpy((char*)buf, (char*) curr_pcb->cur_arg, strlen((char*)(curr_pcb->cur_arg)) + 1);
     /* reset the argument after it is used */
@@ -575,22 +984,45 @@ int32_t getargs (uint8_t* buf, int32_t nbytes){
  *   DESCRIPTION: Calls maps the video mem in user space at a pre set virtual address
  *   INPUTS: uint8_t** screen_start
  *   OUTPUTS: Address, else -1 if the location is not valid 
- *   SIDE EFFECTS: assigns the screen start pointer to the vidmap address
+ *   SIDE EFFECTS: assigns the screen start pointer to the vidmap page of the caller's terminal
  */
 int32_t vidmap (uint8_t** screen_start){
+    int caller_terminal;
     /* check if pointer is NULL or not */
     if(screen_start == NULL){return -1;}
     /* check is the screen start pointer is within the correct bounds */
-    if(((uint32_t)screen_start > USER_SPACE + KERNEL_ADDRESS) || ((uint32_t)screen_start < USER_SPACE)){ return -1;}
+    if(!page_user_ok(screen_start, sizeof(*screen_start))){ return -1;}
 
+    /* map the page of the terminal the caller belongs to, which need not be the one on screen */
+    caller_terminal = current_terminal();
+    /* the program now draws into video memory itself, so the console must not flush over it */
+    console_set_mapped(caller_terminal, 1);
     /* helper function to set up paging */
-    //memcpy(get_terminal(terminal), (void *)VIDEO_MEM_ADDRESS, 4096);
-    vidmap_paging((int8_t **)screen_start, terminal);
-    //memcpy((void *)VIDEO_MEM_ADDRESS, get_terminal(terminal), 4096);
+    vidmap_paging((int8_t **)screen_start, caller_terminal);
 
     /* return 0 on success, should always happen */
     return 0;
 }
+/* 
+ *   ioctl (int32_t fd, int32_t request, void* arg)
+ *   DESCRIPTION: Passes a device specific request to the file behind fd, like switching the terminal to raw mode
+ *   INPUTS: int32_t fd, int32_t request, void* arg
+ *   OUTPUTS: whatever the device returns, -1 if fd is not open or the file type takes no requests
+ *   SIDE EFFECTS: depends on the device
+ */
+int32_t ioctl (int32_t fd, int32_t request, void* arg){
+    pcb_t* curr_pcb;
+    curr_pcb = PCB_ADDR(this_cpu()->pid);
+
+    if (fd < 0 || fd >= 8 || curr_pcb->file_array[fd].flags != 1) {
+        return -1;
+    }
+    if (curr_pcb->file_array[fd].table_pointer.ioctl == NULL) {
+        return -1;
+    }
+    return curr_pcb->file_array[fd].table_pointer.ioctl(fd, request, arg);
+}
+
 /* 
  *   set_handler (int32_t signum, void* handler_address)
  *   DESCRIPTION: Sets the handler in response to various events or signals sent to process
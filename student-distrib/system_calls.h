@@ -1,3 +1,6 @@
+#ifndef _X_SYSTEM_CALLS_H
+#define _X_SYSTEM_CALLS_H
+
 #include "x86_desc.h"
 #include "file_sys.h"
 #include "keyboard.h"
@@ -5,6 +8,56 @@
 #define PCB_SIZE 8192
 #define END_KERNEL 0x800000
 
+/* number of pcb slots below END_KERNEL */
+#define MAX_PROCESSES 6
+
+/*
+ * Kernel stack slots, stacked down from END_KERNEL. Each is a KSTACK_GUARD page left unmapped by page.c
+ * followed by PCB_SIZE bytes of stack with the pcb in the top PCB_RESERVED of them, so a stack that runs
+ * over faults instead of writing into the slot below. Slot 0 is the boot stack, process pid has slot pid + 1
+ */
+#define KSTACK_GUARD    4096
+#define KSLOT_SIZE      (PCB_SIZE + KSTACK_GUARD)
+#define PCB_RESERVED    512
+#define NUM_KSLOTS      (MAX_PROCESSES + 1)
+#define KSLOT(pid)      (END_KERNEL - ((pid) + 2) * KSLOT_SIZE)
+#define KSTACK_LOW(pid) (KSLOT(pid) + KSTACK_GUARD)
+#define KSTACK_TOP(pid) (KSLOT(pid) + KSLOT_SIZE - PCB_RESERVED)
+#define PCB_ADDR(pid)   ((pcb_t *) KSTACK_TOP(pid))
+
+/* ELF header fields execute reads, and the words of a program header it uses */
+#define ELF_PHOFF       28
+#define ELF_PHENTSIZE   42
+#define ELF_PHNUM       44
+#define ELF_PHDR_WORDS  6
+#define ELF_PT_LOAD     1
+
+/* system call numbers, must match ece391sysnum.h and the order of idt_jumptable */
+#define SYS_HALT        1
+#define SYS_EXECUTE     2
+#define SYS_READ        3
+#define SYS_WRITE       4
+#define SYS_OPEN        5
+#define SYS_CLOSE       6
+#define SYS_GETARGS     7
+#define SYS_VIDMAP      8
+#define SYS_SET_HANDLER 9
+#define SYS_SIGRETURN   10
+#define SYS_IOCTL       11
+#define SYS_GETTIME     12
+#define SYS_SLEEP       13
+#define SYS_ALARM       14
+#define SYS_NICE        15
+#define SYS_FORK        16
+#define SYS_SBRK        17
+#define SYS_MMAP        18
+#define SYS_MUNMAP      19
+#define SYS_WAIT        20
+#define NUM_SYSCALLS    20
+
+/* C side of both system call entry paths */
+int32_t syscall_dispatch(uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
 /* halt system call */
 int32_t halt (uint8_t status);
 /* execute system call */
@@ -25,12 +78,33 @@ int32_t vidmap (uint8_t** screen_start);
 int32_t set_handler (int32_t signum, void* handler_address);
 /* sigreturn system call */
 int32_t sigreturn (void);
+/* ioctl system call */
+int32_t ioctl (int32_t fd, int32_t request, void* arg);
+/* fork system call */
+int32_t fork (void);
+/* wait system call */
+int32_t wait (int32_t* status);
 
 /* finish execute function call */
 void finish_execute(void* starting_address);
 /* finish halt function call */
 void finish_halt(uint32_t a, uint32_t b);
-void finish_restore_exe(uint32_t a);
+
+/* user registers a forked child starts with, finish_fork reads them at these offsets */
+typedef struct user_regs {
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+    uint32_t esi;
+    uint32_t edi;
+    uint32_t ebp;
+    uint32_t eip;
+    uint32_t esp;
+    uint32_t eflags;
+} user_regs_t;
+
+/* finish fork function call, enters user mode with regs and eax 0 */
+void finish_fork(user_regs_t* regs);
 //extern void finish_execute(uint8_t[4]);
 
 /* new read directory function */
@@ -44,8 +118,11 @@ int32_t close_dir_pcb (int32_t fd);
 
 int get_terminal(int t);
 
+void process_init(void);
 int next_available_process();
-void restoreExec(int pid);
+/* pid slots in use */
+extern int available_process[MAX_PROCESSES];
+int current_terminal(void);
 
 /* pcb struct to type cast bottom of kernel memory for each process */
 typedef struct pcb {
@@ -57,7 +134,19 @@ typedef struct pcb {
     uint8_t cur_arg[33];
     int process_id;
     int parent_id;
-    uint32_t old_ebp;
+    /* terminal the process was started on */
+    int terminal;
+    /* base scheduling level, inherited from the parent */
+    int nice;
+    /* started by fork on a task of its own, its parent collects it with wait */
+    int forked;
+    /* halted with exit_status, the slot is kept until the parent waits */
+    int zombie;
+    int exit_status;
 
 } pcb_t;
 
+/* fails to compile when the pcb outgrows the room kept for it above its stack */
+typedef char pcb_fits_check[(sizeof(pcb_t) <= PCB_RESERVED) ? 1 : -1];
+
+#endif
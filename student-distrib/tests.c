@@ -5,6 +5,13 @@
 #include "file_sys.h"
 #include "keyboard.h"
 #include "rtc.h"
+#include "tty.h"
+#include "clock.h"
+#include "timer.h"
+#include "smp.h"
+#include "lock.h"
+#include "kstack.h"
+#include "system_calls.h"
 
 
 #define PASS 1
@@ -16,6 +23,8 @@
 	printf("[TEST %s] Running %s at %s:%d\n", __FUNCTION__, __FUNCTION__, __FILE__, __LINE__)
 #define TEST_OUTPUT(name, result)	\
 	printf("[TEST %s] Result = %s\n", name, (result) ? "PASS" : "FAIL");
+#define TEST_SKIP(name, why)	\
+	printf("[TEST %s] Result = SKIP, %s\n", name, why);
 
 static inline void assertion_failure(){
 	/* Use exception #15 for assertions, otherwise
@@ -109,19 +118,22 @@ char* out_of_bounds_check_video(char *a, char b){
 /* 
  *   present_check()
  *   DESCRIPTION: Checks all memory locations that should be present. This includes all 4MB of
- * 	 			  memory that consists of the kernel page, and the 4KB page that consists of 
- * 				  video memory.
+ * 	 			  memory that consists of the kernel page except the unmapped guard pages under the
+ * 				  kernel stacks, and the 4KB page that consists of video memory.
  *   INPUTS: NONE
  *   OUTPUTS: NONE
  *   SIDE EFFECTS: The image should pass. If the kernel or video memory is allocated incorrectly this will cause
  * 				   a page fault.
  */
 void present_check(){
-	//kernel memory access check (every location from 0x400000 to 0x7FFFFF)
+	//kernel memory access check (every location from 0x400000 to 0x7FFFFF but the kernel stack guard pages)
 		int i;
 		for(i = 0; i < 0x400000; i++){				//iterating to next mem address (next 4 bytes) is page fault
 			unsigned char * pointer = (unsigned char*)(i + 0x400000);
 			unsigned char temp;
+			if((uint32_t)pointer >= KSLOT(MAX_PROCESSES - 1) && ((uint32_t)pointer - KSLOT(MAX_PROCESSES - 1)) % KSLOT_SIZE < KSTACK_GUARD){
+				continue;
+			}
 			temp = *(pointer);
 		}
 
@@ -926,6 +938,415 @@ void read_null(){
 /* Checkpoint 4 tests */
 /* Checkpoint 5 tests */
 
+/* 
+ *   tty_line_test()
+ *   DESCRIPTION: Types into the line discipline of terminal 1 and checks that backspace, tab and a full line are
+ *   handled and that terminal 2 does not see terminal 1's input
+ *   INPUTS: NONE
+ *   OUTPUTS: NONE
+ *   SIDE EFFECTS: echoes the typed characters to terminal 1
+ */
+void tty_line_test(){
+	TEST_HEADER;
+	tty_t* tty = tty_get(1);
+	uint8_t buf[TTY_LINE_MAX + 1];
+	int result = PASS;
+	int i, rv;
+
+	/* "ab<backspace>c<tab>" reads back as "ac" plus the tab spaces and the newline */
+	tty_input(tty, 'a');
+	tty_input(tty, 'b');
+	tty_input(tty, '\b');
+	tty_input(tty, 'c');
+	tty_input(tty, '\t');
+	tty_input(tty, '\n');
+	if(tty_get(2)->lines != 0){result = FAIL;}
+	rv = tty_read(tty, buf, sizeof(buf));
+	if(rv != 3 + TTY_TAB_WIDTH || strncmp((int8_t*)buf, (int8_t*)"ac    \n", rv) != 0){result = FAIL;}
+
+	/* a line longer than the limit is cut so the newline still fits */
+	for(i = 0; i < TTY_LINE_MAX + 10; i++){
+		tty_input(tty, 'x');
+	}
+	tty_input(tty, '\n');
+	rv = tty_read(tty, buf, sizeof(buf));
+	if(rv != TTY_LINE_MAX || buf[rv - 1] != '\n'){result = FAIL;}
+
+	TEST_OUTPUT("tty_line_test", result);
+}
+
+#define TIMER_TEST_COUNT 6
+
+/* tick each test timer fired on */
+static volatile uint32_t timer_test_fired[TIMER_TEST_COUNT];
+
+static void timer_test_fn(uint32_t i){
+	timer_test_fired[i] = timer_ticks();
+}
+
+/* 
+ *   timer_wheel_test()
+ *   DESCRIPTION: Arms timers on both sides of the first level's 256 ticks and in the second level, one of
+ *   them armed twice and one cancelled, then waits for them and checks that none fired early or twice
+ *   INPUTS: NONE
+ *   OUTPUTS: NONE
+ *   SIDE EFFECTS: busy for about 1.5 seconds, needs interrupts on
+ */
+void timer_wheel_test(){
+	TEST_HEADER;
+	static const uint32_t delay[TIMER_TEST_COUNT] = {0, 10, 255, 256, 300, 1500};
+	ktimer_t timers[TIMER_TEST_COUNT];
+	uint32_t start;
+	int result = PASS;
+	int i;
+
+	for(i = 0; i < TIMER_TEST_COUNT; i++){
+		timer_test_fired[i] = 0;
+		timer_setup(&timers[i], timer_test_fn, i);
+	}
+	start = timer_ticks();
+	for(i = 0; i < TIMER_TEST_COUNT; i++){
+		timer_add(&timers[i], delay[i]);
+	}
+	/* re-arming moves the timer instead of linking it twice */
+	timer_add(&timers[2], delay[2]);
+	if(timer_del(&timers[4]) != 1){result = FAIL;}
+
+	while(timer_ticks() - start < delay[TIMER_TEST_COUNT - 1] + 10){}
+
+	for(i = 0; i < TIMER_TEST_COUNT; i++){
+		if(i == 4){
+			if(timer_test_fired[i] != 0){result = FAIL;}
+		}else if(timer_test_fired[i] - start < delay[i] || timers[i].pprev != NULL){
+			result = FAIL;
+		}
+	}
+	TEST_OUTPUT("timer_wheel_test", result);
+}
+
+/* 
+ *   smp_cpu_test()
+ *   DESCRIPTION: Checks the per cpu state the other cpus were started with: the boot cpu finds itself through
+ *   its task register, and every online cpu has its own APIC id, TSS descriptor and page directory sharing the
+ *   kernel's mappings
+ *   INPUTS: NONE
+ *   OUTPUTS: NONE
+ *   SIDE EFFECTS: NONE
+ */
+void smp_cpu_test(){
+	TEST_HEADER;
+	int result = PASS;
+	int i, j;
+
+	if(this_cpu() != &cpus[0] || num_cpus < 1 || num_cpus > MAX_CPUS){result = FAIL;}
+	for(i = 0; i < num_cpus; i++){
+		if(!cpus[i].online || cpus[i].id != i || cpus[i].pd[1].val != pd[1].val){result = FAIL;}
+		if(i > 0 && (!cpu_tss_desc_ptr[i - 1].present || cpus[i].pd == pd || cpus[i].tss == &tss)){result = FAIL;}
+		for(j = 0; j < i; j++){
+			if(cpus[j].apic_id == cpus[i].apic_id && num_cpus > 1){result = FAIL;}
+		}
+	}
+	TEST_OUTPUT("smp_cpu_test", result);
+}
+
+/* 
+ *   lock_test()
+ *   DESCRIPTION: Takes a spinlock and a mutex nobody else uses and checks the tickets, the counters and that
+ *   spin_unlock_irqrestore puts the interrupt flag back the way it was, on or off
+ *   INPUTS: NONE
+ *   OUTPUTS: NONE
+ *   SIDE EFFECTS: NONE
+ */
+void lock_test(){
+	TEST_HEADER;
+	static spinlock_t lock;
+	static mutex_t m;
+	uint32_t outer, flags, after;
+	int result = PASS;
+	int i;
+
+	spin_init(&lock, NULL);
+	mutex_init(&m, NULL);
+	cli_and_save(outer);
+	for(i = 0; i < 2; i++){
+		/* first pass with interrupts off, second with them on */
+		if(i == 1){sti();}
+		spin_lock_irqsave(&lock, flags);
+		if(lock.next != lock.owner + 1){result = FAIL;}
+		spin_unlock_irqrestore(&lock, flags);
+		cli_and_save(after);
+		if((after & 0x200) != (flags & 0x200) || lock.next != lock.owner){result = FAIL;}
+	}
+	restore_flags(outer);
+	if(lock.stat.acquired != 2 || lock.stat.contended != 0){result = FAIL;}
+
+	mutex_lock(&m);
+	if(!m.held || m.owner != this_cpu()->pid){result = FAIL;}
+	mutex_unlock(&m);
+	if(m.held || m.stat.acquired != 1 || m.stat.contended != 0){result = FAIL;}
+	TEST_OUTPUT("lock_test", result);
+}
+
+/* 
+ *   kstack_test()
+ *   DESCRIPTION: Checks that the kernel stack slots tile down from END_KERNEL without overlapping, and paints
+ *   the stack of a free pid slot to see the high water mark follow a write into it
+ *   INPUTS: NONE
+ *   OUTPUTS: NONE
+ *   SIDE EFFECTS: paints the stack of the last pid slot if it is free
+ */
+void kstack_test(){
+	TEST_HEADER;
+	int result = PASS;
+	int32_t pid = MAX_PROCESSES - 1;
+	int i;
+
+	if(KSLOT(-1) + KSLOT_SIZE != END_KERNEL){result = FAIL;}
+	for(i = 0; i < MAX_PROCESSES; i++){
+		if(KSLOT(i) + KSLOT_SIZE != KSLOT(i - 1)){result = FAIL;}
+		if((uint32_t)PCB_ADDR(i) != KSTACK_TOP(i) || KSTACK_TOP(i) - KSTACK_LOW(i) != KSTACK_SIZE){result = FAIL;}
+	}
+
+	if(!available_process[pid]){
+		kstack_paint(pid);
+		if(kstack_used(pid) != 0){result = FAIL;}
+		*(uint32_t*)(KSTACK_TOP(pid) - 100) = 0;
+		if(kstack_used(pid) != 100){result = FAIL;}
+		*(uint32_t*)KSTACK_LOW(pid) = 0;
+		if(kstack_used(pid) != KSTACK_SIZE){result = FAIL;}
+	}
+	TEST_OUTPUT("kstack_test", result);
+}
+
+/* 
+ *   user_slot_setup()
+ *   DESCRIPTION: Gives a free pid slot an empty directory and makes it this cpu's process, for the tests
+ *   that run user memory code before any process does
+ *   INPUTS: pid -- slot to use, old_pid -- where to keep this cpu's pid for user_slot_teardown
+ *   OUTPUTS: 0, -1 if the slot is in use
+ *   SIDE EFFECTS: switches this cpu to the slot's directory
+ */
+static int32_t user_slot_setup(int32_t pid, int32_t* old_pid){
+	cpu_t* cpu = this_cpu();
+
+	if(available_process[pid]){return -1;}
+	page_dir_create(pid);
+	program_paging(pid);
+	*old_pid = cpu->pid;
+	cpu->pid = pid;
+	return 0;
+}
+
+/* 
+ *   user_slot_teardown()
+ *   DESCRIPTION: Gives back the user pages of a slot from user_slot_setup and puts this cpu back on pd
+ *   INPUTS: pid -- slot to release, old_pid -- pid user_slot_setup kept
+ *   OUTPUTS: NONE
+ *   SIDE EFFECTS: switches this cpu back to pd
+ */
+static void user_slot_teardown(int32_t pid, int32_t old_pid){
+	cpu_t* cpu = this_cpu();
+
+	page_release(pid);
+	cpu->pid = old_pid;
+	cpu->pd = pd;
+	page_setup_paging();
+}
+
+/* 
+ *   user_page_test()
+ *   DESCRIPTION: Gives a free pid slot a directory and a few user pages, checks they are zeroed, counted and
+ *   seen by page_user_ok, and that releasing them takes them out again and forces the next switch to it to
+ *   load CR3. Runs before any process does
+ *   INPUTS: NONE
+ *   OUTPUTS: NONE
+ *   SIDE EFFECTS: switches this cpu to the slot's directory and back to pd
+ */
+void user_page_test(){
+	TEST_HEADER;
+	int result = PASS;
+	int32_t pid = MAX_PROCESSES - 1;
+	cpu_t* cpu = this_cpu();
+	int32_t old_pid;
+	uint32_t kept, full;
+
+	if(user_slot_setup(pid, &old_pid) != 0){
+		TEST_SKIP("user_page_test", "pid slot in use");
+		return;
+	}
+	if(page_map_user(pid, PROG_IMAGE_ADDRESS, 2) != 0 || page_user_pages(pid) != 2){result = FAIL;}
+	if(*(uint32_t*)(PROG_IMAGE_ADDRESS + FOUR_KB_SIZE) != 0){result = FAIL;}
+	if(!page_user_ok((void*)PROG_IMAGE_ADDRESS, 2 * FOUR_KB_SIZE)){result = FAIL;}
+	if(page_user_ok((void*)PROG_IMAGE_ADDRESS, 2 * FOUR_KB_SIZE + 1)){result = FAIL;}
+	if(page_map_user(pid, USER_SPACE + USER_SPACE_SIZE, 1) != -1){result = FAIL;}
+	/* a switch back to the loaded directory keeps the TLB, one whose mappings were released does not */
+	kept = cpu->tlb_kept;
+	full = cpu->tlb_full;
+	program_paging(pid);
+	if(cpu->tlb_kept != kept + 1 || cpu->tlb_full != full){result = FAIL;}
+	page_release(pid);
+	if(page_user_pages(pid) != 0 || page_user_ok((void*)PROG_IMAGE_ADDRESS, 1)){result = FAIL;}
+	program_paging(pid);
+	if(cpu->tlb_kept != kept + 1 || cpu->tlb_full != full + 2){result = FAIL;}
+	user_slot_teardown(pid, old_pid);
+	TEST_OUTPUT("user_page_test", result);
+}
+
+/* 
+ *   cow_test()
+ *   DESCRIPTION: Forks the address space of one free pid slot into another and writes the shared page from
+ *   both sides, through the kernel's own CR0.WP faults: the first writer gets a copy, the second is left the
+ *   only user of the old frame and writes it in place. Runs before any process does
+ *   INPUTS: NONE
+ *   OUTPUTS: NONE
+ *   SIDE EFFECTS: switches this cpu to the slots' directories and back to pd
+ */
+void cow_test(){
+	TEST_HEADER;
+	int result = PASS;
+	int32_t parent = MAX_PROCESSES - 2;
+	int32_t child = MAX_PROCESSES - 1;
+	cpu_t* cpu = this_cpu();
+	int32_t old_pid;
+	volatile uint32_t* word = (uint32_t*)PROG_IMAGE_ADDRESS;
+
+	if(available_process[child] || user_slot_setup(parent, &old_pid) != 0){
+		TEST_SKIP("cow_test", "pid slot in use");
+		return;
+	}
+	if(page_map_user(parent, PROG_IMAGE_ADDRESS, 1) != 0){result = FAIL;}
+	*word = 1;
+	page_fork(parent, child);
+	if(page_user_pages(child) != 1){result = FAIL;}
+	/* the parent's page is read only now, its write faults and gets a copy */
+	*word = 2;
+	program_paging(child);
+	cpu->pid = child;
+	if(*word != 1){result = FAIL;}
+	*word = 3;
+	program_paging(parent);
+	cpu->pid = parent;
+	if(*word != 2){result = FAIL;}
+	page_release(child);
+	user_slot_teardown(parent, old_pid);
+	TEST_OUTPUT("cow_test", result);
+}
+
+/* 
+ *   heap_test()
+ *   DESCRIPTION: Grows a free pid slot's heap with sbrk and maps a run with mmap, checks neither takes a frame
+ *   before its first touch and that page_user_ok already takes them, then gives both back. Runs before any
+ *   process does
+ *   INPUTS: NONE
+ *   OUTPUTS: NONE
+ *   SIDE EFFECTS: switches this cpu to the slot's directory and back to pd
+ */
+void heap_test(){
+	TEST_HEADER;
+	int result = PASS;
+	int32_t pid = MAX_PROCESSES - 1;
+	int32_t old_pid;
+	uint32_t heap = PROG_IMAGE_ADDRESS + FOUR_KB_SIZE;
+	int32_t map;
+
+	if(user_slot_setup(pid, &old_pid) != 0){
+		TEST_SKIP("heap_test", "pid slot in use");
+		return;
+	}
+	if(page_map_user(pid, PROG_IMAGE_ADDRESS, 1) != 0){result = FAIL;}
+	page_heap_init(pid, PROG_IMAGE_ADDRESS + 100);
+	if(sbrk(3 * FOUR_KB_SIZE) != (int32_t)heap || sbrk(0) != (int32_t)(heap + 3 * FOUR_KB_SIZE)){result = FAIL;}
+	if(page_user_pages(pid) != 1 || !page_user_ok((void*)heap, 3 * FOUR_KB_SIZE)){result = FAIL;}
+	/* the first touch backs the page with zeroes */
+	if(*(volatile uint32_t*)(heap + FOUR_KB_SIZE) != 0 || page_user_pages(pid) != 2){result = FAIL;}
+	map = mmap(2 * FOUR_KB_SIZE);
+	if(map == -1 || (uint32_t)map < heap + 3 * FOUR_KB_SIZE || map + 2 * FOUR_KB_SIZE > USER_MMAP_TOP){result = FAIL;}
+	if(map != -1){
+		*(volatile uint32_t*)map = 7;
+		if(page_user_pages(pid) != 3 || munmap((void*)map, 2 * FOUR_KB_SIZE) != 0 || page_user_pages(pid) != 2){result = FAIL;}
+	}
+	/* the heap cannot shrink below its start, nor munmap reach into it */
+	if(sbrk(-4 * FOUR_KB_SIZE) != -1 || munmap((void*)heap, FOUR_KB_SIZE) != -1){result = FAIL;}
+	if(sbrk(-3 * FOUR_KB_SIZE) != (int32_t)(heap + 3 * FOUR_KB_SIZE) || page_user_pages(pid) != 1){result = FAIL;}
+	user_slot_teardown(pid, old_pid);
+	TEST_OUTPUT("heap_test", result);
+}
+
+/*************************************** Benchmarks ***************************************/
+
+#define BENCH_PASSES 10
+#define BENCH_CHUNK 1024
+
+/* 
+ *   bench_rate()
+ *   DESCRIPTION: Turns a count done in some TSC cycles into a rate with the calibrated TSC frequency
+ *   INPUTS: count -- things done, cycles -- TSC cycles they took
+ *   OUTPUTS: count per second
+ *   SIDE EFFECTS: none
+ */
+static uint32_t bench_rate(uint32_t count, uint32_t cycles){
+	uint32_t rem;
+
+	if(cycles == 0){
+		return 0;
+	}
+	return div64_32((uint64_t)count * clock_tsc_khz() * 1000, cycles, &rem);
+}
+
+/* 
+ *   bench_cat_large()
+ *   DESCRIPTION: Does what cat does with verylargetextwithverylongname.txt (1 KB reads written to the
+ *   terminal) BENCH_PASSES times, first through terminal_write and then with the old putc per character
+ *   loop, and prints the characters per second of each and the TSC cycles per character
+ *   INPUTS: NONE
+ *   OUTPUTS: NONE
+ *   SIDE EFFECTS: prints the file to the console 2 * BENCH_PASSES times
+ */
+void bench_cat_large(){
+	dentry_t dentry;
+	uint8_t buf[BENCH_CHUNK];
+	uint32_t offset, chars, start, write_cycles, putc_cycles;
+	int32_t cnt, pass, i;
+
+	if(read_dentry_by_name((const uint8_t*)"verylargetextwithverylongname.tx", &dentry) == -1){
+		TEST_OUTPUT("bench_cat_large", FAIL);
+		return;
+	}
+
+	/* batched write path, one terminal_write per chunk like cat */
+	chars = 0;
+	start = (uint32_t)rdtsc();
+	for(pass = 0; pass < BENCH_PASSES; pass++){
+		offset = 0;
+		while((cnt = read_data(dentry.inode_n, offset, buf, BENCH_CHUNK)) > 0){
+			terminal_write(1, buf, cnt);
+			offset += cnt;
+			chars += cnt;
+		}
+	}
+	write_cycles = (uint32_t)rdtsc() - start;
+
+	/* the same output one putc at a time */
+	start = (uint32_t)rdtsc();
+	for(pass = 0; pass < BENCH_PASSES; pass++){
+		offset = 0;
+		while((cnt = read_data(dentry.inode_n, offset, buf, BENCH_CHUNK)) > 0){
+			for(i = 0; i < cnt; i++){
+				if(buf[i] != '\0'){
+					putc(buf[i]);
+				}
+			}
+			offset += cnt;
+		}
+	}
+	putc_cycles = (uint32_t)rdtsc() - start;
+
+	printf("cat bench: %u chars, terminal_write %u chars/s (%u cycles/char), putc %u chars/s (%u cycles/char)\n",
+		chars, bench_rate(chars, write_cycles), write_cycles / chars,
+		bench_rate(chars, putc_cycles), putc_cycles / chars);
+	TEST_OUTPUT("bench_cat_large", PASS);
+}
+
 
 /* Test suite entry point */
 void launch_tests(){
@@ -1017,4 +1438,17 @@ void launch_tests(){
 	// read_none();
 	// read_by_parts();
 	// read_null();
+
+	// TERMINAL TESTS
+	// tty_line_test();
+	// timer_wheel_test();
+	// smp_cpu_test();
+	// lock_test();
+	// kstack_test();
+	// user_page_test();
+	// cow_test();
+	// heap_test();
+
+	// BENCHMARKS
+	// bench_cat_large();
 }
@@ -61,4 +61,24 @@ void read_by_parts();
 // checks if null is valid or not
 void read_null();
 
+// types a few lines into terminal 1's line discipline and reads them back
+void tty_line_test();
+// arms and cancels timers across the first two wheel levels and checks when they fire
+void timer_wheel_test();
+// checks the per cpu TSS, directory and APIC id of every cpu that came up
+void smp_cpu_test();
+// takes a spinlock with interrupts off and on and a mutex, and checks the flag and counters after
+void lock_test();
+// checks the kernel stack slots do not overlap and the high water mark of a free one
+void kstack_test();
+// maps a few user pages for a free pid slot and checks they are zeroed, counted and released
+void user_page_test();
+// forks one free pid slot's address space into another and checks copy on write from both sides
+void cow_test();
+// grows a free pid slot's heap and mmaps a run, and checks no frame is taken before the first touch
+void heap_test();
+
+// times cat of the large text file through terminal_write and through putc
+void bench_cat_large();
+
 #endif /* TESTS_H */
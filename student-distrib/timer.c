@@ -0,0 +1,483 @@
+#include "timer.h"
+#include "clock.h"
+#include "lib.h"
+#include "i8259.h"
+#include "klog.h"
+#include "system_calls.h"
+#include "smp.h"
+#include "sched.h"
+
+/* ticks since timer_init, advanced by the interrupt */
+static volatile uint32_t ticks = 0;
+/* next tick the wheel has to run, only behind ticks inside timer_handler */
+static uint32_t wheel_ticks = 0;
+
+/* set while idle with the periodic tick stopped, and the tick count and clock when it was stopped */
+static int32_t tickless = 0;
+static uint32_t idle_ticks;
+static uint32_t idle_ms;
+
+static ktimer_t* tv1[TVR_SIZE];
+static ktimer_t* tvn[TVN_LEVELS][TVN_SIZE];
+
+/* one alarm per process slot, and whether it went off without a sleep to end */
+static ktimer_t alarm_timer[MAX_PROCESSES];
+static volatile int32_t alarm_pending[MAX_PROCESSES];
+
+static void alarm_fire(uint32_t pid);
+
+/*
+ *   timer_link
+ *   DESCRIPTION: Puts a timer into the slot its expiry falls in, relative to the tick the wheel runs next.
+ *   Anything already due goes in the slot that runs next
+ *   INPUTS: t -- timer that is not pending
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller has interrupts off
+ */
+static void timer_link(ktimer_t* t){
+    uint32_t idx = t->expires - wheel_ticks;
+    ktimer_t** slot;
+    int32_t level;
+
+    if((int32_t)idx < 0){
+        slot = &tv1[wheel_ticks & TVR_MASK];
+    }else if(idx < TVR_SIZE){
+        slot = &tv1[t->expires & TVR_MASK];
+    }else{
+        /* the last level takes whatever is left, so the loop stops one short of it */
+        for(level = 0; level < TVN_LEVELS - 1; level++){
+            if(idx < (1U << (TVR_BITS + (level + 1) * TVN_BITS))){
+                break;
+            }
+        }
+        slot = &tvn[level][(t->expires >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK];
+    }
+
+    t->next = *slot;
+    if(t->next != NULL){
+        t->next->pprev = &t->next;
+    }
+    *slot = t;
+    t->pprev = slot;
+}
+
+/*
+ *   timer_unlink
+ *   DESCRIPTION: Takes a pending timer out of its slot
+ *   INPUTS: t -- pending timer
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller has interrupts off
+ */
+static void timer_unlink(ktimer_t* t){
+    *t->pprev = t->next;
+    if(t->next != NULL){
+        t->next->pprev = t->pprev;
+    }
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/*
+ *   timer_cascade
+ *   DESCRIPTION: Empties one slot of an upper level back into the wheel. Everything in it expires within the
+ *   range of the levels below now, so each timer drops at least one level
+ *   INPUTS: level -- index into tvn, index -- slot
+ *   OUTPUTS: index, so the caller knows whether this level wrapped too
+ *   SIDE EFFECTS: caller has interrupts off
+ */
+static uint32_t timer_cascade(int32_t level, uint32_t index){
+    ktimer_t* t = tvn[level][index];
+    ktimer_t* next;
+
+    tvn[level][index] = NULL;
+    while(t != NULL){
+        next = t->next;
+        timer_link(t);
+        t = next;
+    }
+    return index;
+}
+
+/*
+ *   timer_run
+ *   DESCRIPTION: Brings the wheel up to the current tick, firing every timer in the slots it passes. A slot
+ *   is detached before its timers run so a callback can re-arm itself without being run twice
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: calls timer callbacks, interrupts are off
+ */
+static void timer_run(void){
+    uint32_t index;
+    int32_t level;
+    ktimer_t* t;
+
+    while((int32_t)(ticks - wheel_ticks) >= 0){
+        index = wheel_ticks & TVR_MASK;
+        /* the first level wrapped, refill it from the next one, and so on up while levels keep wrapping */
+        if(index == 0){
+            for(level = 0; level < TVN_LEVELS; level++){
+                if(timer_cascade(level, (wheel_ticks >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK) != 0){
+                    break;
+                }
+            }
+        }
+        wheel_ticks++;
+
+        while((t = tv1[index]) != NULL){
+            timer_unlink(t);
+            t->fn(t->data);
+        }
+    }
+}
+
+/*
+ *   timer_next_event
+ *   DESCRIPTION: How far ahead the wheel next has work. Only the first level is searched, a timer in an upper
+ *   level only bounds the answer by the next time the first level wraps, where it gets cascaded closer
+ *   INPUTS: none
+ *   OUTPUTS: ticks from now until the wheel must run, TIMER_NONE if no timer is pending
+ *   SIDE EFFECTS: caller has interrupts off
+ */
+static uint32_t timer_next_event(void){
+    uint32_t i;
+    int32_t level;
+    int32_t upper = 0;
+
+    for(level = 0; level < TVN_LEVELS && !upper; level++){
+        for(i = 0; i < TVN_SIZE; i++){
+            if(tvn[level][i] != NULL){
+                upper = 1;
+                break;
+            }
+        }
+    }
+    for(i = 0; i < TVR_SIZE; i++){
+        if(tv1[(wheel_ticks + i) & TVR_MASK] != NULL || (upper && ((wheel_ticks + i) & TVR_MASK) == 0)){
+            return wheel_ticks + i - ticks;
+        }
+    }
+    return upper ? TVR_SIZE : TIMER_NONE;
+}
+
+/*
+ *   pit_periodic
+ *   DESCRIPTION: Puts PIT channel 0 back to ticking at TIMER_HZ
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+static void pit_periodic(void){
+    uint32_t divisor = (PIT_HZ + TIMER_HZ / 2) / TIMER_HZ;
+
+    outb(PIT_CH0_RATE, PIT_COMMAND);
+    outb(divisor & 0xFF, PIT_CHANNEL0);
+    outb((divisor >> 8) & 0xFF, PIT_CHANNEL0);
+}
+
+/*
+ *   pit_oneshot
+ *   DESCRIPTION: Makes PIT channel 0 interrupt once after ms milliseconds and then stay quiet
+ *   INPUTS: ms -- at most PIT_ONESHOT_MAX_MS
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+static void pit_oneshot(uint32_t ms){
+    uint32_t count = ms * ((PIT_HZ + TIMER_HZ / 2) / TIMER_HZ);
+
+    outb(PIT_CH0_ONESHOT, PIT_COMMAND);
+    outb(count & 0xFF, PIT_CHANNEL0);
+    outb((count >> 8) & 0xFF, PIT_CHANNEL0);
+}
+
+/*
+ *   timer_init
+ *   DESCRIPTION: Starts PIT channel 0 at TIMER_HZ and unmasks its interrupt
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: IRQ0 starts firing once interrupts are on
+ */
+void timer_init(void){
+    int32_t i;
+
+    for(i = 0; i < MAX_PROCESSES; i++){
+        timer_setup(&alarm_timer[i], alarm_fire, i);
+        alarm_pending[i] = 0;
+    }
+    pit_periodic();
+    enable_irq(TIMER_IRQ);
+    klog(KLOG_INFO, "timer: %u Hz tick, stopped when idle", TIMER_HZ);
+}
+
+/*
+ *   timer_handler
+ *   DESCRIPTION: IRQ0, counts the tick and runs whatever timers are due. In idle the interrupt is the one-shot
+ *   going off, which brings the tick back. Console writes left unflushed by single putc calls are drawn here.
+ *   Every SCHED_SLICE_MS the tasks sharing a cpu take turns
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: timer callbacks run before the EOI, with interrupts off. May switch tasks after the EOI
+ */
+void timer_handler(void){
+    if(tickless){
+        timer_resume();
+    }else{
+        ticks++;
+        timer_run();
+    }
+    if(console_dirty()){
+        console_flush();
+    }
+    send_eoi(TIMER_IRQ);
+    if(ticks % SCHED_SLICE_MS == 0){
+        sched_tick();
+    }else{
+        //a task woken on this cpu may outrank the one running, it need not wait for the next slice
+        sched_preempt();
+    }
+}
+
+/*
+ *   timer_resume
+ *   DESCRIPTION: Restarts the periodic tick after idle. The ticks missed are counted from the TSC clock and
+ *   everything that came due meanwhile is run. Called by whatever interrupt ends the idle
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: caller has interrupts off, does nothing if the tick is running
+ */
+void timer_resume(void){
+    if(!tickless){
+        return;
+    }
+    tickless = 0;
+    ticks = idle_ticks + (clock_ms() - idle_ms);
+    pit_periodic();
+    enable_irq(TIMER_IRQ);
+    timer_run();
+}
+
+/*
+ *   timer_now
+ *   DESCRIPTION: Current tick. While the boot cpu idles without the tick, another cpu arming a timer counts
+ *   the ticks missed so far from the TSC clock, the way timer_resume will
+ *   INPUTS: none
+ *   OUTPUTS: tick count
+ *   SIDE EFFECTS: caller has interrupts off
+ */
+static uint32_t timer_now(void){
+    if(tickless){
+        return idle_ticks + (clock_ms() - idle_ms);
+    }
+    return ticks;
+}
+
+/*
+ *   timer_ticks
+ *   DESCRIPTION: Ticks since timer_init, which are milliseconds at TIMER_HZ 1000
+ *   INPUTS: none
+ *   OUTPUTS: tick count
+ *   SIDE EFFECTS: none
+ */
+uint32_t timer_ticks(void){
+    return ticks;
+}
+
+/*
+ *   timer_setup
+ *   DESCRIPTION: Fills in a timer that is not pending. Must be called once before the first timer_add
+ *   INPUTS: t -- timer, fn -- what to call when it expires, data -- passed to fn
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void timer_setup(ktimer_t* t, void (*fn)(uint32_t data), uint32_t data){
+    t->next = NULL;
+    t->pprev = NULL;
+    t->expires = 0;
+    t->fn = fn;
+    t->data = data;
+}
+
+/*
+ *   timer_add
+ *   DESCRIPTION: Arms a timer to fire after at least ms milliseconds, moving it if it was already pending.
+ *   The tick in progress is only partly left, so one more tick is waited for
+ *   INPUTS: t -- timer set up with timer_setup, ms -- delay, capped at TIMER_MAX_MS
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void timer_add(ktimer_t* t, uint32_t ms){
+    uint32_t flags;
+
+    if(ms > TIMER_MAX_MS){
+        ms = TIMER_MAX_MS;
+    }
+    cli_and_save(flags);
+    if(t->pprev != NULL){
+        timer_unlink(t);
+    }
+    t->expires = timer_now() + ms + 1;
+    timer_link(t);
+    /* the boot cpu may be idle with the tick set for a later timer, make it look again */
+    if(tickless){
+        smp_kick(0);
+    }
+    restore_flags(flags);
+}
+
+/*
+ *   timer_del
+ *   DESCRIPTION: Disarms a timer
+ *   INPUTS: t -- timer
+ *   OUTPUTS: 1 if it was pending, 0 if it had fired or was never armed
+ *   SIDE EFFECTS: none
+ */
+int32_t timer_del(ktimer_t* t){
+    uint32_t flags;
+    int32_t pending;
+
+    cli_and_save(flags);
+    pending = (t->pprev != NULL);
+    if(pending){
+        timer_unlink(t);
+    }
+    restore_flags(flags);
+    return pending;
+}
+
+/*
+ *   timer_remaining
+ *   DESCRIPTION: Time left on a timer
+ *   INPUTS: t -- timer
+ *   OUTPUTS: milliseconds until it fires, 0 if it is not pending
+ *   SIDE EFFECTS: none
+ */
+uint32_t timer_remaining(ktimer_t* t){
+    uint32_t flags;
+    uint32_t left = 0;
+
+    cli_and_save(flags);
+    if(t->pprev != NULL && (int32_t)(t->expires - timer_now()) > 0){
+        left = t->expires - timer_now();
+    }
+    restore_flags(flags);
+    return left;
+}
+
+/*
+ *   timer_idle
+ *   DESCRIPTION: Waits for the next interrupt, from the boot cpu's idle loop. Called with interrupts off after
+ *   checking there is nothing to run. Unless a timer is due on the next tick or some cpu has tasks taking turns,
+ *   the periodic tick is stopped first: the PIT is set to go off once when the next timer is due (or the most it
+ *   can count), or is stopped and masked when no timer is pending
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: returns with interrupts off and the tick running again, drops the kernel lock while halted
+ */
+void timer_idle(void){
+    uint32_t next;
+
+    if(console_dirty()){
+        console_flush();
+    }
+    next = timer_next_event();
+    if(!tickless && next > 1 && !sched_need_tick()){
+        tickless = 1;
+        idle_ticks = ticks;
+        idle_ms = clock_ms();
+        if(next == TIMER_NONE){
+            outb(PIT_CH0_ONESHOT, PIT_COMMAND);
+            disable_irq(TIMER_IRQ);
+        }else{
+            pit_oneshot(next > PIT_ONESHOT_MAX_MS ? PIT_ONESHOT_MAX_MS : next);
+        }
+    }
+    cpu_halt();
+    timer_resume();
+}
+
+/*
+ *   alarm_fire
+ *   DESCRIPTION: Alarm timer callback. There is no signal delivery, so ALARM is only marked pending, which
+ *   ends a sleep in progress or the next one
+ *   INPUTS: pid -- process the alarm belongs to
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+static void alarm_fire(uint32_t pid){
+    alarm_pending[pid] = 1;
+    sched_wake_all();
+}
+
+/*
+ *   sleep_wake
+ *   DESCRIPTION: Sleep and read timeout callback
+ *   INPUTS: flag -- address of the flag to set
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+static void sleep_wake(uint32_t flag){
+    *(volatile int32_t*)flag = 1;
+    sched_wake_all();
+}
+
+/*
+ *   timer_release
+ *   DESCRIPTION: Cancels the alarm of a process that is halting
+ *   INPUTS: pid -- process
+ *   OUTPUTS: none
+ *   SIDE EFFECTS: none
+ */
+void timer_release(int32_t pid){
+    if(pid < 0 || pid >= MAX_PROCESSES){
+        return;
+    }
+    timer_del(&alarm_timer[pid]);
+    alarm_pending[pid] = 0;
+}
+
+/*
+ *   sleep(uint32_t ms)
+ *   DESCRIPTION: System call, waits ms milliseconds while the cpu runs other tasks or idles. A pending ALARM ends
+ *   the sleep early and is used up by it
+ *   INPUTS: ms -- how long to sleep
+ *   OUTPUTS: 0 when the whole time was slept, otherwise the milliseconds that were left
+ *   SIDE EFFECTS: none
+ */
+int32_t sleep(uint32_t ms){
+    int32_t pid = this_cpu()->pid;
+    volatile int32_t done = 0;
+    ktimer_t t;
+    uint32_t flags;
+    uint32_t left;
+
+    timer_setup(&t, sleep_wake, (uint32_t)&done);
+    cli_and_save(flags);
+    timer_add(&t, ms);
+    while(!done && !alarm_pending[pid]){
+        sched_wait();
+    }
+    left = timer_remaining(&t);
+    timer_del(&t);
+    alarm_pending[pid] = 0;
+    restore_flags(flags);
+    return left;
+}
+
+/*
+ *   alarm(uint32_t ms)
+ *   DESCRIPTION: System call, sets the alarm of the calling process to go off in ms milliseconds, replacing
+ *   the one already set. 0 only cancels it
+ *   INPUTS: ms -- delay
+ *   OUTPUTS: milliseconds that were left on the previous alarm, 0 if there was none
+ *   SIDE EFFECTS: none
+ */
+int32_t alarm(uint32_t ms){
+    ktimer_t* t = &alarm_timer[this_cpu()->pid];
+    uint32_t left = timer_remaining(t);
+
+    if(ms == 0){
+        timer_del(t);
+    }else{
+        timer_add(t, ms);
+    }
+    return left;
+}
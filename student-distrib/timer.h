@@ -0,0 +1,54 @@
+#ifndef _X_TIMER_H
+#define _X_TIMER_H
+
+#include "types.h"
+
+/* PIT channel 0 drives the tick, one tick per millisecond so timer expiries are counted in ms */
+#define TIMER_HZ            1000
+#define PIT_CHANNEL0        0x40
+#define PIT_CH0_RATE        0x34    //channel 0, low then high byte, mode 2
+#define PIT_CH0_ONESHOT     0x30    //channel 0, low then high byte, mode 0, stops until a count is written
+#define PIT_ONESHOT_MAX_MS  54      //the 16 bit count runs out after 54.9ms
+#define TIMER_IRQ           0
+
+/*
+ * Hierarchical wheel: the first level has a slot for each of the next 256 ticks, each further level
+ * has 64 slots covering 64 times the range of the one below. Together they cover all 32 bits of tick
+ * count. A timer is put straight into its slot, and moved down a level when the wheel below wraps
+ */
+#define TVR_BITS            8
+#define TVN_BITS            6
+#define TVR_SIZE            (1 << TVR_BITS)
+#define TVN_SIZE            (1 << TVN_BITS)
+#define TVR_MASK            (TVR_SIZE - 1)
+#define TVN_MASK            (TVN_SIZE - 1)
+#define TVN_LEVELS          4
+
+/* timer_next_event when nothing is pending */
+#define TIMER_NONE          0xFFFFFFFF
+
+/* longest wait accepted, keeps expiry comparisons on the right side of a 32 bit wrap */
+#define TIMER_MAX_MS        0x3FFFFFFF
+
+typedef struct ktimer {
+    struct ktimer* next;
+    struct ktimer** pprev;          //link pointing at us, NULL when the timer is not pending
+    uint32_t expires;               //tick to fire on
+    void (*fn)(uint32_t data);      //called from the tick interrupt with interrupts off
+    uint32_t data;
+} ktimer_t;
+
+void timer_init(void);
+void timer_handler(void);
+uint32_t timer_ticks(void);
+void timer_setup(ktimer_t* t, void (*fn)(uint32_t data), uint32_t data);
+void timer_add(ktimer_t* t, uint32_t ms);
+int32_t timer_del(ktimer_t* t);
+uint32_t timer_remaining(ktimer_t* t);
+void timer_idle(void);
+void timer_resume(void);
+void timer_release(int32_t pid);
+int32_t sleep(uint32_t ms);
+int32_t alarm(uint32_t ms);
+
+#endif
@@ -0,0 +1,331 @@
+#include "tty.h"
+#include "keyboard.h"
+#include "timer.h"
+#include "sched.h"
+
+/* one line discipline per terminal, 0 for indexing */
+static tty_t ttys[NUM_TERMINALS + 1];
+
+/* 
+ *   tty_init
+ *   DESCRIPTION: Empties the edit buffer and input queue of every terminal
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   Return: none
+ */
+void tty_init(void){
+    int8_t name[LOCK_NAME_LEN];
+    int32_t t;
+    for(t = 1; t <= NUM_TERMINALS; t++){
+        snprintf(name, LOCK_NAME_LEN, "tty%d", t);
+        spin_init(&ttys[t].lock, name);
+        ttys[t].terminal = t;
+        ttys[t].edit_len = 0;
+        ttys[t].q_head = 0;
+        ttys[t].q_count = 0;
+        ttys[t].lines = 0;
+        ttys[t].mode.raw = 0;
+        ttys[t].mode.min = 1;
+        ttys[t].mode.timeout = 0;
+        ttys[t].owner = -1;
+    }
+}
+
+/* 
+ *   tty_get
+ *   DESCRIPTION: Looks up the line discipline of a terminal
+ *   INPUTS: terminal -- terminal number (1 - NUM_TERMINALS)
+ *   OUTPUTS: none
+ *   Return: the terminal's tty, or NULL for a bad terminal number
+ */
+tty_t* tty_get(int32_t terminal){
+    if(terminal < 1 || terminal > NUM_TERMINALS){
+        return NULL;
+    }
+    return &ttys[terminal];
+}
+
+/* 
+ *   tty_echo
+ *   DESCRIPTION: Prints typed characters on the console of the tty, which need not be the one being written to
+ *   INPUTS: tty -- terminal typed on, c -- character to print, count -- how many times to print it
+ *   OUTPUTS: none
+ *   Return: none
+ */
+static void tty_echo(tty_t* tty, uint8_t c, int32_t count){
+    int32_t prev = console_select(tty->terminal);
+    while(count-- > 0){
+        putc(c);
+    }
+    console_select(prev);
+}
+
+/* 
+ *   tty_queue_line
+ *   DESCRIPTION: Moves the edited line and its newline to the input queue and wakes up readers. The line is
+ *   dropped if the queue has no room for it
+ *   INPUTS: tty -- terminal the line was typed on
+ *   OUTPUTS: none
+ *   Return: none
+ */
+static void tty_queue_line(tty_t* tty){
+    int32_t i;
+    int32_t tail;
+
+    tty->edit[tty->edit_len++] = '\n';
+    if(tty->q_count + tty->edit_len <= TTY_QUEUE_SIZE){
+        tail = (tty->q_head + tty->q_count) % TTY_QUEUE_SIZE;
+        for(i = 0; i < tty->edit_len; i++){
+            tty->queue[tail] = tty->edit[i];
+            tail = (tail + 1) % TTY_QUEUE_SIZE;
+        }
+        tty->q_count += tty->edit_len;
+        tty->lines++;
+    }
+    tty->edit_len = 0;
+}
+
+/* 
+ *   tty_raw_input
+ *   DESCRIPTION: Raw mode, the byte goes straight to the input queue without echo. Dropped if the queue is full
+ *   INPUTS: tty -- terminal typed on, c -- byte to queue
+ *   OUTPUTS: none
+ *   Return: none
+ */
+static void tty_raw_input(tty_t* tty, uint8_t c){
+    if(tty->q_count < TTY_QUEUE_SIZE){
+        tty->queue[(tty->q_head + tty->q_count) % TTY_QUEUE_SIZE] = c;
+        tty->q_count++;
+    }
+}
+
+/* 
+ *   tty_input
+ *   DESCRIPTION: Canonical mode line editing for one typed character. Backspace removes the last character,
+ *   tab adds up to TTY_TAB_WIDTH spaces, enter completes the line. Only characters that went into the line are
+ *   echoed, one spot is always kept free for the newline
+ *   INPUTS: tty -- terminal typed on, c -- translated character
+ *   OUTPUTS: none
+ *   Return: none
+ */
+void tty_input(tty_t* tty, uint8_t c){
+    uint32_t flags;
+    int32_t count;
+
+    spin_lock_irqsave(&tty->lock, flags);
+    if(tty->mode.raw){
+        tty_raw_input(tty, c);
+        spin_unlock_irqrestore(&tty->lock, flags);
+        return;
+    }
+
+    switch(c){
+        case '\0':
+            break;
+        case '\b':
+            if(tty->edit_len > 0){
+                tty->edit_len--;
+                tty_echo(tty, '\b', 1);
+            }
+            break;
+        case '\n':
+            tty_echo(tty, '\n', 1);
+            tty_queue_line(tty);
+            break;
+        case '\t':
+            //only add part of the tab if it is near the end so we do not overflow
+            count = (TTY_LINE_MAX - 1) - tty->edit_len;
+            if(count > TTY_TAB_WIDTH){
+                count = TTY_TAB_WIDTH;
+            }
+            memset(&tty->edit[tty->edit_len], ' ', count);
+            tty->edit_len += count;
+            tty_echo(tty, ' ', count);
+            break;
+        default:
+            if(tty->edit_len < TTY_LINE_MAX - 1){
+                tty->edit[tty->edit_len++] = c;
+                tty_echo(tty, c, 1);
+            }
+            break;
+    }
+    spin_unlock_irqrestore(&tty->lock, flags);
+}
+
+/* 
+ *   tty_clear_screen
+ *   DESCRIPTION: Ctrl+L, clears the console of the tty, redraws the prompt and throws away the line being typed.
+ *   Lines already completed stay queued
+ *   INPUTS: tty -- terminal typed on
+ *   OUTPUTS: none
+ *   Return: none
+ */
+void tty_clear_screen(tty_t* tty){
+    uint32_t flags;
+    int32_t prev;
+
+    spin_lock_irqsave(&tty->lock, flags);
+    prev = console_select(tty->terminal);
+    clearFlag = 1;
+    clear();
+    console_select(prev);
+    tty->edit_len = 0;
+    spin_unlock_irqrestore(&tty->lock, flags);
+}
+
+/* 
+ *   tty_timeout
+ *   DESCRIPTION: Read timeout callback, tells the waiting read to give up
+ *   INPUTS: flag -- address of the read's expired flag
+ *   OUTPUTS: none
+ *   Return: none
+ */
+static void tty_timeout(uint32_t flag){
+    *(volatile int32_t*)flag = 1;
+    sched_wake_all();
+}
+
+/* 
+ *   tty_raw_read
+ *   DESCRIPTION: Raw mode read. Waits until min bytes are queued (1 if min is 0 but there is a timeout) or the
+ *   timeout timer fires, then returns what is queued up to nbytes. With min and timeout both 0 it only polls
+ *   INPUTS: tty -- terminal to read from, buf -- destination, nbytes -- size of buf
+ *   OUTPUTS: none
+ *   Return: number of bytes copied, 0 if the timeout ran out first
+ */
+static int32_t tty_raw_read(tty_t* tty, uint8_t* buf, int32_t nbytes){
+    uint32_t flags;
+    volatile int32_t expired = 0;
+    ktimer_t timeout;
+    int32_t want = tty->mode.min;
+    int32_t n = 0;
+
+    if(want == 0 && tty->mode.timeout != 0){
+        want = 1;
+    }
+    if(want > nbytes){
+        want = nbytes;
+    }
+
+    timer_setup(&timeout, tty_timeout, (uint32_t)&expired);
+    spin_lock_irqsave(&tty->lock, flags);
+    if(tty->mode.timeout != 0){
+        timer_add(&timeout, tty->mode.timeout);
+    }
+    //keyboard interrupts and the timeout both wake us
+    while(tty->q_count < want && !expired){
+        sched_boost();
+        spin_wait(&tty->lock);
+    }
+    timer_del(&timeout);
+
+    while(n < nbytes && tty->q_count > 0){
+        buf[n++] = tty->queue[tty->q_head];
+        tty->q_head = (tty->q_head + 1) % TTY_QUEUE_SIZE;
+        tty->q_count--;
+    }
+    spin_unlock_irqrestore(&tty->lock, flags);
+    return n;
+}
+
+/* 
+ *   tty_read
+ *   DESCRIPTION: Blocks until the tty has a completed line, then copies it out including the newline. A line
+ *   longer than nbytes is returned over several reads. Raw mode is handled by tty_raw_read
+ *   INPUTS: tty -- terminal to read from, buf -- destination, nbytes -- size of buf
+ *   OUTPUTS: none
+ *   Return: number of bytes copied
+ */
+int32_t tty_read(tty_t* tty, uint8_t* buf, int32_t nbytes){
+    uint32_t flags;
+    int32_t n = 0;
+    uint8_t c;
+
+    if(nbytes <= 0){
+        return 0;
+    }
+    if(tty->mode.raw){
+        return tty_raw_read(tty, buf, nbytes);
+    }
+    //typing on other terminals never touches this count, so only our own input wakes us
+    spin_lock_irqsave(&tty->lock, flags);
+    while(tty->lines == 0){
+        if(tty->mode.raw){
+            //switched to raw mode while we waited
+            spin_unlock_irqrestore(&tty->lock, flags);
+            return tty_raw_read(tty, buf, nbytes);
+        }
+        sched_boost();
+        spin_wait(&tty->lock);
+    }
+
+    while(n < nbytes && tty->q_count > 0){
+        c = tty->queue[tty->q_head];
+        tty->q_head = (tty->q_head + 1) % TTY_QUEUE_SIZE;
+        tty->q_count--;
+        buf[n++] = c;
+        if(c == '\n'){
+            tty->lines--;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&tty->lock, flags);
+    return n;
+}
+
+/* 
+ *   tty_set_mode
+ *   DESCRIPTION: Switches the tty between line editing and raw mode. Going raw hands the half typed line to the
+ *   queue as it is, going back to line editing recounts the complete lines in the queue
+ *   INPUTS: tty -- terminal to change, mode -- new mode, pid -- process asking, raw mode is undone when it halts
+ *   OUTPUTS: none
+ *   Return: 0 on success, -1 for a bad mode
+ */
+int32_t tty_set_mode(tty_t* tty, const tty_mode_t* mode, int32_t pid){
+    uint32_t flags;
+    int32_t i;
+
+    if(mode->min < 0 || mode->min > TTY_QUEUE_SIZE || mode->timeout < 0){
+        return -1;
+    }
+
+    spin_lock_irqsave(&tty->lock, flags);
+    if(mode->raw && !tty->mode.raw){
+        for(i = 0; i < tty->edit_len; i++){
+            tty_raw_input(tty, tty->edit[i]);
+        }
+        tty->edit_len = 0;
+    }else if(!mode->raw && tty->mode.raw){
+        tty->lines = 0;
+        for(i = 0; i < tty->q_count; i++){
+            if(tty->queue[(tty->q_head + i) % TTY_QUEUE_SIZE] == '\n'){
+                tty->lines++;
+            }
+        }
+    }
+    tty->mode.raw = (mode->raw != 0);
+    tty->mode.min = mode->min;
+    tty->mode.timeout = mode->timeout;
+    tty->owner = tty->mode.raw ? pid : -1;
+    spin_unlock_irqrestore(&tty->lock, flags);
+    return 0;
+}
+
+/* 
+ *   tty_release
+ *   DESCRIPTION: Puts every tty a halting process left in raw mode back to line editing, so the shell gets its
+ *   line back
+ *   INPUTS: pid -- process that is halting
+ *   OUTPUTS: none
+ *   Return: none
+ */
+void tty_release(int32_t pid){
+    tty_mode_t canon = { 0, 1, 0 };
+    int32_t t;
+
+    for(t = 1; t <= NUM_TERMINALS; t++){
+        if(ttys[t].owner == pid){
+            tty_set_mode(&ttys[t], &canon, -1);
+        }
+    }
+}
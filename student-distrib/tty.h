@@ -0,0 +1,48 @@
+#ifndef _X_TTY_H
+#define _X_TTY_H
+
+#include "types.h"
+#include "lib.h"
+#include "lock.h"
+
+/* longest line a terminal takes, counting the newline. Raise it here for longer lines */
+#define TTY_LINE_MAX    128
+/* room for completed lines that no program has read yet */
+#define TTY_QUEUE_SIZE  (2 * TTY_LINE_MAX)
+/* spaces a tab turns into */
+#define TTY_TAB_WIDTH   4
+
+/* ioctl requests on the terminal, must match ece391syscall.h */
+#define TTY_GETMODE     1
+#define TTY_SETMODE     2
+
+/* argument of TTY_GETMODE/TTY_SETMODE */
+typedef struct tty_mode {
+    int32_t raw;        //0 for line editing, 1 to hand every byte to read as it is typed
+    int32_t min;        //raw mode: bytes read waits for, 0 to return what is there
+    int32_t timeout;    //raw mode: milliseconds read waits at most, 0 to wait for min bytes
+} tty_mode_t;
+
+/* line discipline and input queue of one terminal */
+typedef struct tty {
+    int32_t terminal;                   //console the input is echoed to
+    uint8_t edit[TTY_LINE_MAX];         //line being typed
+    int32_t edit_len;
+    uint8_t queue[TTY_QUEUE_SIZE];      //completed lines, each ending in '\n'
+    int32_t q_head;                     //oldest byte in queue
+    volatile int32_t q_count;           //bytes in queue, raw readers wait for enough of them
+    volatile int32_t lines;             //completed lines in queue, readers wait for this to be nonzero
+    tty_mode_t mode;
+    int32_t owner;                      //pid that turned on raw mode, -1 if none
+    spinlock_t lock;                    //guards all of the above, taken by the keyboard handler too
+} tty_t;
+
+void tty_init(void);
+tty_t* tty_get(int32_t terminal);
+void tty_input(tty_t* tty, uint8_t c);
+void tty_clear_screen(tty_t* tty);
+int32_t tty_read(tty_t* tty, uint8_t* buf, int32_t nbytes);
+int32_t tty_set_mode(tty_t* tty, const tty_mode_t* mode, int32_t pid);
+void tty_release(int32_t pid);
+
+#endif
@@ -15,6 +15,14 @@
 #define USER_DS     0x002B
 #define KERNEL_TSS  0x0030
 #define KERNEL_LDT  0x0038
+/* the other cpus' TSSs follow the LDT, cpu n (n >= 1) uses CPU_TSS_BASE + (n - 1) * 8 */
+#define CPU_TSS_BASE 0x0040
+
+/* cpus the kernel brings up, the rest are left halted */
+#define MAX_CPUS    8
+
+/* the double fault task's TSS, after the cpus' ones. See kstack.c */
+#define DF_TSS      (CPU_TSS_BASE + (MAX_CPUS - 1) * 8)
 
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE    104
@@ -41,7 +49,7 @@ void Invalid_TSS();
 void Segment_Not_Present();
 void Stack_Segment_Fault();
 void General_Protection_Fault();
-void Page_Fault();
+void Page_Fault(uint32_t error);
 void x87_Floating_Point_Exception();
 void Alignment_Check();
 void Machine_Check();
@@ -50,6 +58,8 @@ void SIMD_Floating_Point_exception();
 //interrupts
 void keyboard_handler();
 void rtc_handler();
+void serial_handler();
+void timer_handler();
 //system call
 void idtSyscall();
 
@@ -79,6 +89,9 @@ void SIMD_Floating_Point_exception_asm();
 //interrupts
 void keyboard_handler_asm();
 void rtc_handler_asm();
+void serial_handler_asm();
+void timer_handler_asm();
+void apic_spurious_asm();
 //system call
 void idtSyscall_asm();
 
@@ -182,6 +195,8 @@ extern uint32_t ldt;
 extern uint32_t tss_size;
 extern seg_desc_t tss_desc_ptr;
 extern tss_t tss;
+extern seg_desc_t cpu_tss_desc_ptr[MAX_CPUS - 1];
+extern seg_desc_t df_tss_desc_ptr;
 
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim)                          \
@@ -0,0 +1,101 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define SBUFSIZE 33
+#define MAX_CPUS 8
+#define NUM_TERMINALS 3
+
+/* must match sched_cpu_stat_t in the kernel's sched.h */
+struct sched_cpu_stat {
+    uint32_t online;
+    uint32_t running;
+    uint32_t queued;
+    uint32_t switches;
+    uint32_t steals;
+    uint32_t stolen;
+};
+
+/* must match sched_task_stat_t in the kernel's sched.h */
+struct sched_task_stat {
+    uint32_t cpu;
+    uint32_t state;
+    uint32_t migrations;
+    uint32_t prio;
+    uint32_t nice;
+};
+
+/* must match sched_stat_t in the kernel's sched.h */
+struct sched_stat {
+    uint32_t num_cpus;
+    struct sched_cpu_stat cpu[MAX_CPUS];
+    struct sched_task_stat task[NUM_TERMINALS];
+};
+
+static const char* states[] = { "empty", "runnable", "running", "waiting" };
+
+/*
+ * Shows where the terminals' tasks run and how the cpus share them out:
+ * task switches, tasks stolen by idle cpus and migrations per terminal.
+ * "cpustat -r" clears the counters after printing them.
+ */
+int main ()
+{
+    struct sched_stat st;
+    uint8_t buf[SBUFSIZE];
+    int32_t fd, cnt, got;
+    uint32_t i;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"schedstat"))) {
+        ece391_fdputs (1, (uint8_t*)"schedstat open failed\n");
+        return 2;
+    }
+    got = 0;
+    while (got < (int32_t)sizeof (st) &&
+           0 < (cnt = ece391_read (fd, (uint8_t*)&st + got, sizeof (st) - got)))
+        got += cnt;
+
+    ece391_fdputs (1, (uint8_t*)"cpu running queued switches steals stolen\n");
+    for (i = 0; i < st.num_cpus && i < MAX_CPUS; i++) {
+        ece391_put_num (1, i, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        if (0 == st.cpu[i].running)
+            ece391_fdputs (1, (uint8_t*)"idle");
+        else {
+            ece391_fdputs (1, (uint8_t*)"tty");
+            ece391_put_num (1, st.cpu[i].running, 10);
+        }
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, st.cpu[i].queued, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, st.cpu[i].switches, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, st.cpu[i].steals, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, st.cpu[i].stolen, 10);
+        ece391_fdputs (1, (uint8_t*)"\n");
+    }
+
+    ece391_fdputs (1, (uint8_t*)"tty cpu state migrations level nice\n");
+    for (i = 0; i < NUM_TERMINALS; i++) {
+        ece391_put_num (1, i + 1, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, st.task[i].cpu, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_fdputs (1, (uint8_t*)(st.task[i].state < 4 ? states[st.task[i].state] : "?"));
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, st.task[i].migrations, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, st.task[i].prio, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, st.task[i].nice, 10);
+        ece391_fdputs (1, (uint8_t*)"\n");
+    }
+
+    if (0 == ece391_getargs (buf, SBUFSIZE - 1) &&
+        0 == ece391_strncmp (buf, (uint8_t*)"-r", 3))
+        ece391_write (fd, buf, 1);
+    ece391_close (fd);
+    return 0;
+}
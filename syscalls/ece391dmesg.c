@@ -0,0 +1,50 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 1024
+#define SBUFSIZE 33
+
+/* 
+ * Prints the kernel log.  Every line of the kmsg device is
+ * "<level>[seconds.microseconds] text"; with a level (0 errors ... 3 debug) as the
+ * argument only messages at that level or more important are shown.
+ */
+int main ()
+{
+    uint8_t buf[BUFSIZE + 1];
+    uint8_t arg[SBUFSIZE];
+    int32_t fd, cnt, start, i;
+    int32_t max_level = 9;
+
+    if (0 == ece391_getargs (arg, SBUFSIZE - 1)) {
+        max_level = arg[0] - '0';
+        if (max_level < 0 || max_level > 9) {
+            ece391_fdputs (1, (uint8_t*)"usage: dmesg [level]\n");
+            return 3;
+        }
+    }
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"kmsg"))) {
+        ece391_fdputs (1, (uint8_t*)"kmsg open failed\n");
+        return 2;
+    }
+
+    /* the device only hands out whole lines, so every read starts on one */
+    while (0 < (cnt = ece391_read (fd, buf, BUFSIZE))) {
+        buf[cnt] = '\0';
+        for (start = 0; start < cnt; start = i + 1) {
+            for (i = start; i < cnt && '\n' != buf[i]; i++)
+                ;
+            if ('<' == buf[start] && buf[start + 1] - '0' > max_level)
+                continue;
+            buf[i] = '\0';
+            ece391_fdputs (1, buf + start);
+            ece391_fdputs (1, (uint8_t*)"\n");
+        }
+    }
+
+    ece391_close (fd);
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define SBUFSIZE 33
+#define PAGE_SIZE 4096
+#define TOUCHED 8
+#define CHILD_STATUS 42
+
+/* big enough to span several pages, each written by the child is copied */
+static uint8_t data[TOUCHED * PAGE_SIZE];
+
+/*
+ * Forks once.  The child overwrites a few pages of memory it shares with
+ * the parent and halts with a status of its own.  The parent waits for
+ * it, checks that wait names that child and hands back its status, and
+ * that none of the child's writes reached its copy.  With any argument
+ * fork and wait are called through sysenter instead.
+ */
+int main ()
+{
+    uint8_t buf[SBUFSIZE];
+    int32_t fast, child, pid, status;
+    uint32_t i;
+
+    for (i = 0; i < TOUCHED; i++)
+        data[i * PAGE_SIZE] = 'p';
+    fast = (0 == ece391_getargs (buf, SBUFSIZE - 1) && '\0' != buf[0]);
+
+    child = fast ? ece391_fast_fork () : ece391_fork ();
+    if (-1 == child) {
+        ece391_fdputs (1, (uint8_t*)"fork failed\n");
+        return 2;
+    }
+    if (0 == child) {
+        for (i = 0; i < TOUCHED; i++)
+            data[i * PAGE_SIZE] = 'c';
+        ece391_fdputs (1, (uint8_t*)"child wrote ");
+        ece391_put_num (1, TOUCHED, 10);
+        ece391_fdputs (1, (uint8_t*)" pages\n");
+        return CHILD_STATUS;
+    }
+
+    pid = fast ? ece391_fast_wait (&status) : ece391_wait (&status);
+    for (i = 0; i < TOUCHED; i++) {
+        if ('p' != data[i * PAGE_SIZE]) {
+            ece391_fdputs (1, (uint8_t*)"parent saw the child's write\n");
+            return 1;
+        }
+    }
+    ece391_fdputs (1, (uint8_t*)"parent: child ");
+    ece391_put_num (1, child, 10);
+    ece391_fdputs (1, (uint8_t*)" halted with ");
+    ece391_put_num (1, status, 10);
+    if (pid != child) {
+        ece391_fdputs (1, (uint8_t*)", but wait returned ");
+        ece391_put_num (1, pid, 10);
+        ece391_fdputs (1, (uint8_t*)"\n");
+        return 1;
+    }
+    if (CHILD_STATUS != status) {
+        ece391_fdputs (1, (uint8_t*)", not the status it returned\n");
+        return 1;
+    }
+    ece391_fdputs (1, (uint8_t*)", memory unchanged\n");
+    return 0;
+}
@@ -9,19 +9,27 @@
 int32_t
 do_one_file (const char* s, const char* fname) 
 {
-    int32_t fd, cnt, last, line_start, line_end, check, s_len;
-    uint8_t data[BUFSIZE+1];
+    int32_t fd, cnt, last, size, line_start, line_end, check, s_len;
+    uint8_t* data;
+    uint8_t* grown;
 
     s_len = ece391_strlen ((uint8_t*)s);
     if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
         ece391_fdputs (1, (uint8_t*)"file open failed\n");
         return -1;
     }
+    /* doubled whenever a line does not fit, so no line is cut short */
+    size = BUFSIZE;
+    if (0 == (data = ece391_malloc (size + 1))) {
+        ece391_fdputs (1, (uint8_t*)"out of memory\n");
+        return -1;
+    }
     last = 0;
     while (1) {
-        cnt = ece391_read (fd, data + last, BUFSIZE - last);
+        cnt = ece391_fast_read (fd, data + last, size - last);
 	if (-1 == cnt) {
             ece391_fdputs (1, (uint8_t*)"file read failed\n");
+            ece391_free (data);
             return -1;
 	}
 	last += cnt;
@@ -30,11 +38,21 @@ do_one_file (const char* s, const char* fname)
 	    line_end = line_start;
 	    while (line_end < last && '\n' != data[line_end])
 		line_end++;
-	    if ('\n' != data[line_end] && 0 != cnt && line_start != 0) {
-		/* copy from line_start to last down to 0 and fix last */
-		data[line_end] = '\0';
-		ece391_strcpy (data, data + line_start);
-		last -= line_start;
+	    if (line_end == last && 0 != cnt) {
+		if (0 != line_start) {
+		    /* copy from line_start to last down to 0 and fix last */
+		    data[line_end] = '\0';
+		    ece391_strcpy (data, data + line_start);
+		    last -= line_start;
+		} else if (last == size) {
+		    if (0 == (grown = ece391_realloc (data, 2 * size + 1))) {
+			ece391_fdputs (1, (uint8_t*)"out of memory\n");
+			ece391_free (data);
+			return -1;
+		    }
+		    data = grown;
+		    size *= 2;
+		}
 		break;
 	    }
 	    /* search the line */
@@ -58,6 +76,7 @@ do_one_file (const char* s, const char* fname)
 	if (0 == cnt)
 	    break;
     }
+    ece391_free (data);
     if (-1 == ece391_close (fd)) {
         ece391_fdputs (1, (uint8_t*)"file close failed\n");
         return -1;
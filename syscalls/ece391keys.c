@@ -0,0 +1,53 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define SBUFSIZE 33
+/* how long each read waits for a key, in milliseconds */
+#define KEY_TIMEOUT 500
+
+/* 
+ * Prints the code of every key as it is typed, using the terminal's raw
+ * mode, and a dot for every half second without a key.  q quits.
+ */
+int main ()
+{
+    struct tty_mode mode;
+    uint8_t buf[SBUFSIZE];
+    uint8_t c;
+    int32_t cnt;
+
+    mode.raw = 1;
+    mode.min = 0;
+    mode.timeout = KEY_TIMEOUT;
+    if (-1 == ece391_ioctl (0, TTY_SETMODE, &mode)) {
+        ece391_fdputs (1, (uint8_t*)"could not switch the terminal to raw mode\n");
+        return 3;
+    }
+    ece391_fdputs (1, (uint8_t*)"press keys, q quits\n");
+
+    while (1) {
+        cnt = ece391_read (0, &c, 1);
+        if (-1 == cnt) {
+            ece391_fdputs (1, (uint8_t*)"read failed\n");
+            break;
+        }
+        if (0 == cnt) {
+            ece391_fdputs (1, (uint8_t*)".");
+            continue;
+        }
+        if ('q' == c)
+            break;
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_itoa (c, buf, 10);
+        ece391_fdputs (1, buf);
+    }
+    ece391_fdputs (1, (uint8_t*)"\n");
+
+    mode.raw = 0;
+    mode.min = 1;
+    mode.timeout = 0;
+    ece391_ioctl (0, TTY_SETMODE, &mode);
+    return 0;
+}
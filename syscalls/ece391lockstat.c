@@ -0,0 +1,86 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define SBUFSIZE 33
+#define MAX_LOCKS 16
+#define LOCK_NAME_LEN 12
+
+/* must match lock_stat_t in the kernel's lock.h */
+struct lock_stat {
+    uint8_t name[LOCK_NAME_LEN];
+    uint32_t acquired;
+    uint32_t contended;
+    uint32_t wait_lo;
+    uint32_t wait_hi;
+    uint32_t hold_lo;
+    uint32_t hold_hi;
+    uint32_t hold_max;
+};
+
+/* must match lock_stats_t in the kernel's lock.h */
+struct lock_stats {
+    uint32_t num_locks;
+    struct lock_stat lock[MAX_LOCKS];
+};
+
+/* average without 64-bit division, which needs libgcc */
+static uint32_t
+average (uint32_t lo, uint32_t hi, uint32_t cnt)
+{
+    while (0 != hi) {
+        lo = (lo >> 1) | (hi << 31);
+        hi >>= 1;
+        cnt >>= 1;
+    }
+    if (0 == cnt)
+        return 0;
+    return lo / cnt;
+}
+
+/*
+ * Prints how often each kernel lock was taken, how often it had to be
+ * waited for and the average wait and hold times in cycles.
+ * "lockstat -r" clears the counters after printing them.
+ */
+int main ()
+{
+    static struct lock_stats st;
+    struct lock_stat* l;
+    uint8_t buf[SBUFSIZE];
+    int32_t fd, cnt, got;
+    uint32_t i;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"lockstat"))) {
+        ece391_fdputs (1, (uint8_t*)"lockstat open failed\n");
+        return 2;
+    }
+    got = 0;
+    while (got < (int32_t)sizeof (st) &&
+           0 < (cnt = ece391_read (fd, (uint8_t*)&st + got, sizeof (st) - got)))
+        got += cnt;
+
+    ece391_fdputs (1, (uint8_t*)"lock acquired contended avg-wait avg-hold max-hold (cycles)\n");
+    for (i = 0; i < st.num_locks && i < MAX_LOCKS; i++) {
+        l = &st.lock[i];
+        ece391_fdputs (1, l->name);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, l->acquired, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, l->contended, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, average (l->wait_lo, l->wait_hi, l->contended), 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, average (l->hold_lo, l->hold_hi, l->acquired), 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, l->hold_max, 10);
+        ece391_fdputs (1, (uint8_t*)"\n");
+    }
+
+    if (0 == ece391_getargs (buf, SBUFSIZE - 1) &&
+        0 == ece391_strncmp (buf, (uint8_t*)"-r", 3))
+        ece391_write (fd, buf, 1);
+    ece391_close (fd);
+    return 0;
+}
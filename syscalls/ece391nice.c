@@ -0,0 +1,37 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define SBUFSIZE 33
+#define LOWEST_LEVEL 3
+
+/* 
+ * nice [<level>/]<program>: runs program at scheduling level level,
+ * the lowest (3) if none is given.  getargs only passes one word, so
+ * the program gets no arguments of its own.
+ */
+int main ()
+{
+    uint8_t arg[SBUFSIZE];
+    uint8_t* cmd = arg;
+    int32_t level = LOWEST_LEVEL;
+    int32_t ret;
+
+    if (0 != ece391_getargs (arg, SBUFSIZE - 1) || '\0' == arg[0]) {
+        ece391_fdputs (1, (uint8_t*)"usage: nice [<level>/]<program>\n");
+        return 3;
+    }
+    if (arg[0] >= '0' && arg[0] <= '9' && '/' == arg[1]) {
+        level = arg[0] - '0';
+        cmd = arg + 2;
+    }
+
+    /* nice(0) reads the level this program runs at */
+    ece391_nice (level - ece391_nice (0));
+    if (-1 == (ret = ece391_execute (cmd))) {
+        ece391_fdputs (1, (uint8_t*)"no such program\n");
+        return 2;
+    }
+    return ret;
+}
@@ -0,0 +1,64 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define SBUFSIZE 33
+
+/* parses a decimal number, returns -1 for anything else */
+static int32_t
+parse_ms (const uint8_t* s, uint32_t* ms)
+{
+    uint32_t value = 0;
+
+    if ('\0' == *s)
+        return -1;
+    for (; '\0' != *s; s++) {
+        if (*s < '0' || *s > '9')
+            return -1;
+        value = value * 10 + (*s - '0');
+    }
+    *ms = value;
+    return 0;
+}
+
+/* 
+ * sleep <ms>[/<alarm ms>]: sleeps for ms milliseconds.  With a second
+ * number (getargs only passes one word) an alarm is set first, and if it
+ * goes off before the sleep is over the time that was left is printed.
+ */
+int main ()
+{
+    uint8_t arg[SBUFSIZE];
+    uint8_t buf[SBUFSIZE];
+    uint8_t* second;
+    uint32_t ms, alarm_ms;
+    int32_t left;
+
+    if (0 != ece391_getargs (arg, SBUFSIZE - 1))
+        goto usage;
+    for (second = arg; '\0' != *second && '/' != *second; second++)
+        ;
+    if ('/' == *second) {
+        *second++ = '\0';
+        if (0 != parse_ms (second, &alarm_ms))
+            goto usage;
+        (void)ece391_alarm (alarm_ms);
+    }
+    if (0 != parse_ms (arg, &ms))
+        goto usage;
+
+    left = ece391_sleep (ms);
+    (void)ece391_alarm (0);
+    if (0 != left) {
+        ece391_fdputs (1, (uint8_t*)"alarm, ");
+        ece391_itoa (left, buf, 10);
+        ece391_fdputs (1, buf);
+        ece391_fdputs (1, (uint8_t*)" ms left\n");
+    }
+    return 0;
+
+usage:
+    ece391_fdputs (1, (uint8_t*)"usage: sleep <ms>[/<alarm ms>]\n");
+    return 3;
+}
@@ -0,0 +1,179 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+#include "ece391sysnum.h"
+
+#define SBUFSIZE 33
+#define MAX_PROCESSES 6
+#define NUM_SYSCALLS 20
+#define HIST_BUCKETS 32
+#define RECORDS_PER_READ 16
+
+/* must match syscall_record_t in the kernel's syscall_trace.h */
+struct syscall_record {
+    uint32_t pid;
+    uint32_t num;
+    uint32_t args[3];
+    int32_t ret;
+    uint32_t cycles;
+};
+
+/* must match syscall_stats_t in the kernel's syscall_trace.h */
+struct syscall_stats {
+    uint32_t count;
+    uint32_t errors;
+    uint32_t total_lo;
+    uint32_t total_hi;
+    uint32_t max_cycles;
+    uint32_t hist[HIST_BUCKETS];
+};
+
+static const char* names[NUM_SYSCALLS] = {
+    "halt", "execute", "read", "write", "open",
+    "close", "getargs", "vidmap", "set_handler", "sigreturn",
+    "ioctl",
+    "gettime", "sleep", "alarm", "nice", "fork",
+    "sbrk", "mmap", "munmap", "wait"
+};
+
+static void
+put_int (int32_t value)
+{
+    if (value < 0) {
+        ece391_fdputs (1, (uint8_t*)"-");
+        value = -value;
+    }
+    ece391_put_num (1, value, 10);
+}
+
+static const char*
+name_of (uint32_t num)
+{
+    if (num < 1 || num > NUM_SYSCALLS)
+        return "?";
+    return names[num - 1];
+}
+
+/* average without 64-bit division, which needs libgcc */
+static uint32_t
+average (const struct syscall_stats* st)
+{
+    uint32_t lo = st->total_lo, hi = st->total_hi, cnt = st->count;
+
+    while (0 != hi) {
+        lo = (lo >> 1) | (hi << 31);
+        hi >>= 1;
+        cnt >>= 1;
+    }
+    if (0 == cnt)
+        return 0;
+    return lo / cnt;
+}
+
+static int32_t
+dump_stats (void)
+{
+    struct syscall_stats stats[NUM_SYSCALLS];
+    int32_t fd, cnt, got, i, b;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"sysstat"))) {
+        ece391_fdputs (1, (uint8_t*)"sysstat open failed\n");
+        return -1;
+    }
+    got = 0;
+    while (got < (int32_t)sizeof (stats) &&
+           0 < (cnt = ece391_read (fd, (uint8_t*)stats + got, sizeof (stats) - got)))
+        got += cnt;
+    ece391_close (fd);
+
+    ece391_fdputs (1, (uint8_t*)"call        count  errors  avg  max (cycles)\n");
+    for (i = 0; i < NUM_SYSCALLS; i++) {
+        if (0 == stats[i].count)
+            continue;
+        ece391_fdputs (1, (uint8_t*)name_of (i + 1));
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, stats[i].count, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, stats[i].errors, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, average (&stats[i]), 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, stats[i].max_cycles, 10);
+        ece391_fdputs (1, (uint8_t*)"\n  ");
+        /* log2 histogram, only the buckets that were hit */
+        for (b = 0; b < HIST_BUCKETS; b++) {
+            if (0 == stats[i].hist[b])
+                continue;
+            ece391_fdputs (1, (uint8_t*)"2^");
+            ece391_put_num (1, b, 10);
+            ece391_fdputs (1, (uint8_t*)":");
+            ece391_put_num (1, stats[i].hist[b], 10);
+            ece391_fdputs (1, (uint8_t*)" ");
+        }
+        ece391_fdputs (1, (uint8_t*)"\n");
+    }
+    return 0;
+}
+
+static int32_t
+dump_ring (int32_t fd, int32_t pid)
+{
+    struct syscall_record recs[RECORDS_PER_READ];
+    int32_t cnt, i;
+
+    if (-1 == ece391_write (fd, &pid, sizeof (pid)))
+        return -1;
+    while (0 < (cnt = ece391_read (fd, recs, sizeof (recs)))) {
+        for (i = 0; i < cnt / (int32_t)sizeof (struct syscall_record); i++) {
+            ece391_put_num (1, recs[i].pid, 10);
+            ece391_fdputs (1, (uint8_t*)" ");
+            ece391_fdputs (1, (uint8_t*)name_of (recs[i].num));
+            ece391_fdputs (1, (uint8_t*)"(");
+            ece391_put_num (1, recs[i].args[0], 16);
+            ece391_fdputs (1, (uint8_t*)", ");
+            ece391_put_num (1, recs[i].args[1], 16);
+            ece391_fdputs (1, (uint8_t*)", ");
+            ece391_put_num (1, recs[i].args[2], 16);
+            ece391_fdputs (1, (uint8_t*)") = ");
+            put_int (recs[i].ret);
+            ece391_fdputs (1, (uint8_t*)" <");
+            ece391_put_num (1, recs[i].cycles, 10);
+            ece391_fdputs (1, (uint8_t*)">\n");
+        }
+    }
+    return 0;
+}
+
+/* 
+ * Prints the per call counters and latency histograms, then the recent
+ * system calls of the pid given as argument, or of every pid.
+ */
+int main ()
+{
+    uint8_t buf[SBUFSIZE];
+    int32_t fd, pid;
+
+    if (0 != dump_stats ())
+        return 2;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"strace"))) {
+        ece391_fdputs (1, (uint8_t*)"strace open failed\n");
+        return 2;
+    }
+
+    if (0 == ece391_getargs (buf, SBUFSIZE - 1)) {
+        pid = buf[0] - '0';
+        if (pid < 0 || pid >= MAX_PROCESSES || 0 != dump_ring (fd, pid)) {
+            ece391_fdputs (1, (uint8_t*)"bad pid\n");
+            return 3;
+        }
+    } else {
+        for (pid = 0; pid < MAX_PROCESSES; pid++)
+            dump_ring (fd, pid);
+    }
+
+    ece391_close (fd);
+    return 0;
+}
+
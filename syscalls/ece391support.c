@@ -18,7 +18,7 @@ void ece391_strcpy(uint8_t* dst, const uint8_t* src)
 
 void ece391_fdputs(int32_t fd, const uint8_t* s)
 {
-    (void)ece391_write (fd, s, ece391_strlen(s));
+    (void)ece391_fast_write (fd, s, ece391_strlen(s));
 }
 
 int32_t ece391_strcmp(const uint8_t* s1, const uint8_t* s2)
@@ -80,6 +80,17 @@ uint8_t* ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix)
         return ece391_strrev(buf);
 }
 
+/* Write a number to fd in base "radix", hexadecimal gets a 0x prefix */
+void ece391_put_num(int32_t fd, uint32_t value, int32_t radix)
+{
+    uint8_t buf[33];
+
+    if (16 == radix)
+        ece391_fdputs (fd, (uint8_t*)"0x");
+    ece391_itoa (value, buf, radix);
+    ece391_fdputs (fd, buf);
+}
+
 /* In-place string reversal */
 uint8_t* ece391_strrev(uint8_t* s)
 {
@@ -102,3 +113,103 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+
+/*
+ * Heap allocator.  A request of up to MALLOC_SMALL bytes goes in a block
+ * of the smallest power of two size class from MALLOC_MIN up that holds
+ * it and its header, taken from that class's free list.  An empty list is
+ * refilled with a page from sbrk cut into blocks of the class.  Anything
+ * bigger gets whole pages of its own from mmap, given back by free.
+ */
+#define MALLOC_PAGE     4096
+#define MALLOC_MIN      16
+#define MALLOC_CLASSES  8
+#define MALLOC_SMALL    ((MALLOC_MIN << (MALLOC_CLASSES - 1)) - sizeof (struct malloc_hdr))
+#define MALLOC_BIG      MALLOC_CLASSES
+
+/* in front of every block, 8 bytes so what follows stays 8 byte aligned */
+struct malloc_hdr {
+    uint32_t class;             /* size class, MALLOC_BIG for a mapping */
+    uint32_t pages;             /* pages of the mapping */
+};
+
+/* a free block keeps the next one on its list where the data goes */
+static void* free_list[MALLOC_CLASSES];
+
+/* Usable bytes of a block */
+static uint32_t malloc_capacity(const struct malloc_hdr* hdr)
+{
+    if (MALLOC_BIG == hdr->class)
+        return hdr->pages * MALLOC_PAGE - sizeof (struct malloc_hdr);
+    return (MALLOC_MIN << hdr->class) - sizeof (struct malloc_hdr);
+}
+
+void* ece391_malloc(uint32_t size)
+{
+    struct malloc_hdr* hdr;
+    uint8_t* page;
+    uint32_t class, block, off, pages;
+
+    if (size > MALLOC_SMALL) {
+        if (size > 0x7FFFFFFF - MALLOC_PAGE)
+            return 0;
+        pages = (size + sizeof (struct malloc_hdr) + MALLOC_PAGE - 1) / MALLOC_PAGE;
+        hdr = ece391_fast_mmap (pages * MALLOC_PAGE);
+        if ((void*)-1 == hdr)
+            return 0;
+        hdr->class = MALLOC_BIG;
+        hdr->pages = pages;
+        return hdr + 1;
+    }
+
+    for (class = 0; (MALLOC_MIN << class) - sizeof (struct malloc_hdr) < size; class++);
+    if (0 == free_list[class]) {
+        page = ece391_fast_sbrk (MALLOC_PAGE);
+        if ((void*)-1 == page)
+            return 0;
+        block = MALLOC_MIN << class;
+        for (off = 0; off + block <= MALLOC_PAGE; off += block) {
+            hdr = (struct malloc_hdr*)(page + off);
+            hdr->class = class;
+            *(void**)(hdr + 1) = free_list[class];
+            free_list[class] = hdr;
+        }
+    }
+    hdr = free_list[class];
+    free_list[class] = *(void**)(hdr + 1);
+    return hdr + 1;
+}
+
+void ece391_free(void* ptr)
+{
+    struct malloc_hdr* hdr;
+
+    if (0 == ptr)
+        return;
+    hdr = (struct malloc_hdr*)ptr - 1;
+    if (MALLOC_BIG == hdr->class) {
+        (void)ece391_fast_munmap (hdr, hdr->pages * MALLOC_PAGE);
+        return;
+    }
+    *(void**)ptr = free_list[hdr->class];
+    free_list[hdr->class] = hdr;
+}
+
+/* Grows a block by moving it when it does not fit any more, shrinking keeps it */
+void* ece391_realloc(void* ptr, uint32_t size)
+{
+    uint32_t cap, i;
+    uint8_t* copy;
+
+    if (0 == ptr)
+        return ece391_malloc (size);
+    cap = malloc_capacity ((struct malloc_hdr*)ptr - 1);
+    if (size <= cap)
+        return ptr;
+    if (0 == (copy = ece391_malloc (size)))
+        return 0;
+    for (i = 0; i < cap; i++)
+        copy[i] = ((uint8_t*)ptr)[i];
+    ece391_free (ptr);
+    return copy;
+}
@@ -0,0 +1,80 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define ITERATIONS 100000
+#define SBUFSIZE 33
+
+/* low 32 bits of the time stamp counter, plenty for one timed loop */
+static inline uint32_t
+rdtsc_lo (void)
+{
+    uint32_t lo, hi;
+
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return lo;
+}
+
+/* nanoseconds from a to b, fine for loops shorter than four seconds */
+static uint32_t
+elapsed_ns (const struct ece391_time* a, const struct ece391_time* b)
+{
+    return (b->sec - a->sec) * 1000000000 + b->nsec - a->nsec;
+}
+
+static void
+print_result (const char* name, uint32_t cycles, uint32_t ns)
+{
+    uint8_t buf[SBUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_itoa (cycles / ITERATIONS, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)" cycles, ");
+    ece391_itoa (ns / ITERATIONS, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)" ns per round trip\n");
+}
+
+/* 
+ * Times a system call round trip through int $0x80 and through sysenter.
+ * close(-1) is rejected right after dispatch, so the loop measures little
+ * more than the entry and exit paths.
+ */
+int main ()
+{
+    uint32_t i, start, int_cycles, fast_cycles, int_ns, fast_ns;
+    struct ece391_time t0, t1;
+
+    /* warm up both paths */
+    for (i = 0; i < 1000; i++) {
+        (void)ece391_close (-1);
+        (void)ece391_fast_close (-1);
+    }
+
+    (void)ece391_fast_gettime (&t0);
+    start = rdtsc_lo ();
+    for (i = 0; i < ITERATIONS; i++)
+        (void)ece391_close (-1);
+    int_cycles = rdtsc_lo () - start;
+    (void)ece391_fast_gettime (&t1);
+    int_ns = elapsed_ns (&t0, &t1);
+
+    (void)ece391_fast_gettime (&t0);
+    start = rdtsc_lo ();
+    for (i = 0; i < ITERATIONS; i++)
+        (void)ece391_fast_close (-1);
+    fast_cycles = rdtsc_lo () - start;
+    (void)ece391_fast_gettime (&t1);
+    fast_ns = elapsed_ns (&t0, &t1);
+
+    print_result ("int $0x80: ", int_cycles, int_ns);
+    if (ece391_sysenter_ok)
+        print_result ("sysenter:  ", fast_cycles, fast_ns);
+    else
+        ece391_fdputs (1, (uint8_t*)"sysenter:  not supported, the fast calls used int $0x80\n");
+
+    return 0;
+}
+
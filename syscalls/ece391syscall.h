@@ -3,6 +3,15 @@
 
 #include <stdint.h>
 
+/* 
+ * Time since boot from gettime, counted by the TSC and calibrated
+ * against the PIT.  Must match clock_time_t in the kernel.
+ */
+struct ece391_time {
+	uint32_t sec;
+	uint32_t nsec;
+};
+
 /* All calls return >= 0 on success or -1 on failure. */
 
 /*  
@@ -21,6 +30,94 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+extern int32_t ece391_ioctl (int32_t fd, int32_t request, void* arg);
+extern int32_t ece391_gettime (struct ece391_time* t);
+extern int32_t ece391_sleep (uint32_t ms);
+extern int32_t ece391_alarm (uint32_t ms);
+extern int32_t ece391_nice (int32_t inc);
+extern int32_t ece391_fork (void);
+extern void* ece391_sbrk (int32_t increment);
+extern void* ece391_mmap (uint32_t length);
+extern int32_t ece391_munmap (void* addr, uint32_t length);
+extern int32_t ece391_wait (int32_t* status);
+
+/* 
+ * Same calls entering the kernel through sysenter/sysexit rather than
+ * int $0x80.  They behave identically but skip the interrupt gate.  On a
+ * CPU without sysenter (ece391_sysenter_ok is 0) they use int $0x80.
+ */
+extern int32_t ece391_sysenter_ok;
+extern int32_t ece391_fast_halt (uint8_t status);
+extern int32_t ece391_fast_execute (const uint8_t* command);
+extern int32_t ece391_fast_read (int32_t fd, void* buf, int32_t nbytes);
+extern int32_t ece391_fast_write (int32_t fd, const void* buf, int32_t nbytes);
+extern int32_t ece391_fast_open (const uint8_t* filename);
+extern int32_t ece391_fast_close (int32_t fd);
+extern int32_t ece391_fast_getargs (uint8_t* buf, int32_t nbytes);
+extern int32_t ece391_fast_vidmap (uint8_t** screen_start);
+extern int32_t ece391_fast_set_handler (int32_t signum, void* handler);
+extern int32_t ece391_fast_sigreturn (void);
+extern int32_t ece391_fast_ioctl (int32_t fd, int32_t request, void* arg);
+extern int32_t ece391_fast_gettime (struct ece391_time* t);
+extern int32_t ece391_fast_sleep (uint32_t ms);
+extern int32_t ece391_fast_alarm (uint32_t ms);
+extern int32_t ece391_fast_nice (int32_t inc);
+extern int32_t ece391_fast_fork (void);
+extern void* ece391_fast_sbrk (int32_t increment);
+extern void* ece391_fast_mmap (uint32_t length);
+extern int32_t ece391_fast_munmap (void* addr, uint32_t length);
+extern int32_t ece391_fast_wait (int32_t* status);
+
+/* 
+ * sleep returns 0 after sleeping the whole time, or the milliseconds
+ * left when an ALARM set with alarm cut it short.  alarm replaces the
+ * caller's alarm (0 only cancels it) and returns what was left on the
+ * old one.  Until signals are delivered an alarm that goes off outside
+ * a sleep ends the next sleep right away.
+ */
+
+/* 
+ * nice moves the caller's scheduling level by inc (0 is the top of 4,
+ * the value is clamped) and returns the new level.  Programs it executes
+ * start at the same level.
+ */
+
+/* 
+ * fork starts a copy of the caller that returns 0 from the call, with
+ * the same memory (copied page by page as either side writes to it) and
+ * the same open files.  The child runs beside the parent on the same
+ * terminal; the parent gets the child's pid back right away.  wait
+ * blocks until one of the caller's forked children halts, stores its
+ * halt status (unless status is NULL) and returns its pid, which is
+ * free for reuse from then on.  It returns -1 at once when the caller
+ * has no forked children left.  Children that outlive their parent
+ * are cleaned up when they halt.
+ */
+
+/* 
+ * sbrk moves the end of the heap, which starts on the page after the
+ * program, by increment bytes and returns the old end.  mmap reserves
+ * length bytes (rounded up to pages) between the heap and the stack and
+ * returns where; munmap gives such pages back.  Both fail with
+ * (void*)-1 or -1.  Memory from either reads as zero and only takes up
+ * a page of real memory once it is touched.
+ */
+
+/* 
+ * ioctl requests on the terminal (fd 0 or 1).  TTY_SETMODE with raw set
+ * makes read return typed bytes without waiting for Enter or echoing
+ * them: read waits for min bytes, or at most timeout milliseconds when
+ * timeout is not 0, and min = timeout = 0 only polls.  Raw mode is undone
+ * when the program halts.  Must match tty.h in the kernel.
+ */
+#define TTY_GETMODE 1
+#define TTY_SETMODE 2
+
+struct tty_mode {
+	int32_t raw;
+	int32_t min;
+	int32_t timeout;
+};
 
 enum signums {
 	DIV_ZERO = 0,
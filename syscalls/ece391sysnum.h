@@ -11,5 +11,15 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_IOCTL   11
+#define SYS_GETTIME 12
+#define SYS_SLEEP   13
+#define SYS_ALARM   14
+#define SYS_NICE    15
+#define SYS_FORK    16
+#define SYS_SBRK    17
+#define SYS_MMAP    18
+#define SYS_MUNMAP  19
+#define SYS_WAIT    20
 
 #endif /* ECE391SYSNUM_H */
@@ -0,0 +1,164 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define SBUFSIZE 33
+#define MAX_PROCESSES 6
+#define NAME_LEN 33
+#define DEFAULT_MS 1000
+
+/* must match proc_stat_t in the kernel's acct.h */
+struct proc_stat {
+    uint32_t user_lo;
+    uint32_t user_hi;
+    uint32_t kernel_lo;
+    uint32_t kernel_hi;
+    int32_t pid;
+    int32_t parent;
+    int32_t terminal;
+    int32_t nice;
+    uint32_t state;
+    uint32_t switches;
+    uint32_t preempted;
+    uint32_t syscalls;
+    uint32_t page_faults;
+    uint32_t age_ms;
+    uint32_t kstack_used;
+    uint32_t user_pages;
+    uint8_t name[NAME_LEN];
+};
+
+/* must match proc_stats_t in the kernel's acct.h */
+struct proc_stats {
+    uint32_t uptime_ms;
+    uint32_t num_procs;
+    struct proc_stat proc[MAX_PROCESSES];
+};
+
+/* PROC_RUNNING, PROC_READY, PROC_SLEEPING, PROC_CHILD */
+static const char* states = "RQSWZ";
+
+static struct proc_stats before, after;
+
+/* hi:lo microseconds in milliseconds, by long division since there is no libgcc */
+static uint32_t
+us_to_ms (uint32_t lo, uint32_t hi)
+{
+    uint32_t q = 0, rem = 0;
+    int32_t bit;
+
+    for (bit = 63; bit >= 0; bit--) {
+        rem = (rem << 1) | (((bit >= 32 ? hi >> (bit - 32) : lo >> bit)) & 1);
+        q <<= 1;
+        if (rem >= 1000) {
+            rem -= 1000;
+            q |= 1;
+        }
+    }
+    return q;
+}
+
+static int32_t
+snapshot (struct proc_stats* st)
+{
+    int32_t fd, cnt, got;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"procstat")))
+        return -1;
+    got = 0;
+    while (got < (int32_t)sizeof (*st) &&
+           0 < (cnt = ece391_read (fd, (uint8_t*)st + got, sizeof (*st) - got)))
+        got += cnt;
+    ece391_close (fd);
+    return 0;
+}
+
+/* cpu time of pid between the two snapshots in tenths of a percent of the interval, 0 if it is new */
+static uint32_t
+permille (const struct proc_stat* p, uint32_t interval_us)
+{
+    uint32_t i, used;
+
+    for (i = 0; i < before.num_procs; i++) {
+        if (before.proc[i].pid != p->pid || before.proc[i].age_ms > p->age_ms)
+            continue;
+        used = (p->user_lo - before.proc[i].user_lo) +
+               (p->kernel_lo - before.proc[i].kernel_lo);
+        if (interval_us < 1000)
+            return 0;
+        /* used * 1000 / interval_us without the product, which overflows after an hour */
+        return used / (interval_us / 1000);
+    }
+    return 0;
+}
+
+/*
+ * top [<ms>]: samples every process twice, ms milliseconds apart (a
+ * second by default), and prints each one's share of one cpu over that
+ * time next to its totals since it was executed: user and kernel time,
+ * task switches (and how many were preemptions), system calls and page
+ * faults.  State is R running, Q queued, S sleeping, W waiting for a
+ * child.
+ */
+int main ()
+{
+    uint8_t arg[SBUFSIZE];
+    uint32_t ms = DEFAULT_MS, i, pm;
+    struct proc_stat* p;
+
+    if (0 == ece391_getargs (arg, SBUFSIZE - 1) && '\0' != arg[0]) {
+        ms = 0;
+        for (i = 0; arg[i] >= '0' && arg[i] <= '9'; i++)
+            ms = ms * 10 + (arg[i] - '0');
+    }
+
+    if (0 != snapshot (&before)) {
+        ece391_fdputs (1, (uint8_t*)"procstat open failed\n");
+        return 2;
+    }
+    ece391_sleep (ms);
+    snapshot (&after);
+
+    ece391_fdputs (1, (uint8_t*)"PID PPID TTY S NI %CPU USER(ms) SYS(ms) CSW(PRE) SYSCALLS PF KSTK MEM(KB) NAME\n");
+    for (i = 0; i < after.num_procs; i++) {
+        p = &after.proc[i];
+        pm = permille (p, (after.uptime_ms - before.uptime_ms) * 1000);
+        ece391_put_num (1, p->pid, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        if (p->parent < 0)
+            ece391_fdputs (1, (uint8_t*)"-");
+        else
+            ece391_put_num (1, p->parent, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, p->terminal, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_write (1, &states[p->state <= 4 ? p->state : 0], 1);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, p->nice, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, pm / 10, 10);
+        ece391_fdputs (1, (uint8_t*)".");
+        ece391_put_num (1, pm % 10, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, us_to_ms (p->user_lo, p->user_hi), 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, us_to_ms (p->kernel_lo, p->kernel_hi), 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, p->switches, 10);
+        ece391_fdputs (1, (uint8_t*)"(");
+        ece391_put_num (1, p->preempted, 10);
+        ece391_fdputs (1, (uint8_t*)") ");
+        ece391_put_num (1, p->syscalls, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, p->page_faults, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, p->kstack_used, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, p->user_pages * 4, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_fdputs (1, p->name);
+        ece391_fdputs (1, (uint8_t*)"\n");
+    }
+    return 0;
+}
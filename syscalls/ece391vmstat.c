@@ -0,0 +1,84 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define SBUFSIZE 33
+#define MAX_CPUS 8
+
+/* must match vm_cpu_stat_t in the kernel's page.h */
+struct vm_cpu_stat {
+    uint32_t tlb_full;
+    uint32_t tlb_page;
+    uint32_t tlb_kept;
+};
+
+/* must match vm_stat_t in the kernel's page.h */
+struct vm_stat {
+    uint32_t num_cpus;
+    uint32_t global_pages;
+    uint32_t frames;
+    uint32_t frames_used;
+    uint32_t cow_copies;
+    uint32_t cow_reuses;
+    uint32_t demand_pages;
+    struct vm_cpu_stat cpu[MAX_CPUS];
+};
+
+/*
+ * Shows how much user memory is in use.  Counts the writes to pages
+ * shared by fork that had to copy them, and the heap and mmap pages
+ * filled in on first use.  Then, per cpu, the whole TLB flushes (CR3
+ * loads), the single page flushes (invlpg) and the process switches that
+ * kept a directory that was still loaded.
+ * "vmstat -r" clears the counters after printing them.
+ */
+int main ()
+{
+    struct vm_stat st;
+    uint8_t buf[SBUFSIZE];
+    int32_t fd, cnt, got;
+    uint32_t i;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"vmstat"))) {
+        ece391_fdputs (1, (uint8_t*)"vmstat open failed\n");
+        return 2;
+    }
+    got = 0;
+    while (got < (int32_t)sizeof (st) &&
+           0 < (cnt = ece391_read (fd, (uint8_t*)&st + got, sizeof (st) - got)))
+        got += cnt;
+
+    ece391_fdputs (1, (uint8_t*)"user memory ");
+    ece391_put_num (1, st.frames_used * 4, 10);
+    ece391_fdputs (1, (uint8_t*)" of ");
+    ece391_put_num (1, st.frames * 4, 10);
+    ece391_fdputs (1, (uint8_t*)" KB, global kernel pages ");
+    ece391_fdputs (1, (uint8_t*)(st.global_pages ? "on\n" : "off\n"));
+    ece391_fdputs (1, (uint8_t*)"copy on write: ");
+    ece391_put_num (1, st.cow_copies, 10);
+    ece391_fdputs (1, (uint8_t*)" pages copied, ");
+    ece391_put_num (1, st.cow_reuses, 10);
+    ece391_fdputs (1, (uint8_t*)" taken back\n");
+    ece391_fdputs (1, (uint8_t*)"heap and mmap pages backed on first touch: ");
+    ece391_put_num (1, st.demand_pages, 10);
+    ece391_fdputs (1, (uint8_t*)"\n");
+
+    ece391_fdputs (1, (uint8_t*)"cpu full page kept\n");
+    for (i = 0; i < st.num_cpus && i < MAX_CPUS; i++) {
+        ece391_put_num (1, i, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, st.cpu[i].tlb_full, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, st.cpu[i].tlb_page, 10);
+        ece391_fdputs (1, (uint8_t*)" ");
+        ece391_put_num (1, st.cpu[i].tlb_kept, 10);
+        ece391_fdputs (1, (uint8_t*)"\n");
+    }
+
+    if (0 == ece391_getargs (buf, SBUFSIZE - 1) &&
+        0 == ece391_strncmp (buf, (uint8_t*)"-r", 3))
+        ece391_write (fd, buf, 1);
+    ece391_close (fd);
+    return 0;
+}